@@ -0,0 +1,341 @@
+#include "admit.h"
+#include "tsh.h"
+#include "events.h"
+#include "evlog.h"
+#include "throttle.h"
+#include "helper-routines.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/timerfd.h>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+
+struct admit_t admit = { 0, 0, 10, 0, 256, 64 };
+
+/************************************
+ * Admission control
+ ************************************/
+
+#define NPSI 3                  /* cpu, memory, io; then meminfo */
+
+struct held_t {                 /* A background command waiting to start */
+    std::string cmdline;
+    long long since;            /* when it was held, ns */
+};
+
+struct reading_t {              /* One look at the system */
+    double psi[NPSI];           /* some avg10, percent (0 if unknown) */
+    long avail;                 /* MemAvailable, MB (-1 if unknown) */
+};
+
+static const char *files[NPSI + 1] = {
+    "/proc/pressure/cpu", "/proc/pressure/memory", "/proc/pressure/io", "/proc/meminfo"
+};
+static const char *psinames[NPSI] = { "cpu", "memory", "io" };
+static int fds[NPSI + 1];
+static int opened = 0;
+
+static std::deque<held_t> held;         /* in the order they were typed */
+static std::vector<pid_t> shed;         /* jobs we stopped, oldest first */
+static int tfd = -1;
+static int releasing = 0;               /* eval is starting a held job */
+static long shedavail;                  /* MemAvailable at the last stop, MB */
+
+/* readpressure - Fill in r from the pressure files and meminfo */
+static void readpressure(struct reading_t *r)
+{
+    char buf[4096], *p;
+    ssize_t n;
+    int i;
+
+    if (!opened) {
+	for (i = 0; i <= NPSI; i++)
+	    fds[i] = open(files[i], O_RDONLY | O_CLOEXEC);
+	opened = 1;
+    }
+    for (i = 0; i < NPSI; i++) {
+	r->psi[i] = 0;
+	if (fds[i] >= 0 && (n = pread(fds[i], buf, sizeof(buf) - 1, 0)) > 0) {
+	    buf[n] = '\0';
+	    sscanf(buf, "some avg10=%lf", &r->psi[i]);
+	}
+    }
+    r->avail = -1;
+    if (fds[NPSI] >= 0 && (n = pread(fds[NPSI], buf, sizeof(buf) - 1, 0)) > 0) {
+	buf[n] = '\0';
+	if ((p = strstr(buf, "MemAvailable:")) != NULL)
+	    r->avail = strtol(p + 13, NULL, 10) / 1024;
+    }
+}
+
+/*
+ * overlimit - Which limit r is over: 1 + the PSI index, NPSI + 1 for
+ *    MemAvailable, or 0 if none. why gets it in words.
+ */
+static int overlimit(const struct reading_t *r, char *why, size_t size)
+{
+    int lim[NPSI] = { admit.cpu, admit.mem, admit.io };
+    int i;
+
+    for (i = 0; i < NPSI; i++)
+	if (lim[i] > 0 && r->psi[i] > lim[i]) {
+	    snprintf(why, size, "%s pressure %.1f%% > %d%%", psinames[i], r->psi[i], lim[i]);
+	    return i + 1;
+	}
+    if (admit.avail > 0 && r->avail >= 0 && r->avail < admit.avail) {
+	snprintf(why, size, "MemAvailable %ld MB < %ld MB", r->avail, admit.avail);
+	return NPSI + 1;
+    }
+    return 0;
+}
+
+/* anybg - True if a background job is running */
+static int anybg(void)
+{
+    int i;
+
+    for (i = 0; i < MAXJOBS; i++)
+	if (jobs[i].state == BG)
+	    return 1;
+    return 0;
+}
+
+/* addsize - procscan: add ps's RSS to its job's, if it is in a background job */
+static void addsize(const struct procstat_t *ps, void *arg)
+{
+    long *mb = (long *)arg, pages;
+    struct job_t *job;
+    const char *p = ps->tail;
+    int i;
+
+    if ((job = getjobpid(jobs, ps->pgrp)) == NULL || job->state != BG)
+	return;
+    /* Fields after the command: state ppid pgrp ... rss is the 22nd */
+    for (i = 0; i < 22 && p != NULL; i++)
+	p = strchr(p + 1, ' ');
+    if (p != NULL && sscanf(p, "%ld", &pages) == 1)
+	mb[job - jobs] += pages * (sysconf(_SC_PAGESIZE) / 1024) / 1024;
+}
+
+/*
+ * groupsizes - RSS in MB of each job's whole process group, by job
+ *    slot, from one pass over /proc
+ */
+static void groupsizes(long *mb)
+{
+    memset(mb, 0, MAXJOBS * sizeof(mb[0]));
+    procscan(addsize, mb);
+}
+
+/*
+ * shedone - Stop the background job with the largest RSS. Stopping a
+ *    job frees nothing, it only stops it growing, so after one stop the
+ *    next waits until MemAvailable has gone on falling.
+ */
+static void shedone(const struct reading_t *r)
+{
+    long mb[MAXJOBS];
+    struct job_t *job;
+    int i, big = -1;
+
+    if (!shed.empty() && r->avail >= shedavail)
+	return;
+    groupsizes(mb);
+    for (i = 0; i < MAXJOBS; i++) {
+	if (jobs[i].state != BG || (big >= 0 && mb[i] <= mb[big]))
+	    continue;
+	if (std::find(shed.begin(), shed.end(), jobs[i].pid) == shed.end())
+	    big = i;            /* (its stop may not have been reaped yet) */
+    }
+    if (big < 0)
+	return;
+    job = &jobs[big];
+    throttlejob(job, 100);      /* its SIGSTOPs would be taken for the throttler's */
+    kill(-job->pid, SIGSTOP);
+    shed.push_back(job->pid);
+    shedavail = r->avail;
+    printf("admit: stopping [%d] (%d), RSS %ld MB (MemAvailable %ld MB < %ld MB) %s",
+	   job->jid, job->pid, mb[big], r->avail, admit.reserve, job->cmdline);
+    EVLOG(nowns(), LOG_SHED, job->pid, job->jid, (int)mb[big], job->cmdline);
+}
+
+/* unshed - Continue the job stopped most recently, if it is still stopped */
+static void unshed(void)
+{
+    struct job_t *job;
+    pid_t pid = shed.back();
+
+    shed.pop_back();
+    if ((job = getjobpid(jobs, pid)) == NULL || job->state != ST)
+	return;                 /* gone, or someone else dealt with it */
+    job->state = BG;
+    kill(-pid, SIGCONT);
+    printf("admit: continuing [%d] (%d) %s", job->jid, job->pid, job->cmdline);
+    EVLOG(nowns(), LOG_CONT, pid, job->jid, 0, job->cmdline);
+}
+
+/* release - Start the oldest held command */
+static void release(void)
+{
+    struct held_t h = held.front();
+    char cmdline[MAXLINE];
+
+    held.pop_front();
+    printf("admit: starting (held %.1f s) %s", (nowns() - h.since) / 1e9, h.cmdline.c_str());
+    EVLOG(nowns(), LOG_ADMIT, 0, 0, (int)((nowns() - h.since) / 1000000), h.cmdline.c_str());
+    strcpy(cmdline, h.cmdline.c_str());
+    releasing = 1;
+    eval(cmdline);
+    releasing = 0;
+}
+
+static void tick(int fd, void *arg);
+
+/* watching - Run the recheck timer while there is anything to recheck */
+static void watching(void)
+{
+    struct itimerspec its;
+    int want = admit.on && (!held.empty() || !shed.empty() || (admit.reserve > 0 && anybg()));
+
+    if (want && tfd < 0) {
+	if ((tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+	    return;
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_nsec = its.it_interval.tv_nsec = ADMIT_RECHECK * 1000000L;
+	timerfd_settime(tfd, 0, &its, NULL);
+	if (!watchfd(tfd, tick, NULL)) {
+	    close(tfd);
+	    tfd = -1;
+	}
+    }
+    else if (!want && tfd >= 0) {
+	unwatchfd(tfd);
+	close(tfd);
+	tfd = -1;
+    }
+}
+
+/*
+ * tick - Recheck: stop a job if memory is short, else continue a
+ *    stopped one or start a held one if pressure is under the limits.
+ *    One step per tick, so the averages can catch up with it.
+ */
+static void tick(int fd, void *arg)
+{
+    struct reading_t r;
+    unsigned long long n;
+    char why[128];
+
+    read(fd, &n, sizeof(n));
+    readpressure(&r);
+    if (admit.reserve > 0 && r.avail >= 0 && r.avail < admit.reserve)
+	shedone(&r);
+    else if (!overlimit(&r, why, sizeof(why))) {
+	if (!shed.empty())
+	    unshed();
+	else if (!held.empty())
+	    release();
+    }
+    fflush(stdout);
+    watching();
+}
+
+/*
+ * admitjob - The launch path asks whether background cmdline may start
+ *    now. Returns 0 if it was held instead.
+ */
+int admitjob(char *cmdline)
+{
+    struct reading_t r;
+    struct held_t h;
+    char why[128];
+
+    if (!admit.on || releasing)
+	return 1;
+    if (!held.empty())
+	snprintf(why, sizeof(why), "%zu held before it", held.size());
+    else {
+	readpressure(&r);
+	if (!overlimit(&r, why, sizeof(why))) {
+	    watching();         /* a new bg job for the reserve to watch */
+	    return 1;
+	}
+    }
+    h.cmdline = cmdline;
+    h.since = nowns();
+    held.push_back(h);
+    printf("admit: holding (%s) %s", why, cmdline);
+    EVLOG(h.since, LOG_HOLD, 0, 0, (int)held.size(), cmdline);
+    watching();
+    return 0;
+}
+
+/* admitshow - Print the limits, the current readings and what is held */
+void admitshow(void)
+{
+    struct reading_t r;
+    size_t i;
+    struct job_t *job;
+
+    if (!admit.on) {
+	printf("admit: off\n");
+	return;
+    }
+    readpressure(&r);
+    printf("admit: on, cpu %d%%, memory %d%%, io %d%%, avail %ld MB, reserve %ld MB\n",
+	   admit.cpu, admit.mem, admit.io, admit.avail, admit.reserve);
+    printf("now: cpu %.1f%%, memory %.1f%%, io %.1f%%, avail %ld MB\n",
+	   r.psi[0], r.psi[1], r.psi[2], r.avail);
+    for (i = 0; i < shed.size(); i++)
+	if ((job = getjobpid(jobs, shed[i])) != NULL && job->state == ST)
+	    printf("stopped: [%d] (%d) %s", job->jid, job->pid, job->cmdline);
+    for (i = 0; i < held.size(); i++)
+	printf("held %.1f s: %s", (nowns() - held[i].since) / 1e9, held[i].cmdline.c_str());
+}
+
+/*
+ * admitset - Change the limits from the admit builtin's arguments:
+ *    on|off, cpu|mem|io PCT, avail|reserve MB. Turning admission off
+ *    continues what it stopped and starts what it held. Returns 0 on
+ *    a bad argument.
+ */
+int admitset(char **argv)
+{
+    const char *keys[] = { "cpu", "mem", "io", "avail", "reserve" };
+    long *mb[] = { &admit.avail, &admit.reserve };
+    int *pct[] = { &admit.cpu, &admit.mem, &admit.io };
+    int i;
+
+    if (!strcmp(argv[0], "on") && argv[1] == NULL)
+	admit.on = 1;
+    else if (!strcmp(argv[0], "off") && argv[1] == NULL) {
+	while (!shed.empty())
+	    unshed();
+	while (!held.empty())
+	    release();
+	admit.on = 0;
+    }
+    else {
+	for (i = 0; i < 5; i++)
+	    if (!strcmp(argv[0], keys[i]))
+		break;
+	if (i == 5 || argv[1] == NULL || argv[2] != NULL || !isdigit(argv[1][0]))
+	    return 0;
+	if (i < NPSI)
+	    *pct[i] = atoi(argv[1]);
+	else
+	    *mb[i - NPSI] = atol(argv[1]);
+    }
+    watching();
+    return 1;
+}
+/************************************
+ * end admission control
+ ************************************/
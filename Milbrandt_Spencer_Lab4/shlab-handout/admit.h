@@ -0,0 +1,38 @@
+//-*-c++-*-
+#ifndef _admit_h_
+#define _admit_h_
+
+/*
+ * Pressure-aware admission of background jobs (the admit builtin).
+ * With admission on, a new & job is started only while the system's
+ * pressure stall averages (/proc/pressure/{cpu,memory,io}, "some"
+ * avg10) are under their limits and MemAvailable is above its floor.
+ * Otherwise the command line is held, in order, and a recheck timer
+ * starts the held jobs one at a time once pressure has eased. If
+ * MemAvailable drops below the reserve, the running background job
+ * with the largest RSS is stopped; stopped jobs are continued before
+ * anything held is started. Every decision is printed and, with
+ * tsh -l, logged.
+ *
+ * The pressure files and /proc/meminfo are opened once and re-read
+ * with pread, so a check costs four syscalls and no /proc lookups.
+ */
+
+#define ADMIT_RECHECK 500   /* ms between rechecks while it matters */
+
+struct admit_t {            /* Admission limits, 0 = not checked */
+    int on;
+    int cpu;                /* PSI some avg10 limits, percent */
+    int mem;
+    int io;
+    long avail;             /* MemAvailable floor for new jobs, MB */
+    long reserve;           /* below this, stop the largest bg job, MB */
+};
+
+extern struct admit_t admit;
+
+int admitjob(char *cmdline);
+void admitshow(void);
+int admitset(char **argv);
+
+#endif
@@ -0,0 +1,111 @@
+#include "board.h"
+#include "tsh.h"
+#include "jobs.h"
+#include "helper-routines.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+/*****************************************
+ * Shared-memory job status board (tsh -b)
+ *****************************************/
+
+int board_on = 0;                  /* publishing enabled (-b NAME) */
+static struct board_t *board = NULL;
+static char boardname[MAXLINE];
+
+/* boardunlink - Remove the board when the shell exits */
+static void boardunlink(void)
+{
+    shm_unlink(boardname);
+}
+
+/*
+ * boardopen - Create the board as shared memory object /name, readable
+ *    only by us. One left behind by an earlier shell of ours is taken
+ *    over; one that belongs to another user, or to a shell that is
+ *    still running, is refused (EACCES, EBUSY).
+ */
+int boardopen(const char *name)
+{
+    struct stat st;
+    int fd;
+
+    snprintf(boardname, sizeof(boardname), "/%s", name[0] == '/' ? name + 1 : name);
+    if ((fd = shm_open(boardname, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600)) < 0) {
+	if (errno != EEXIST || (fd = shm_open(boardname, O_RDWR | O_CLOEXEC, 0)) < 0)
+	    return 0;
+	if (fstat(fd, &st) < 0 || st.st_uid != geteuid() || fchmod(fd, 0600) < 0) {
+	    close(fd);
+	    errno = EACCES;
+	    return 0;
+	}
+    }
+    if (ftruncate(fd, sizeof(struct board_t)) < 0) {
+	close(fd);
+	return 0;
+    }
+    board = (struct board_t *)mmap(NULL, sizeof(struct board_t), PROT_READ | PROT_WRITE,
+				   MAP_SHARED, fd, 0);
+    close(fd);
+    if (board == MAP_FAILED)
+	return 0;
+    if (!memcmp(board->magic, BOARD_MAGIC, sizeof(BOARD_MAGIC)) && board->shell != getpid() &&
+	board->shell > 0 && kill(board->shell, 0) == 0) {
+	munmap(board, sizeof(struct board_t));
+	errno = EBUSY;              /* another shell is publishing to it */
+	return 0;
+    }
+
+    board->seq.store(0, std::memory_order_relaxed);
+    board->shell = getpid();
+    board->maxjobs = MAXJOBS;
+    board->njobs = 0;
+    memcpy(board->magic, BOARD_MAGIC, sizeof(BOARD_MAGIC));
+    atexit(boardunlink);
+    board_on = 1;
+    return 1;
+}
+
+/*
+ * boardupdate - Republish the job list. Called by the shell after
+ *    anything that adds, removes or changes the state of a job.
+ */
+void boardupdate(void)
+{
+    unsigned seq;
+    int i, n = 0;
+
+    if (!board_on)
+	return;
+
+    seq = board->seq.load(std::memory_order_relaxed);
+    board->seq.store(seq + 1, std::memory_order_relaxed);   /* odd: writing */
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (i = 0; i < MAXJOBS; i++) {
+	if (jobs[i].pid != 0) {
+	    struct board_ent *e = &board->ent[n++];
+
+	    e->pid = jobs[i].pid;
+	    e->jid = jobs[i].jid;
+	    e->state = jobs[i].state;
+	    e->start = jobs[i].start;
+	    strncpy(e->cmd, jobs[i].cmdline, BOARD_CMD - 1);
+	    e->cmd[BOARD_CMD - 1] = '\0';
+	}
+    }
+    board->njobs = n;
+    board->updated = nowns();
+
+    board->seq.store(seq + 2, std::memory_order_release);   /* even: stable */
+}
+/***********************
+ * end job status board
+ ***********************/
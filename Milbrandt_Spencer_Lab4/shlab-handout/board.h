@@ -0,0 +1,44 @@
+//-*-c++-*-
+#ifndef _board_h_
+#define _board_h_
+
+#include <sys/types.h> // needed for pid_t
+#include <atomic>
+#include "globals.h"
+
+/*
+ * Shared-memory job status board (tsh -b NAME, read by tshtop).
+ *
+ * The shell copies the live jobs into a POSIX shared memory object
+ * under a seqlock: seq is odd while an update is in progress. Readers
+ * copy the entries and retry if seq was odd or changed meanwhile, so
+ * they never make a syscall and never interrupt the shell.
+ */
+#define BOARD_MAGIC "TSHBRD1"
+#define BOARD_CMD   64            /* bytes of cmdline kept per job */
+
+struct board_ent {
+    pid_t pid;                    /* job PID */
+    int jid;                      /* job ID */
+    int state;                    /* BG, FG or ST */
+    int pad;
+    long long start;              /* CLOCK_MONOTONIC ns when added */
+    char cmd[BOARD_CMD];          /* cmdline prefix, NUL terminated */
+};
+
+struct board_t {
+    char magic[8];
+    pid_t shell;                  /* PID of the publishing shell */
+    int maxjobs;                  /* capacity of ent[] */
+    std::atomic<unsigned> seq;    /* seqlock sequence, odd = writing */
+    int njobs;                    /* valid entries in ent[] */
+    long long updated;            /* CLOCK_MONOTONIC ns of last update */
+    struct board_ent ent[MAXJOBS];
+};
+
+extern int board_on;
+
+int boardopen(const char *name);
+void boardupdate(void);
+
+#endif
@@ -0,0 +1,475 @@
+#include "capture.h"
+#include "events.h"
+#include "jobs.h"
+#include "helper-routines.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <sys/uio.h>
+
+long capture_cap = 0;           /* -c SIZE or "capture SIZE" */
+int tag_on = 0;                 /* -T or "tag on" */
+int tag_fd = STDOUT_FILENO;     /* "tag -o FILE" */
+
+/***************************************
+ * Background job output capture
+ ***************************************/
+
+struct capture_t {          /* One job's captured output */
+    pid_t pid;              /* job it belongs to, 0 if the slot is free */
+    int rfd;                /* pipe read end, -1 after EOF */
+    int memfd;              /* the ring */
+    char *map;              /* memfd mapped read-only */
+    long cap;               /* ring size */
+    unsigned long long wpos;    /* bytes captured so far */
+    unsigned long long shown;   /* bytes already written to the terminal */
+    int passthru;           /* job is in the foreground: echo new output */
+    int tag;                /* forward complete lines with prefix */
+    int tagonly;            /* the ring is only there for tagging */
+    int reaped;             /* the job has finished */
+    unsigned long long scan;    /* tagged: no newline in [qpos, scan) */
+    unsigned long long qpos;    /* tagged: bytes queued for the next writev */
+    unsigned long long fwd;     /* tagged: bytes written out */
+    int plen;
+    char prefix[TAG_PREFIX];
+};
+
+static struct capture_t caps[MAXJOBS + 1];  /* indexed by job ID */
+static int pendfd[2] = { -1, -1 };          /* pipe between capbegin and capend */
+
+/* The writev batch of tagged lines; they all belong to tagowner */
+static char tagfmt[TAG_PREFIX] = "[%j] ";
+static struct iovec tagiov[TAG_IOV];
+static int ntag = 0;
+static struct capture_t *tagowner = NULL;
+static char newline[] = "\n";
+
+/* writeall - writev that finishes the job after short writes and EAGAIN */
+static void writeall(int fd, struct iovec *iov, int n)
+{
+    struct pollfd pfd = { fd, POLLOUT, 0 };
+    ssize_t w;
+
+    while (n > 0) {
+	if ((w = writev(fd, iov, n)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno == EAGAIN && poll(&pfd, 1, -1) >= 0)
+		continue;           /* a non-blocking fd that is full */
+	    return;                 /* nowhere to put it; drop the batch */
+	}
+	while (n > 0 && (size_t)w >= iov->iov_len) {
+	    w -= iov->iov_len;
+	    iov++;
+	    n--;
+	}
+	if (n > 0) {
+	    iov->iov_base = (char *)iov->iov_base + w;
+	    iov->iov_len -= w;
+	}
+    }
+}
+
+/* tagflush - Write out the batch; the ring space it used is free again */
+static void tagflush(void)
+{
+    if (ntag == 0)
+	return;
+    if (tag_fd == STDOUT_FILENO)
+	fflush(stdout);
+    writeall(tag_fd, tagiov, ntag);
+    ntag = 0;
+    tagowner->fwd = tagowner->qpos;
+}
+
+/*
+ * tagqueue - Add ring bytes [from, to) to the batch as one line:
+ *    prefix, the bytes (two pieces if they wrap), and a newline if
+ *    nl is set. Advances the job's queue position.
+ */
+static void tagqueue(struct capture_t *c, unsigned long long from,
+		     unsigned long long to, int nl)
+{
+    long off = from % c->cap;
+    long len = to - from;
+
+    if (ntag + 4 > TAG_IOV || (ntag > 0 && tagowner != c))
+	tagflush();
+    tagowner = c;
+    tagiov[ntag].iov_base = c->prefix;
+    tagiov[ntag++].iov_len = c->plen;
+    tagiov[ntag].iov_base = c->map + off;
+    tagiov[ntag].iov_len = len < c->cap - off ? len : c->cap - off;
+    if ((long)tagiov[ntag++].iov_len < len) {
+	tagiov[ntag].iov_base = c->map;
+	tagiov[ntag].iov_len = len - tagiov[ntag - 1].iov_len;
+	ntag++;
+    }
+    if (nl) {
+	tagiov[ntag].iov_base = newline;
+	tagiov[ntag++].iov_len = 1;
+    }
+    c->qpos = c->scan = to;
+}
+
+/* taglines - Queue every complete line that has arrived */
+static void taglines(struct capture_t *c)
+{
+    unsigned long long p = c->scan;
+    long off, len;
+    char *q;
+
+    while (p < c->wpos) {
+	off = p % c->cap;
+	len = c->wpos - p;
+	if (len > c->cap - off)
+	    len = c->cap - off;
+	if ((q = (char *)memchr(c->map + off, '\n', len)) != NULL) {
+	    p += q - (c->map + off) + 1;
+	    tagqueue(c, c->qpos, p, 0);
+	}
+	else
+	    p += len;
+    }
+    c->scan = p;
+}
+
+/* tagrest - Queue the unfinished last line (ring full or end of output) */
+static void tagrest(struct capture_t *c)
+{
+    if (c->qpos < c->wpos)
+	tagqueue(c, c->qpos, c->wpos, 1);
+}
+
+/* capwrite - Write ring bytes [from, to) to fd (at most two pieces) */
+static void capwrite(struct capture_t *c, int fd, unsigned long long from,
+		     unsigned long long to)
+{
+    struct iovec iov[2];
+    long off = from % c->cap;
+    long len = to - from;
+    int n = 1;
+
+    if (len <= 0)
+	return;
+    iov[0].iov_base = c->map + off;
+    iov[0].iov_len = len < c->cap - off ? len : c->cap - off;
+    if ((long)iov[0].iov_len < len) {
+	iov[1].iov_base = c->map;
+	iov[1].iov_len = len - iov[0].iov_len;
+	n = 2;
+    }
+    writeall(fd, iov, n);
+}
+
+/* capclose - Release a capture slot */
+static void capclose(struct capture_t *c)
+{
+    if (c->rfd >= 0) {
+	unwatchfd(c->rfd);
+	close(c->rfd);
+    }
+    if (c->map != NULL)
+	munmap(c->map, c->cap);
+    if (c->memfd >= 0)
+	close(c->memfd);
+    memset(c, 0, sizeof(*c));
+    c->rfd = c->memfd = -1;
+}
+
+/*
+ * capdrain - Watch handler: move what's in the pipe into the ring
+ *    with splice (no copy through user space), wrapping at the cap.
+ *    At most one cap's worth per call, so a job that writes as fast
+ *    as we drain can't keep the shell here.
+ */
+static void capdrain(int fd, void *arg)
+{
+    struct capture_t *c = (struct capture_t *)arg;
+    unsigned long long start = c->wpos;
+    long room;
+    loff_t off;
+    ssize_t n;
+
+    while (c->wpos - start < (unsigned long long)c->cap) {
+	/* A tagged job's unwritten bytes must not be overwritten */
+	room = c->cap;
+	if (c->tag) {
+	    if (ntag > 0 && c->wpos - c->fwd > (unsigned long long)c->cap / 2)
+		tagflush();
+	    if ((room = c->cap - (c->wpos - c->fwd)) == 0) {
+		tagrest(c);         /* one line fills the ring: cut it */
+		tagflush();
+		room = c->cap;
+	    }
+	}
+	off = c->wpos % c->cap;
+	if (room > c->cap - off)
+	    room = c->cap - off;
+	n = splice(fd, NULL, c->memfd, &off, room, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (n > 0) {
+	    c->wpos += n;
+	    if (c->tag)
+		taglines(c);
+	    continue;
+	}
+	if (n == 0) {               /* every writer has gone */
+	    unwatchfd(fd);
+	    close(fd);
+	    c->rfd = -1;
+	    if (c->tag)
+		tagrest(c);
+	}
+	break;
+    }
+    if (c->tag)
+	tagflush();
+
+    if (c->passthru && c->wpos > start) {
+	fflush(stdout);
+	if (c->wpos - start > (unsigned long long)c->cap)
+	    start = c->wpos - c->cap;
+	capwrite(c, STDOUT_FILENO, start, c->wpos);
+	c->shown = c->wpos;
+    }
+    if (c->tagonly && c->reaped && c->rfd < 0)
+	capclose(c);                /* every line is out: nothing to keep */
+}
+
+/*
+ * capbegin - Make the pipe for a new background job and return its
+ *    write end for the child's stdout/stderr, or -1 if the job should
+ *    just write to the terminal. Follow with capend.
+ */
+int capbegin(void)
+{
+    if ((capture_cap <= 0 && !tag_on) || nwatched() >= MAXWATCH)
+	return -1;
+    if (pipe2(pendfd, O_CLOEXEC) < 0)
+	return -1;
+    fcntl(pendfd[0], F_SETFL, O_NONBLOCK);      /* our end only */
+    return pendfd[1];
+}
+
+/* tagexpand - Expand the tag format for job into buf; returns the length */
+static int tagexpand(char *buf, struct job_t *job)
+{
+    char tmp[32];
+    const char *f, *add;
+    int n = 0, len;
+
+    for (f = tagfmt; *f != '\0'; f++) {
+	add = tmp;
+	if (*f != '%' || f[1] == '\0') {
+	    tmp[0] = *f;
+	    tmp[1] = '\0';
+	}
+	else {
+	    switch (*++f) {
+	    case 'j': snprintf(tmp, sizeof(tmp), "%d", job->jid); break;
+	    case 'p': snprintf(tmp, sizeof(tmp), "%d", job->pid); break;
+	    case 'c':
+		len = strcspn(job->cmdline, " \t\n");
+		snprintf(tmp, sizeof(tmp), "%.*s", len, job->cmdline);
+		break;
+	    default:  tmp[0] = *f; tmp[1] = '\0'; break;
+	    }
+	}
+	len = strlen(add);
+	if (n + len > TAG_PREFIX - 1)
+	    len = TAG_PREFIX - 1 - n;
+	memcpy(buf + n, add, len);
+	n += len;
+    }
+    buf[n] = '\0';
+    return n;
+}
+
+/* capend - The job is spawned (job is NULL if that failed): attach the pipe */
+void capend(struct job_t *job)
+{
+    struct capture_t *c;
+
+    close(pendfd[1]);
+    if (job == NULL || job->jid < 1 || job->jid > MAXJOBS) {
+	close(pendfd[0]);
+	return;
+    }
+    c = &caps[job->jid];
+    if (c->pid != 0)
+	capclose(c);                /* an older job's output under this ID */
+    memset(c, 0, sizeof(*c));
+    c->pid = job->pid;
+    c->cap = capture_cap > 0 ? capture_cap : TAG_RING;
+    c->rfd = pendfd[0];
+    if ((c->tag = tag_on))
+	c->plen = tagexpand(c->prefix, job);
+    c->tagonly = capture_cap <= 0;
+    if ((c->memfd = memfd_create("tsh-output", MFD_CLOEXEC)) < 0 ||
+	ftruncate(c->memfd, c->cap) < 0 ||
+	(c->map = (char *)mmap(NULL, c->cap, PROT_READ, MAP_SHARED, c->memfd, 0)) == MAP_FAILED) {
+	c->map = NULL;
+	capclose(c);                /* the job gets SIGPIPE, as with a closed terminal */
+	return;
+    }
+    watchfd(c->rfd, capdrain, c);
+}
+
+/*
+ * capdel - The job has finished. A ring that was only there to tag its
+ *    lines goes as soon as its output has ended too, rather than when
+ *    the job ID is reused.
+ */
+void capdel(struct job_t *job)
+{
+    struct capture_t *c;
+
+    if (job->jid < 1 || job->jid > MAXJOBS || (c = &caps[job->jid])->pid != job->pid)
+	return;
+    c->reaped = 1;
+    if (c->tagonly && c->rfd < 0) {
+	if (tagowner == c)
+	    tagflush();
+	capclose(c);
+    }
+}
+
+/* capfind - Capture for a job ID, or NULL */
+static struct capture_t *capfind(int jid)
+{
+    if (jid < 1 || jid > MAXJOBS || caps[jid].map == NULL)
+	return NULL;
+    return &caps[jid];
+}
+
+/* capshow - Print what's kept for job jid (jobs -o). Returns 0 if nothing */
+int capshow(int jid)
+{
+    struct capture_t *c = capfind(jid);
+    unsigned long long from;
+
+    if (c == NULL)
+	return 0;
+    if (c->rfd >= 0)
+	capdrain(c->rfd, c);
+    from = c->wpos > (unsigned long long)c->cap ? c->wpos - c->cap : 0;
+    if (from > 0)
+	printf("[%d] (%llu earlier bytes not kept)\n", jid, from);
+    fflush(stdout);
+    capwrite(c, STDOUT_FILENO, from, c->wpos);
+    return 1;
+}
+
+/* capfg - The job is coming to the foreground: replay unseen output, then pass it through */
+void capfg(struct job_t *job)
+{
+    struct capture_t *c = capfind(job->jid);
+    unsigned long long from;
+
+    if (c == NULL || c->pid != job->pid || c->tag)
+	return;                     /* tagged output is already out there */
+    if (c->rfd >= 0)
+	capdrain(c->rfd, c);
+    from = c->shown;
+    if (c->wpos - from > (unsigned long long)c->cap) {
+	printf("[%d] (%llu bytes not kept)\n", job->jid, c->wpos - c->cap - from);
+	from = c->wpos - c->cap;
+    }
+    fflush(stdout);
+    capwrite(c, STDOUT_FILENO, from, c->wpos);
+    c->shown = c->wpos;
+    c->passthru = 1;
+}
+
+/* capfgdone - waitfg returned: pass through the last of it, then capture again */
+void capfgdone(int jid)
+{
+    struct capture_t *c = capfind(jid);
+
+    if (c == NULL || !c->passthru)
+	return;
+    if (c->rfd >= 0)
+	capdrain(c->rfd, c);
+    c->passthru = 0;
+}
+
+/*
+ * capresize - Give job jid a new cap, keeping as much of the newest
+ *    output as fits. Returns 0 if the job has no capture.
+ */
+int capresize(int jid, long cap)
+{
+    struct capture_t *c = capfind(jid);
+    unsigned long long p, from;
+    int memfd;
+    char *map;
+    long off, len;
+
+    if (c == NULL || cap <= 0)
+	return 0;
+    if (c->tag && c->wpos - c->qpos > (unsigned long long)cap) {
+	tagrest(c);                 /* the unfinished line won't fit */
+	tagflush();
+    }
+    if ((memfd = memfd_create("tsh-output", MFD_CLOEXEC)) < 0)
+	return 0;
+    if (ftruncate(memfd, cap) < 0 ||
+	(map = (char *)mmap(NULL, cap, PROT_READ, MAP_SHARED, memfd, 0)) == MAP_FAILED) {
+	close(memfd);
+	return 0;
+    }
+
+    /* Byte p of the output lives at p % cap in either ring */
+    from = c->wpos - (c->wpos < (unsigned long long)c->cap ? c->wpos : c->cap);
+    if (c->wpos - from > (unsigned long long)cap)
+	from = c->wpos - cap;
+    for (p = from; p < c->wpos; p += len) {
+	off = p % c->cap;
+	len = c->wpos - p;
+	if (len > c->cap - off)
+	    len = c->cap - off;
+	if (len > cap - (long)(p % cap))
+	    len = cap - p % cap;
+	pwrite(memfd, c->map + off, len, p % cap);
+    }
+
+    munmap(c->map, c->cap);
+    close(c->memfd);
+    c->tagonly = 0;                 /* asked for: keep it */
+    c->memfd = memfd;
+    c->map = map;
+    c->cap = cap;
+    return 1;
+}
+
+/* tagformat - Set the prefix format for newly tagged jobs. Returns 0 if too long */
+int tagformat(const char *fmt)
+{
+    if (strlen(fmt) >= sizeof(tagfmt))
+	return 0;
+    strcpy(tagfmt, fmt);
+    return 1;
+}
+
+/* tagoutput - Send tagged lines to path ("-" is the terminal). Returns 0 on error */
+int tagoutput(const char *path)
+{
+    int fd = STDOUT_FILENO;
+
+    if (strcmp(path, "-") != 0 &&
+	(fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) < 0)
+	return 0;
+    if (tag_fd != STDOUT_FILENO)
+	close(tag_fd);
+    tag_fd = fd;
+    return 1;
+}
+
+/***************************************
+ * end background job output capture
+ ***************************************/
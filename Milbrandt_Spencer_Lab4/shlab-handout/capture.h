@@ -0,0 +1,52 @@
+//-*-c++-*-
+#ifndef _capture_h_
+#define _capture_h_
+
+/*
+ * Background job output capture (tsh -c SIZE, the capture builtin).
+ * A captured job's stdout and stderr go to a pipe that the shell
+ * keeps drained, with splice, into a ring buffer in a memfd of the
+ * job's cap size. Only the newest cap bytes are kept, so a chatty job
+ * neither blocks on a full pipe nor floods the terminal. "jobs -o %N"
+ * shows what is kept; fg replays what hasn't been seen and then
+ * passes new output through while the job is in the foreground. A
+ * finished job's output stays available under its job ID until that
+ * ID is captured again.
+ */
+
+#define CAP_DEFAULT (64 * 1024)   /* cap for "capture on" */
+
+extern long capture_cap;          /* cap for new bg jobs, 0 = capture off */
+
+/*
+ * Tagged output (tsh -T, the tag builtin). Background jobs' output
+ * goes through the same rings, but every complete line is forwarded
+ * as soon as it's there, with a prefix ("[%j] " by default: %j is the
+ * job ID, %p the pid, %c the command name), to the terminal or a
+ * file, like parallel --tag. Lines leave the ring as iovecs pointing
+ * into the mapping and go out in batched writev calls, so lines of
+ * different jobs never mix and each job's lines stay in order. A
+ * line longer than the ring is cut into ring-sized pieces. A ring that
+ * is only there for tagging is released once the job has finished and
+ * its output has ended.
+ */
+#define TAG_RING    (1024 * 1024) /* ring size when only tagging */
+#define TAG_IOV     1024          /* iovecs per writev batch */
+#define TAG_PREFIX  32            /* max expanded prefix length */
+
+extern int tag_on;                /* tag new bg jobs' output */
+extern int tag_fd;                /* where tagged lines go */
+
+struct job_t;
+
+int capbegin(void);
+void capend(struct job_t *job);
+void capdel(struct job_t *job);
+int capshow(int jid);
+void capfg(struct job_t *job);
+void capfgdone(int jid);
+int capresize(int jid, long cap);
+int tagformat(const char *fmt);
+int tagoutput(const char *path);
+
+#endif
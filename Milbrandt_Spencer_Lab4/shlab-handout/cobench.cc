@@ -0,0 +1,120 @@
+/*
+ * cobench.c - Concurrent child awaits on the libtsh coroutine executor
+ *
+ * usage: cobench [-n jobs]...
+ * For each -n (default 1000 and 10000), spawns that many long-lived
+ * children at once, parks one coroutine in co_await job.exited() for
+ * each, then terminates them all and waits for every coroutine to
+ * resume. Reports the spawn rate, how long the fan-in took, and the
+ * executor's resident memory per waiting job.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <vector>
+#include "coexec.h"
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* rss - Resident set size of this process, in bytes */
+static long rss(void)
+{
+    long size, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+
+    if (f != NULL) {
+	if (fscanf(f, "%ld %ld", &size, &resident) != 2)
+	    resident = 0;
+	fclose(f);
+    }
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+struct round_t {            /* Results of one round */
+    int n, failed, resumed;
+    long rss0, rss1;
+    double t0, t1, t2;
+};
+
+static Task waiter(Job job, struct round_t *r)
+{
+    int status = co_await job.exited();
+
+    if (WIFSIGNALED(status))
+	r->resumed++;
+}
+
+static Task fanout(Executor &ex, struct round_t *r)
+{
+    char *argv[] = { (char *)"/bin/sleep", (char *)"1000", NULL };
+    std::vector<Job> jobs;
+    int i;
+
+    jobs.reserve(r->n);
+    r->rss0 = rss();
+    r->t0 = now();
+    for (i = 0; i < r->n; i++) {
+	Job j = co_await ex.spawn(argv);
+	if (!j.ok()) {
+	    r->failed++;
+	    continue;
+	}
+	ex.start(waiter(j, r));
+	jobs.push_back(j);
+    }
+    co_await ex.yield();            /* every waiter is now parked */
+    r->t1 = now();
+    r->rss1 = rss();
+    for (i = 0; i < (int)jobs.size(); i++)
+	jobs[i].signal(SIGTERM);
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<int> sizes;
+    struct rlimit rl;
+    int c, i;
+
+    while ((c = getopt(argc, argv, "n:")) != EOF) {
+	if (c != 'n') {
+	    fprintf(stderr, "Usage: %s [-n jobs]...\n", argv[0]);
+	    exit(1);
+	}
+	sizes.push_back(atoi(optarg));
+    }
+    if (sizes.empty()) {
+	sizes.push_back(1000);
+	sizes.push_back(10000);
+    }
+
+    /* One pidfd per live child */
+    getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+
+    for (i = 0; i < (int)sizes.size(); i++) {
+	Executor ex;
+	struct round_t r = {};
+
+	r.n = sizes[i];
+	ex.start(fanout(ex, &r));
+	ex.run();
+	r.t2 = now();
+	printf("%6d jobs (%d failed): spawned at %.0f/s, fan-in %.3fs, %ld bytes/job resident\n",
+	       r.n, r.failed, (r.n - r.failed) / (r.t1 - r.t0), r.t2 - r.t1,
+	       r.n > r.failed ? (r.rss1 - r.rss0) / (r.n - r.failed) : 0L);
+	if (r.resumed != r.n - r.failed)
+	    printf("  only %d of %d waiters resumed\n", r.resumed, r.n - r.failed);
+    }
+    return 0;
+}
@@ -0,0 +1,264 @@
+#include "coexec.h"
+#include "jobctl.h"
+#include "helper-routines.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+/**********************************
+ * Coroutine job executor
+ **********************************/
+
+/*
+ * final_awaiter - A finished task resumes whoever co_awaited it. A
+ *    detached one has nobody to do that, so it frees its own frame.
+ */
+std::coroutine_handle<> Task::promise_type::final_awaiter::await_suspend(
+    std::coroutine_handle<promise_type> h) noexcept
+{
+    std::coroutine_handle<> cont = h.promise().cont;
+
+    if (h.promise().detached)
+	h.destroy();
+    return cont ? cont : std::noop_coroutine();
+}
+
+void Task::promise_type::unhandled_exception()
+{
+    app_error("Executor: task threw an exception");
+}
+
+int Job::stop(void)
+{
+    return j && j->state != CO_DONE && kill(-j->pid, SIGSTOP) == 0;
+}
+
+int Job::cont(void)
+{
+    if (!j || j->state == CO_DONE || kill(-j->pid, SIGCONT) < 0)
+	return 0;
+    j->state = CO_RUN;
+    return 1;
+}
+
+int Job::signal(int sig)
+{
+    return j && j->state != CO_DONE && kill(-j->pid, sig) == 0;
+}
+
+/*
+ * StopAwait - A stop nobody was watching for is still pending in the
+ *    kernel, so look for one before joining the stop watch list.
+ */
+bool Job::StopAwait::await_suspend(std::coroutine_handle<> h)
+{
+    if (ex->pollstop(j.get()))
+	return false;
+    if (j->stopwait.empty())
+	ex->watching.push_back(j);
+    j->stopwait.push_back(h);
+    return true;
+}
+
+Executor::Executor()
+    : nlive(0)
+{
+    sigset_t mask;
+    struct epoll_event ev;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+	unix_error("Executor: epoll_create1 error");
+    if ((sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+	unix_error("Executor: signalfd error");
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;             /* NULL marks the signalfd */
+    epoll_ctl(epfd, EPOLL_CTL_ADD, sigfd, &ev);
+}
+
+Executor::~Executor()
+{
+    while (!ready.empty()) {        /* tasks started but never run */
+	ready.front().destroy();
+	ready.pop_front();
+    }
+    close(sigfd);
+    close(epfd);
+}
+
+/* spawn - see coexec.h */
+Executor::SpawnAwait Executor::spawn(char **argv, int outfd)
+{
+    std::shared_ptr<cojob_t> j = std::make_shared<cojob_t>();
+    struct epoll_event ev;
+    SpawnAwait a;
+
+    j->pid = 0;
+    j->pidfd = -1;
+    j->state = CO_DONE;
+    j->status = 127 << 8;           /* what a shell reports for "not found" */
+    a.job.j = j;
+    a.job.ex = this;
+
+    if (argv[0] == NULL)
+	return a;
+    if ((j->pid = execjob(argv, outfd)) < 0) {
+	j->pid = 0;
+	return a;
+    }
+    if ((j->pidfd = syscall(SYS_pidfd_open, j->pid, 0)) < 0) {
+	kill(-j->pid, SIGKILL);
+	waitpid(j->pid, NULL, 0);
+	j->pid = 0;
+	return a;
+    }
+    j->state = CO_RUN;
+    j->status = 0;
+    j->self = j;
+    ev.events = EPOLLIN;
+    ev.data.ptr = j.get();
+    epoll_ctl(epfd, EPOLL_CTL_ADD, j->pidfd, &ev);
+    nlive++;
+    return a;
+}
+
+/* spawn - Parse cmdline the way tsh does and launch it */
+Executor::SpawnAwait Executor::spawn(const char *cmdline, int outfd)
+{
+    char buf[MAXLINE];
+    char *argv[MAXARGS];
+    size_t len = strlen(cmdline);
+
+    if (len + 2 > MAXLINE)
+	len = MAXLINE - 2;
+    memcpy(buf, cmdline, len);
+    buf[len++] = '\n';
+    buf[len] = '\0';
+    parseline(buf, argv);
+    return spawn(argv, outfd);
+}
+
+void Executor::start(Task &&t)
+{
+    t.h.promise().detached = true;
+    ready.push_back(t.h);
+    t.h = nullptr;
+}
+
+/* wake - Move a waiter list onto the ready queue */
+void Executor::wake(std::vector<std::coroutine_handle<> > &waiters)
+{
+    for (size_t i = 0; i < waiters.size(); i++)
+	ready.push_back(waiters[i]);
+    waiters.clear();
+}
+
+/* exitjob - A job's pidfd is readable: collect its status. Returns 1 if it was reaped */
+int Executor::exitjob(cojob_t *j)
+{
+    siginfo_t info;
+    std::shared_ptr<cojob_t> keep;
+
+    memset(&info, 0, sizeof(info));
+    if (waitid((idtype_t)P_PIDFD, j->pidfd, &info, WEXITED | WNOHANG) < 0 ||
+	info.si_pid == 0)
+	return 0;
+    j->status = waitstatus(&info);
+    j->state = CO_DONE;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, j->pidfd, NULL);
+    close(j->pidfd);
+    j->pidfd = -1;
+    nlive--;
+    wake(j->exitwait);
+    wake(j->stopwait);
+    keep.swap(j->self);             /* may be the last reference */
+    return 1;
+}
+
+/* pollstop - Collect a pending stop of a running job. Returns 1 if there was one */
+int Executor::pollstop(cojob_t *j)
+{
+    siginfo_t info;
+
+    memset(&info, 0, sizeof(info));
+    if (j->state != CO_RUN ||
+	waitid((idtype_t)P_PIDFD, j->pidfd, &info, WSTOPPED | WNOHANG) < 0 ||
+	info.si_pid == 0)
+	return 0;
+    j->status = waitstatus(&info);
+    j->state = CO_STOP;
+    return 1;
+}
+
+/*
+ * checkstops - SIGCHLD arrived. Check each job somebody is waiting
+ *    to see stop; the rest can't have anything we care about.
+ */
+void Executor::checkstops(void)
+{
+    struct signalfd_siginfo ssi;
+    size_t i, n = 0;
+
+    while (read(sigfd, &ssi, sizeof(ssi)) == sizeof(ssi))
+	;
+    for (i = 0; i < watching.size(); i++) {
+	cojob_t *j = watching[i].get();
+
+	if (!j->stopwait.empty() && pollstop(j))
+	    wake(j->stopwait);
+	if (!j->stopwait.empty())
+	    watching[n++] = watching[i];
+    }
+    watching.resize(n);
+}
+
+/* run - see coexec.h */
+int Executor::run(void)
+{
+    struct epoll_event evs[256];
+    sigset_t mask, prev;
+    int i, n, reaped = 0;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+
+    for (;;) {
+	while (!ready.empty()) {
+	    std::coroutine_handle<> h = ready.front();
+	    ready.pop_front();
+	    h.resume();
+	}
+	if (nlive == 0)
+	    break;
+	if ((n = epoll_wait(epfd, evs, 256, -1)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    unix_error("Executor: epoll_wait error");
+	}
+	for (i = 0; i < n; i++) {
+	    if (evs[i].data.ptr == NULL)
+		checkstops();
+	    else
+		reaped += exitjob((cojob_t *)evs[i].data.ptr);
+	}
+    }
+
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    return reaped;
+}
+/**********************
+ * end coroutine job executor
+ **********************/
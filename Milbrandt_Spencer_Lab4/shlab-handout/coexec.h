@@ -0,0 +1,197 @@
+//-*-c++-*-
+#ifndef _coexec_h_
+#define _coexec_h_
+
+#include <sys/types.h> // needed for pid_t
+#include <coroutine>
+#include <deque>
+#include <memory>
+#include <vector>
+
+/*
+ * Coroutine job executor (C++20, part of libtsh).
+ *
+ *   Task build(Executor &ex) {
+ *       Job a = co_await ex.spawn("cc -c a.c");
+ *       Job b = co_await ex.spawn("cc -c b.c");
+ *       if (co_await a.exited() == 0 && co_await b.exited() == 0)
+ *           co_await ex.spawn("cc -o prog a.o b.o");
+ *   }
+ *   ex.start(build(ex));
+ *   ex.run();
+ *
+ * Everything runs on the thread that calls run(). Every live child's
+ * pidfd is in one epoll set, so an exit resumes exactly the coroutines
+ * waiting on that job, and a job costs one small record plus whatever
+ * coroutine frames wait on it. A pidfd doesn't report stops: while
+ * run() is active SIGCHLD is blocked in the calling thread and read
+ * from a signalfd instead, and only jobs with a stopped() waiter are
+ * checked when it arrives.
+ */
+
+class Executor;
+
+/* Shared state of one job; only Executor and Job touch it */
+struct cojob_t {
+    pid_t pid;                  /* 0 if the spawn failed */
+    int pidfd;
+    int state;                  /* CO_RUN, CO_STOP or CO_DONE */
+    int status;                 /* latest waitpid-style status */
+    std::vector<std::coroutine_handle<> > exitwait, stopwait;
+    std::shared_ptr<cojob_t> self;  /* keeps it alive until it's reaped */
+};
+
+#define CO_RUN  1
+#define CO_STOP 2
+#define CO_DONE 3
+
+/*
+ * Task - A coroutine run by an Executor. Hand it to Executor::start
+ *    to run it on its own, or co_await it from another Task to run it
+ *    and resume when it has finished (fan-in).
+ */
+class Task {
+public:
+    struct promise_type {
+	std::coroutine_handle<> cont;   /* who co_awaits us, if anyone */
+	bool detached = false;          /* owned by the executor */
+
+	Task get_return_object() {
+	    return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+	}
+	std::suspend_always initial_suspend() noexcept { return {}; }
+	struct final_awaiter {
+	    bool await_ready() noexcept { return false; }
+	    std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept;
+	    void await_resume() noexcept {}
+	};
+	final_awaiter final_suspend() noexcept { return {}; }
+	void return_void() {}
+	void unhandled_exception();
+    };
+
+    Task(Task &&t) : h(t.h) { t.h = nullptr; }
+    ~Task() { if (h) h.destroy(); }
+
+    /* Awaitable for co_await task: run it, resume when it's finished */
+    struct JoinAwait {
+	std::coroutine_handle<promise_type> h;
+	bool await_ready() { return !h || h.done(); }
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> c) {
+	    h.promise().cont = c;
+	    return h;
+	}
+	void await_resume() {}
+    };
+    JoinAwait operator co_await() { return JoinAwait{h}; }
+
+private:
+    friend class Executor;
+    explicit Task(std::coroutine_handle<promise_type> h) : h(h) {}
+    Task(const Task &);
+    Task &operator=(const Task &);
+
+    std::coroutine_handle<promise_type> h;
+};
+
+/* Job - A handle on a spawned job. Cheap to copy */
+class Job {
+public:
+    /* Awaitable for exited(): yields the waitpid-style exit status */
+    struct ExitAwait {
+	std::shared_ptr<cojob_t> j;
+	bool await_ready() { return j->state == CO_DONE; }
+	void await_suspend(std::coroutine_handle<> h) { j->exitwait.push_back(h); }
+	int await_resume() { return j->status; }
+    };
+    /* Awaitable for stopped(): yields the stop (or exit) status */
+    struct StopAwait {
+	std::shared_ptr<cojob_t> j;
+	Executor *ex;
+	bool await_ready() { return j->state != CO_RUN; }
+	bool await_suspend(std::coroutine_handle<> h);
+	int await_resume() { return j->status; }
+    };
+
+    Job() : ex(nullptr) {}
+
+    bool ok(void) const { return j && j->pid > 0; }
+    pid_t pid(void) const { return j ? j->pid : 0; }
+
+    /* Signal the job's process group. Return 1 on success */
+    int stop(void);
+    int cont(void);
+    int signal(int sig);
+
+    /* Resume when the job has exited / next stops (or exits) */
+    ExitAwait exited(void) { return ExitAwait{j}; }
+    StopAwait stopped(void) { return StopAwait{j, ex}; }
+
+private:
+    friend class Executor;
+    std::shared_ptr<cojob_t> j;
+    Executor *ex;
+};
+
+class Executor {
+public:
+    /* Awaitable for spawn(): the fork has already happened */
+    struct SpawnAwait {
+	Job job;
+	bool await_ready() { return true; }
+	void await_suspend(std::coroutine_handle<>) {}
+	Job await_resume() { return job; }
+    };
+    /* Awaitable for yield(): requeue the caller behind the ready tasks */
+    struct YieldAwait {
+	Executor *ex;
+	bool await_ready() { return false; }
+	void await_suspend(std::coroutine_handle<> h) { ex->ready.push_back(h); }
+	void await_resume() {}
+    };
+
+    Executor();
+    ~Executor();
+
+    /*
+     * Launch argv (or a parsed cmdline) in its own process group. A
+     * command that can't be exec'd gives a Job that isn't ok() and
+     * has already exited with status 127.
+     */
+    SpawnAwait spawn(char **argv, int outfd = -1);
+    SpawnAwait spawn(const char *cmdline, int outfd = -1);
+
+    /* Hand a task to the executor; it runs once run() is called */
+    void start(Task &&t);
+
+    /* Let every other ready task run before continuing */
+    YieldAwait yield(void) { return YieldAwait{this}; }
+
+    /*
+     * Run tasks until none can make progress any more: nothing is
+     * ready and no job is left to wait for. Returns how many jobs
+     * were reaped.
+     */
+    int run(void);
+
+    int live(void) const { return nlive; }
+
+private:
+    friend struct Job::StopAwait;
+
+    int epfd;                   /* pidfds of live jobs, plus sigfd */
+    int sigfd;                  /* SIGCHLD, for stops */
+    int nlive;
+    std::deque<std::coroutine_handle<> > ready;
+    std::vector<std::shared_ptr<cojob_t> > watching;  /* jobs with stopped() waiters */
+
+    int exitjob(cojob_t *j);
+    int pollstop(cojob_t *j);
+    void checkstops(void);
+    void wake(std::vector<std::coroutine_handle<> > &waiters);
+
+    Executor(const Executor &);
+    Executor &operator=(const Executor &);
+};
+
+#endif
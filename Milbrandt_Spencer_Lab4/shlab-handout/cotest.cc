@@ -0,0 +1,117 @@
+/*
+ * cotest.c - Unit tests for the libtsh coroutine executor
+ *
+ * usage: cotest
+ * Prints one line per failed check and exits 0 when everything passed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <vector>
+#include "coexec.h"
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+	printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+	failures++; \
+    } \
+} while (0)
+
+/* exited() yields the exit status; awaiting it again is immediate */
+static Task exitstatus(Executor &ex, int *done)
+{
+    Job j = co_await ex.spawn("/bin/sh -c 'exit 5'");
+    int status;
+
+    CHECK(j.ok());
+    status = co_await j.exited();
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 5);
+    status = co_await j.exited();
+    CHECK(WEXITSTATUS(status) == 5);
+    CHECK(!j.signal(SIGINT));
+    (*done)++;
+}
+
+/* A command that can't run has already "exited" with 127 */
+static Task notfound(Executor &ex, int *done)
+{
+    Job j = co_await ex.spawn("./no-such-program");
+
+    CHECK(!j.ok());
+    CHECK(WEXITSTATUS(co_await j.exited()) == 127);
+    (*done)++;
+}
+
+/* stopped() sees a ctrl-z style stop; cont() lets the job finish */
+static Task stopcont(Executor &ex, int *done)
+{
+    Job j = co_await ex.spawn("./mystop 1");
+    int status;
+
+    status = co_await j.stopped();
+    CHECK(WIFSTOPPED(status) && WSTOPSIG(status) == SIGTSTP);
+    CHECK(j.cont());
+    status = co_await j.exited();
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    (*done)++;
+}
+
+/* A stop that happened before anyone asked is still reported */
+static Task latestop(Executor &ex, int *done)
+{
+    Job j = co_await ex.spawn("./myspin 5");
+    int status;
+
+    CHECK(j.stop());
+    usleep(100000);
+    status = co_await j.stopped();
+    CHECK(WIFSTOPPED(status) && WSTOPSIG(status) == SIGSTOP);
+    CHECK(j.signal(SIGKILL));
+    status = co_await j.exited();
+    CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL);
+    (*done)++;
+}
+
+/* Fan-out to child tasks, fan-in by awaiting them */
+static Task child(Executor &ex, int n, int *sum)
+{
+    Job j = co_await ex.spawn(n % 2 ? "/bin/false" : "/bin/true");
+
+    *sum += WEXITSTATUS(co_await j.exited());
+}
+
+static Task fanin(Executor &ex, int *done)
+{
+    std::vector<Task> kids;
+    int i, sum = 0;
+
+    for (i = 0; i < 8; i++)
+	kids.push_back(child(ex, i, &sum));
+    for (i = 0; i < 8; i++)
+	co_await kids[i];
+    CHECK(sum == 4);
+    (*done)++;
+}
+
+int main(void)
+{
+    Executor ex;
+    int done = 0;
+
+    ex.start(exitstatus(ex, &done));
+    ex.start(notfound(ex, &done));
+    ex.start(stopcont(ex, &done));
+    ex.start(latestop(ex, &done));
+    ex.start(fanin(ex, &done));
+    ex.run();
+    CHECK(done == 5);
+    CHECK(ex.live() == 0);
+
+    if (failures == 0)
+	printf("cotest: all checks passed\n");
+    return failures != 0;
+}
@@ -0,0 +1,403 @@
+#include "dag.h"
+#include "tsh.h"
+#include "jobs.h"
+#include "events.h"
+#include "capture.h"
+#include "helper-routines.h"
+#include "globals.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <string>
+#include <vector>
+#include <queue>
+#include <unordered_map>
+
+/*************************************
+ * Dependency-graph job runner
+ *************************************/
+
+/* Task states */
+#define T_WAIT 0    /* some deps haven't finished */
+#define T_READY 1   /* on the ready heap */
+#define T_RUN  2    /* running as a job */
+#define T_OK   3
+#define T_FAIL 4
+#define T_SKIP 5    /* something it depends on failed */
+
+struct task_t {             /* One line of the dag file */
+    std::string name;
+    std::string cmd;        /* empty: nothing to run */
+    int line;
+    int state;
+    int left;               /* deps not finished yet */
+    int blocked;            /* a dep failed or was skipped */
+    int prio;               /* tasks on the longest chain from here down */
+    int status;             /* shell-style exit status */
+    long long start, end;   /* ns since the run began */
+};
+
+/*
+ * The graph, in compressed rows: task t's dependents are
+ * kids[kidx[t] .. kidx[t+1]), its deps deps[didx[t] .. didx[t+1]).
+ */
+static std::vector<task_t> tasks;
+static std::vector<int> kids, kidx, deps, didx;
+
+/* A run in progress */
+typedef std::pair<int, int> ready_t;        /* (prio, -task): file order breaks ties */
+static std::priority_queue<ready_t> ready;
+static std::unordered_map<pid_t, int> running;  /* job pid -> task */
+static std::vector<std::pair<int, int> > finished;  /* (task, status) not handled yet */
+static jobhook_t *prevhook;
+static long long t0;
+
+/* dagerror - Report a problem with the file and give up on it */
+static int dagerror(const char *path, int line, const char *msg, const char *what)
+{
+    if (line > 0)
+	printf("dag: %s:%d: %s%s\n", path, line, msg, what);
+    else
+	printf("dag: %s: %s%s\n", path, msg, what);
+    return 0;
+}
+
+/*
+ * dagload - Read the tasks and their deps into compressed rows.
+ *    Returns 0 (after saying why) if the file can't be used.
+ */
+static int dagload(const char *path)
+{
+    std::unordered_map<std::string, int> byname;
+    std::vector<std::pair<int, std::string> > edges;    /* (task, dep name) */
+    std::vector<int> dep;
+    FILE *fp;
+    char *buf = NULL, *p, *colon, *semi, *tok, *save;
+    size_t bufsize = 0;
+    int line = 0, ok = 1, t;
+    size_t i;
+
+    if ((fp = fopen(path, "r")) == NULL)
+	return dagerror(path, 0, strerror(errno), "");
+    tasks.clear();
+    while (ok && getline(&buf, &bufsize, fp) > 0) {
+	line++;
+	for (p = buf; *p == ' ' || *p == '\t'; p++)
+	    ;
+	if (*p == '\0' || *p == '\n' || *p == '#')
+	    continue;
+	p[strcspn(p, "\n")] = '\0';
+	if ((colon = strchr(p, ':')) == NULL) {
+	    ok = dagerror(path, line, "expected \"name: deps ; command\"", "");
+	    break;
+	}
+	*colon = '\0';
+	if ((semi = strchr(colon + 1, ';')) != NULL)
+	    *semi++ = '\0';
+
+	task_t task;
+	task.line = line;
+	task.state = T_WAIT;
+	task.left = task.blocked = task.prio = task.status = 0;
+	task.start = task.end = 0;
+	if ((tok = strtok_r(p, " \t", &save)) == NULL || strtok_r(NULL, " \t", &save) != NULL) {
+	    ok = dagerror(path, line, "a task needs exactly one name", "");
+	    break;
+	}
+	task.name = tok;
+	if (semi != NULL) {
+	    semi += strspn(semi, " \t");
+	    task.cmd = semi;
+	    if (task.cmd.size() + 2 > MAXLINE) {
+		ok = dagerror(path, line, "command too long for ", task.name.c_str());
+		break;
+	    }
+	}
+	if (!byname.insert(std::make_pair(task.name, (int)tasks.size())).second) {
+	    ok = dagerror(path, line, "task defined twice: ", tok);
+	    break;
+	}
+	for (tok = strtok_r(colon + 1, " \t", &save); tok != NULL; tok = strtok_r(NULL, " \t", &save))
+	    edges.push_back(std::make_pair((int)tasks.size(), std::string(tok)));
+	tasks.push_back(task);
+    }
+    free(buf);
+    fclose(fp);
+    if (!ok)
+	return 0;
+
+    /* Name the deps by number, then lay both directions out in rows */
+    dep.resize(edges.size());
+    kidx.assign(tasks.size() + 1, 0);
+    didx.assign(tasks.size() + 1, 0);
+    for (i = 0; i < edges.size(); i++) {
+	std::unordered_map<std::string, int>::iterator it = byname.find(edges[i].second);
+
+	if (it == byname.end())
+	    return dagerror(path, tasks[edges[i].first].line, "unknown task ", edges[i].second.c_str());
+	dep[i] = it->second;
+	kidx[dep[i] + 1]++;
+	didx[edges[i].first + 1]++;
+    }
+    for (i = 0; i < tasks.size(); i++) {
+	kidx[i + 1] += kidx[i];
+	didx[i + 1] += didx[i];
+    }
+    kids.resize(edges.size());
+    deps.resize(edges.size());
+    std::vector<int> kfill(kidx.begin(), kidx.end() - 1), dfill(didx.begin(), didx.end() - 1);
+    for (i = 0; i < edges.size(); i++) {
+	t = edges[i].first;
+	kids[kfill[dep[i]]++] = t;
+	deps[dfill[t]++] = dep[i];
+	tasks[t].left++;
+    }
+    return 1;
+}
+
+/*
+ * dagorder - Kahn's algorithm. Fills order with a topological order
+ *    and returns 1, or names a cycle and returns 0. Priorities are
+ *    then the longest chain of tasks from each one down.
+ */
+static int dagorder(const char *path, std::vector<int> &order)
+{
+    std::vector<int> left(tasks.size());
+    std::vector<char> seen;
+    size_t i, head;
+    int t, k, best;
+
+    order.clear();
+    for (i = 0; i < tasks.size(); i++)
+	if ((left[i] = tasks[i].left) == 0)
+	    order.push_back(i);
+    for (head = 0; head < order.size(); head++)
+	for (k = kidx[order[head]]; k < kidx[order[head] + 1]; k++)
+	    if (--left[kids[k]] == 0)
+		order.push_back(kids[k]);
+
+    if (order.size() < tasks.size()) {
+	/* Walk unfinished deps back from any stuck task until one repeats */
+	for (t = 0; left[t] == 0; t++)
+	    ;
+	seen.assign(tasks.size(), 0);
+	while (!seen[t]) {
+	    seen[t] = 1;
+	    for (k = didx[t]; left[deps[k]] == 0; k++)
+		;
+	    t = deps[k];
+	}
+	std::string cycle = tasks[t].name;
+	k = t;
+	do {
+	    for (i = didx[k]; left[deps[i]] == 0; i++)
+		;
+	    k = deps[i];
+	    cycle = tasks[k].name + " -> " + cycle;
+	} while (k != t);
+	return dagerror(path, tasks[t].line, "dependency cycle: ", cycle.c_str());
+    }
+
+    for (i = order.size(); i-- > 0; ) {
+	t = order[i];
+	best = 0;
+	for (k = kidx[t]; k < kidx[t + 1]; k++)
+	    if (tasks[kids[k]].prio > best)
+		best = tasks[kids[k]].prio;
+	tasks[t].prio = best + 1;
+    }
+    return 1;
+}
+
+/* daghook - jobhook: note a task's job terminating, for the run loop */
+static void daghook(struct job_t *job, int status)
+{
+    std::unordered_map<pid_t, int>::iterator it;
+
+    if (prevhook != NULL)
+	prevhook(job, status);
+    if (WIFSTOPPED(status) || (it = running.find(job->pid)) == running.end())
+	return;
+    finished.push_back(std::make_pair(it->second,
+				      WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status)));
+    running.erase(it);
+}
+
+/* release - Task t is over; the dependents it was holding back may be ready */
+static void release(int t)
+{
+    std::vector<int> stack(1, t);
+    int k, kid;
+
+    while (!stack.empty()) {
+	t = stack.back();
+	stack.pop_back();
+	for (k = kidx[t]; k < kidx[t + 1]; k++) {
+	    kid = kids[k];
+	    if (tasks[t].state != T_OK)
+		tasks[kid].blocked = 1;
+	    if (--tasks[kid].left > 0)
+		continue;
+	    if (tasks[kid].blocked) {   /* the whole subtree is skipped */
+		tasks[kid].state = T_SKIP;
+		stack.push_back(kid);
+	    }
+	    else {
+		tasks[kid].state = T_READY;
+		ready.push(ready_t(tasks[kid].prio, -kid));
+	    }
+	}
+    }
+}
+
+/* launch - Start task t; it lands on finished at once if there is no job to wait for */
+static void launch(int t, int flags)
+{
+    char cmdline[MAXLINE], buf[MAXLINE];
+    char *argv[MAXARGS];
+    int outfd;
+    pid_t pid;
+
+    tasks[t].state = T_RUN;
+    tasks[t].start = nowns() - t0;
+    if ((flags & DAG_DRYRUN) || tasks[t].cmd.empty()) {
+	finished.push_back(std::make_pair(t, 0));
+	return;
+    }
+    snprintf(cmdline, sizeof(cmdline), "%s\n", tasks[t].cmd.c_str());
+    strcpy(buf, cmdline);
+    parseline(buf, argv);
+    if (argv[0] == NULL) {
+	finished.push_back(std::make_pair(t, 0));
+	return;
+    }
+    outfd = capbegin();
+    pid = spawnjob(argv, cmdline, BG, outfd);
+    if (outfd >= 0)
+	capend(pid ? getjobpid(jobs, pid) : NULL);
+    if (pid == 0)
+	finished.push_back(std::make_pair(t, 127));
+    else
+	running[pid] = t;
+}
+
+/* dagreport - The per-task table and the summary line */
+static void dagreport(int flags, int critical, long long load, long long sched)
+{
+    int count[T_SKIP + 1] = { 0 };
+    char what[32];
+    size_t i;
+
+    if (!(flags & DAG_QUIET))
+	printf("%-24s %-10s %10s %10s\n", "task", "status", "start(s)", "time(s)");
+    for (i = 0; i < tasks.size(); i++) {
+	task_t *t = &tasks[i];
+
+	count[t->state]++;
+	if (flags & DAG_QUIET)
+	    continue;
+	switch (t->state) {
+	case T_OK:   strcpy(what, "ok"); break;
+	case T_FAIL: snprintf(what, sizeof(what), "failed(%d)", t->status); break;
+	case T_SKIP: strcpy(what, "skipped"); break;
+	case T_RUN:  strcpy(what, "abandoned"); break;
+	default:     strcpy(what, "not run"); break;
+	}
+	if (t->state == T_OK || t->state == T_FAIL)
+	    printf("%-24s %-10s %10.3f %10.3f\n", t->name.c_str(), what,
+		   t->start / 1e9, (t->end - t->start) / 1e9);
+	else
+	    printf("%-24s %s\n", t->name.c_str(), what);
+    }
+    printf("dag: %d tasks: %d ok, %d failed, %d skipped, %d not run in %.3fs"
+	   " (critical path %d, load %.1f ms, scheduling %.1f ms)\n",
+	   (int)tasks.size(), count[T_OK], count[T_FAIL], count[T_SKIP],
+	   count[T_WAIT] + count[T_READY] + count[T_RUN],
+	   (nowns() - t0) / 1e9, critical, load / 1e6, sched / 1e6);
+}
+
+/*
+ * dagrun - Run the dag file at path (see dag.h). Returns a shell
+ *    status: 0 if every task succeeded, 1 if any failed or was
+ *    skipped, 2 if the file was refused and 130 if interrupted.
+ */
+int dagrun(const char *path, int maxjobs, int flags)
+{
+    std::vector<int> order;
+    sigset_t prev;
+    long long tl = nowns(), load, sched = 0, t1, tspawn;
+    int critical = 0, stopping = 0, status = 0, t;
+    size_t i;
+
+    if (!dagload(path) || !dagorder(path, order))
+	return 2;
+    for (i = 0; i < tasks.size(); i++) {
+	if (tasks[i].prio > critical)
+	    critical = tasks[i].prio;
+	if (tasks[i].left == 0) {
+	    tasks[i].state = T_READY;
+	    ready.push(ready_t(tasks[i].prio, -(int)i));
+	}
+    }
+    t0 = nowns();
+    load = t0 - tl;
+
+    blockjobsigs(&prev);
+    drainevents();
+    interrupted = 0;
+    prevhook = jobhook;
+    jobhook = daghook;
+    for (;;) {
+	t1 = nowns();
+	tspawn = 0;
+	for (i = 0; i < finished.size(); i++) {
+	    task_t *task = &tasks[finished[i].first];
+
+	    task->end = t1 - t0;
+	    task->status = finished[i].second;
+	    task->state = task->status == 0 ? T_OK : T_FAIL;
+	    if (task->status != 0)
+		status = 1;
+	    release(finished[i].first);
+	}
+	finished.clear();
+	while (!stopping && (int)running.size() < maxjobs && !ready.empty()) {
+	    t = -ready.top().second;
+	    ready.pop();
+	    long long ts = nowns();
+	    launch(t, flags);
+	    tspawn += nowns() - ts;
+	}
+	sched += nowns() - t1 - tspawn;
+
+	if (!finished.empty())
+	    continue;
+	if (running.empty() && (stopping || ready.empty()))
+	    break;
+	waitevents(&prev);
+	drainevents();
+	if (interrupted) {
+	    interrupted = 0;
+	    if (stopping++)
+		break;              /* second ctrl-c: leave them to it */
+	    for (std::unordered_map<pid_t, int>::iterator it = running.begin(); it != running.end(); ++it)
+		kill(-it->first, SIGINT);
+	}
+    }
+    jobhook = prevhook;
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+
+    for (i = 0; i < tasks.size(); i++)
+	if (tasks[i].state == T_SKIP)
+	    status = 1;
+    dagreport(flags, critical, load, sched);
+    running.clear();
+    ready = std::priority_queue<ready_t>();
+    return stopping ? 130 : status;
+}
+/*************************************
+ * end dependency-graph job runner
+ *************************************/
@@ -0,0 +1,29 @@
+//-*-c++-*-
+#ifndef _dag_h_
+#define _dag_h_
+
+/*
+ * Dependency-graph job runner (the dag builtin). A dag file has one
+ * task per line, written like a one-line make rule:
+ *
+ *     name: dep1 dep2 ; command args
+ *
+ * The command is optional (a task without one just groups its deps).
+ * Blank lines and lines starting with # are ignored. Tasks may name
+ * deps that are defined further down. Cycles are refused before
+ * anything runs.
+ *
+ * Ready tasks run as background jobs, at most maxjobs at a time. The
+ * one with the longest chain of tasks still waiting on it starts
+ * first. A task that fails (exits non-zero or is killed) stops every
+ * task below it. Tasks that don't depend on it keep going. Ctrl-c
+ * interrupts the running tasks and starts nothing new; a second
+ * ctrl-c leaves them behind as ordinary background jobs.
+ */
+
+#define DAG_QUIET  1    /* summary line only, no per-task report */
+#define DAG_DRYRUN 2    /* schedule without running; every task succeeds at once */
+
+int dagrun(const char *path, int maxjobs, int flags);
+
+#endif
@@ -0,0 +1,527 @@
+#include "events.h"
+#include "tsh.h"
+#include "jobs.h"
+#include "outbuf.h"
+#include "stats.h"
+#include "evlog.h"
+#include "board.h"
+#include "uring.h"
+#include "place.h"
+#include "throttle.h"
+#include "tree.h"
+#include "limit.h"
+#include "capture.h"
+#include "helper-routines.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <atomic>
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "event ring needs lock-free ints");
+static_assert((EVRING_SIZE & (EVRING_SIZE - 1)) == 0, "EVRING_SIZE must be a power of two");
+
+/*************************************************
+ * Event ring shared by signal handlers and main
+ *************************************************/
+
+static struct event_t ring[EVRING_SIZE];
+static std::atomic<unsigned> head(0);   /* next slot the producer fills */
+static std::atomic<unsigned> tail(0);   /* next slot the consumer drains */
+
+/*
+ * Set by the producer when the ring was full. Children that could
+ * not be queued are simply left unreaped, so the kernel keeps their
+ * status for us until the consumer has made room.
+ */
+static volatile sig_atomic_t overflow = 0;
+static volatile sig_atomic_t lostsig = 0;
+
+jobhook_t *jobhook = NULL;
+
+static struct exit_t exits[NEXITS];
+unsigned nexits = 0;
+int interrupted = 0;
+
+/* Jobs whose leader is gone but not the rest of their group (tree.h) */
+static struct job_t *waiting[MAXJOBS];
+static int nwaiting = 0;
+
+/*
+ * Reaper thread mode (-t). The job signals stay blocked in every
+ * thread; the reaper collects them with sigwaitinfo, so it is the
+ * ring's only producer. It rings an eventfd doorbell after each batch
+ * and the main thread polls that instead of calling sigsuspend, so it
+ * can watch other descriptors at the same time.
+ */
+static int threaded = 0;
+static pthread_t reaper;
+static int doorbell = -1;
+
+/*
+ * Watched descriptors (see watchfd). Slot 0 of pfds is left for the
+ * one extra descriptor a caller of pollwatched waits on.
+ */
+static struct watch_t watches[MAXWATCH];
+static struct pollfd pfds[MAXWATCH + 1];
+static int nwatch = 0;
+static unsigned watchserial = 0;
+
+/* ringfull - True if the producer has no free slot */
+static int ringfull(void)
+{
+    return head.load(std::memory_order_relaxed) -
+	tail.load(std::memory_order_acquire) == EVRING_SIZE;
+}
+
+/* pushevent - Producer side. Caller must have checked ringfull() */
+static void pushevent(int kind, pid_t pid, int status, int sig, long long cpu)
+{
+    unsigned h = head.load(std::memory_order_relaxed);
+    struct event_t *e = &ring[h & (EVRING_SIZE - 1)];
+
+    e->kind = kind;
+    e->pid = pid;
+    e->status = status;
+    e->sig = sig;
+    e->ts = nowns();
+    e->cpu = cpu;
+    head.store(h + 1, std::memory_order_release);
+}
+
+/*
+ * reapchildren - Reap every child with a pending status change and
+ *    queue one EV_CHILD event per child. Called from sigchld_handler,
+ *    and from the main loop (with job signals blocked) after an overflow.
+ *    wait4 is waitpid plus the child's rusage, for the limit notices.
+ */
+void reapchildren(void)
+{
+    int olderrno = errno;
+    int status;
+    pid_t pid;
+    struct rusage ru;
+
+    for (;;) {
+	if (ringfull()) {
+	    overflow = 1;
+	    break;
+	}
+	if ((pid = wait4(-1, &status, WNOHANG | WUNTRACED, &ru)) <= 0)
+	    break;
+	pushevent(EV_CHILD, pid, status, 0,
+		  (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000LL +
+		  (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000LL);
+    }
+    errno = olderrno;
+}
+
+/* ringbell - Wake a main thread sleeping in waitevents (-t only) */
+static void ringbell(void)
+{
+    uint64_t one = 1;
+
+    write(doorbell, &one, sizeof(one));
+}
+
+/* reaperloop - Body of the reaper thread */
+static void *reaperloop(void *arg)
+{
+    sigset_t mask;
+    siginfo_t info;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTSTP);
+
+    for (;;) {
+	if (sigwaitinfo(&mask, &info) < 0)
+	    continue;
+	if (info.si_signo == SIGCHLD)
+	    reapchildren();
+	else
+	    pushsignal(info.si_signo);
+	ringbell();
+    }
+    return NULL;
+}
+
+/*
+ * startreaper - Switch to reaper thread mode. Must be called before
+ *    any child is forked; the job signals are blocked here so every
+ *    thread created afterwards inherits the blocked mask.
+ */
+void startreaper(void)
+{
+    sigset_t prev;
+
+    blockjobsigs(&prev);
+    threaded = 1;
+    if ((doorbell = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0)
+	unix_error("eventfd error");
+    if (pthread_create(&reaper, NULL, reaperloop, NULL) != 0)
+	app_error("pthread_create error");
+}
+
+/* pushsignal - Queue a keyboard signal for the foreground job */
+void pushsignal(int sig)
+{
+    if (ringfull())
+	lostsig = sig;
+    else
+	pushevent(EV_SIGNAL, 0, 0, sig, 0);
+}
+
+/* forwardsig - Send sig to the process group of the fg job, if any */
+static void forwardsig(int sig)
+{
+    pid_t pid = fgpid(jobs);
+
+    if (pid != 0) {
+	throttlewake(pid);
+	if (sig == SIGINT) {
+	    struct job_t *job = getjobpid(jobs, pid);
+
+	    treekill(&job, 1, sig);
+	}
+	else
+	    kill(-pid, sig);
+	EVLOG(nowns(), LOG_FWD, pid, pid2jid(pid), sig, NULL);
+    }
+    else if (sig == SIGINT)
+	interrupted = 1;
+}
+
+/* noteexit - Remember how a terminated job ended */
+static void noteexit(struct job_t *job, int status)
+{
+    struct exit_t *x = &exits[nexits++ % NEXITS];
+
+    x->pid = job->pid;
+    x->jid = job->jid;
+    x->status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+/* getexit - Exit record i, or NULL if it is gone (or not made yet) */
+const struct exit_t *getexit(unsigned i)
+{
+    if (i >= nexits || nexits - i > NEXITS)
+	return NULL;
+    return &exits[i % NEXITS];
+}
+
+/* findexit - Newest exit record for pid (or, if pid is 0, job jid) */
+const struct exit_t *findexit(pid_t pid, int jid)
+{
+    unsigned i;
+    const struct exit_t *x;
+
+    for (i = nexits; i > 0 && (x = getexit(i - 1)) != NULL; i--)
+	if (pid != 0 ? x->pid == pid : x->jid == jid)
+	    return x;
+    return NULL;
+}
+
+/*
+ * notice - Queue a "Job [jid] (pid) <what> <n>" line, with " (why)" on
+ *    the end if there's a why
+ */
+static void notice(struct job_t *job, const char *what, int n, const char *why)
+{
+    obputs("Job [");
+    obint(job->jid);
+    obputs("] (");
+    obint(job->pid);
+    obputs(") ");
+    obputs(what);
+    obputs(" ");
+    obint(n);
+    if (why != NULL) {
+	obputs(" (");
+	obputs(why);
+	obputs(")");
+    }
+    obputs("\n");
+}
+
+/*
+ * finishjob - job's whole tree is gone; status is how its leader ended.
+ *    Take it off the list.
+ */
+static void finishjob(struct job_t *job, int status)
+{
+    if (jobhook != NULL)
+	jobhook(job, status);
+    if (WIFSIGNALED(status))
+	notice(job, "terminated by signal", WTERMSIG(status), limitwhy(job));
+    else if (limitwhy(job) != NULL)
+	notice(job, "exited with status", WEXITSTATUS(status), limitwhy(job));
+    noteexit(job, status);
+    placedel(job);
+    limitdel(job);
+    capdel(job);
+    EVLOG(nowns(), LOG_EXIT, job->pid, job->jid, status, NULL);
+    deletejob(jobs, job->pid);
+}
+
+/*
+ * orphanevent - A status for a process that isn't a job leader: one of
+ *    a job's descendants, re-parented to us. A stop can still be traced
+ *    to its group; an exit can't, so each job on the waiting list is
+ *    checked instead (there are rarely any).
+ */
+static void orphanevent(struct event_t *e)
+{
+    struct job_t *job;
+    int i = 0;
+
+    if (WIFSTOPPED(e->status)) {
+	if ((job = getjobpid(jobs, getpgid(e->pid))) != NULL && job->status != -1 &&
+	    job->state != ST) {
+	    updatejob(job, e->status);
+	    EVLOG(nowns(), LOG_STOP, job->pid, job->jid, WSTOPSIG(e->status), NULL);
+	    notice(job, "stopped by signal", WSTOPSIG(e->status), NULL);
+	}
+	return;
+    }
+    while (i < nwaiting) {
+	if (treealive(waiting[i]->pid)) {
+	    i++;
+	    continue;
+	}
+	job = waiting[i];
+	waiting[i] = waiting[--nwaiting];
+	finishjob(job, job->status);
+    }
+}
+
+/* childevent - Apply one waitpid status to the job list */
+static void childevent(struct event_t *e)
+{
+    struct job_t *job = getjobpid(jobs, e->pid);
+
+    if (job == NULL) {
+	orphanevent(e);
+	return;
+    }
+    if (WIFSTOPPED(e->status) && throttlestop(job, WSTOPSIG(e->status)))
+	return;                         /* the throttler's, not a real stop */
+
+    if (STATS_ON) {
+	if (job->firstchld == 0) {
+	    job->firstchld = e->ts;
+	    statrecord(SEG_RUN, e->ts - job->start);
+	}
+	statrecord(SEG_REAP, nowns() - e->ts);
+    }
+    EVLOG(e->ts, LOG_REAP, e->pid, job->jid, e->status, NULL);
+
+    if (WIFEXITED(e->status) || WIFSIGNALED(e->status)) {
+	limitexit(job, e->status, e->cpu);
+	if (treealive(job->pid)) {
+	    job->status = e->status;    /* wait for the rest of its group */
+	    waiting[nwaiting++] = job;
+	}
+	else
+	    finishjob(job, e->status);
+    }
+    else if (WIFSTOPPED(e->status)) {   /* child is currently stopped */
+	if (jobhook != NULL)
+	    jobhook(job, e->status);
+	updatejob(job, e->status);
+	EVLOG(nowns(), LOG_STOP, e->pid, job->jid, WSTOPSIG(e->status), NULL);
+	notice(job, "stopped by signal", WSTOPSIG(e->status), NULL);
+    }
+}
+
+/*
+ * drainevents - Consumer side. Apply every queued event to the job
+ *    list in arrival order and return how many were handled. The
+ *    notices for one batch go out together in a single writev.
+ */
+int drainevents(void)
+{
+    int n = 0;
+    sigset_t prev;
+
+    for (;;) {
+	unsigned t = tail.load(std::memory_order_relaxed);
+	unsigned h = head.load(std::memory_order_acquire);
+
+	for (; t != h; t++, n++) {
+	    struct event_t *e = &ring[t & (EVRING_SIZE - 1)];
+
+	    if (e->kind == EV_CHILD)
+		childevent(e);
+	    else
+		forwardsig(e->sig);
+	}
+	tail.store(t, std::memory_order_release);
+	obflush();
+
+	if (lostsig) {
+	    forwardsig(lostsig);
+	    lostsig = 0;
+	    n++;
+	}
+
+	if (!overflow)
+	    break;
+
+	if (threaded) {
+	    /* Only the reaper may produce; kick it and let the caller wait */
+	    overflow = 0;
+	    pthread_kill(reaper, SIGCHLD);
+	    break;
+	}
+
+	/* Pick up the children the handler had to leave behind */
+	blockjobsigs(&prev);
+	overflow = 0;
+	reapchildren();
+	sigprocmask(SIG_SETMASK, &prev, NULL);
+    }
+    if (n > 0)
+	boardupdate();
+    return n;
+}
+
+/* blockjobsigs - Block SIGCHLD, SIGINT and SIGTSTP, saving the old mask */
+void blockjobsigs(sigset_t *prev)
+{
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTSTP);
+    sigprocmask(SIG_BLOCK, &mask, prev);
+}
+
+/* unblockjobsigs - Give a freshly forked child a clean signal mask */
+void unblockjobsigs(void)
+{
+    sigset_t mask;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTSTP);
+    sigprocmask(SIG_UNBLOCK, &mask, NULL);
+}
+
+/*
+ * waitevents - Sleep until a handler has queued something (or a
+ *    watched descriptor needed attention). The job signals must be
+ *    blocked by the caller (prev is the mask to wait with), so an
+ *    event can't slip in between the check and the sleep. In reaper
+ *    thread mode the doorbell keeps its count until it is read, for
+ *    the same reason. With -u the io_uring does the waiting.
+ */
+void waitevents(const sigset_t *prev)
+{
+    uint64_t n;
+
+    if (head.load(std::memory_order_acquire) != tail.load(std::memory_order_relaxed) ||
+	overflow || lostsig)
+	return;
+    if (uring_on)
+	uringwait();
+    else if (threaded) {
+	if (pollwatched(doorbell, NULL))
+	    read(doorbell, &n, sizeof(n));
+    }
+    else if (nwatch > 0)
+	pollwatched(-1, prev);
+    else
+	sigsuspend(prev);
+}
+
+/*
+ * watchfd - Have fn(fd, arg) called whenever fd is readable while the
+ *    shell is waiting for something (input, a foreground job, ...).
+ *    fn must not block. Returns 0 if the table is full.
+ */
+int watchfd(int fd, watchfn_t *fn, void *arg)
+{
+    struct watch_t *w;
+
+    if (nwatch == MAXWATCH)
+	return 0;
+    w = &watches[nwatch];
+    w->fd = fd;
+    w->fn = fn;
+    w->arg = arg;
+    w->serial = ++watchserial;
+    w->armed = 0;
+    pfds[nwatch + 1].fd = fd;
+    pfds[nwatch + 1].events = POLLIN;
+    nwatch++;
+    return 1;
+}
+
+/* unwatchfd - Stop watching fd (before closing it) */
+void unwatchfd(int fd)
+{
+    int i;
+
+    for (i = 0; i < nwatch; i++) {
+	if (watches[i].fd != fd)
+	    continue;
+	if (watches[i].armed)
+	    uringunwatch(watches[i].serial);
+	nwatch--;
+	watches[i] = watches[nwatch];
+	pfds[i + 1] = pfds[nwatch + 1];
+	return;
+    }
+}
+
+/* nwatched, getwatch - Walk the watch table (for the io_uring loop) */
+int nwatched(void)
+{
+    return nwatch;
+}
+
+struct watch_t *getwatch(int i)
+{
+    return &watches[i];
+}
+
+/* runwatch - A watched descriptor is readable: call its handler */
+void runwatch(struct watch_t *w)
+{
+    w->fn(w->fd, w->arg);
+}
+
+/*
+ * pollwatched - Wait until fd (if not -1) is readable or a signal not
+ *    in mask (if given) arrives, calling the handlers of any watched
+ *    descriptors that become readable first. Returns 1 if fd is
+ *    readable.
+ */
+int pollwatched(int fd, const sigset_t *mask)
+{
+    int i;
+
+    pfds[0].fd = fd;
+    pfds[0].events = POLLIN;
+    pfds[0].revents = 0;
+    if (ppoll(pfds, nwatch + 1, NULL, mask) <= 0)
+	return 0;
+    /* Top down, so a handler that unwatches itself doesn't hide one we haven't run */
+    for (i = nwatch; i > 0; i--)
+	if (pfds[i].revents != 0)
+	    runwatch(&watches[i - 1]);
+    return pfds[0].revents != 0;
+}
+/******************
+ * end event ring
+ ******************/
@@ -0,0 +1,88 @@
+//-*-c++-*-
+#ifndef _events_h_
+#define _events_h_
+
+#include <sys/types.h> // needed for pid_t
+#include <signal.h>
+
+/* Event kinds */
+#define EV_CHILD  1 /* waitpid() reported a child status change */
+#define EV_SIGNAL 2 /* keyboard signal to forward to the fg job */
+
+/*
+ * The signal handlers never touch the job list. They push fixed-size
+ * events onto a single-producer/single-consumer ring and the main loop
+ * drains it. Handlers mask each other (see Signal), so there is only
+ * ever one producer at a time. With -t the producer is a dedicated
+ * reaper thread instead, and the handlers are never installed.
+ */
+struct event_t {            /* One ring entry */
+    pid_t pid;              /* child PID (EV_CHILD) */
+    int kind;               /* EV_CHILD or EV_SIGNAL */
+    int status;             /* waitpid status (EV_CHILD) */
+    int sig;                /* signal number (EV_SIGNAL) */
+    long long ts;           /* CLOCK_MONOTONIC time of the push, in ns */
+    long long cpu;          /* CPU time the child had used, in ns (EV_CHILD) */
+};
+
+#define EVRING_SIZE 1024    /* ring slots, must be a power of two */
+
+/*
+ * Optional hook run by drainevents for every stop or termination it
+ * applies, just before a terminated job is deleted from the list.
+ */
+struct job_t;
+typedef void jobhook_t(struct job_t *job, int status);
+extern jobhook_t *jobhook;
+
+/*
+ * Descriptors the shell keeps an eye on while it waits (job output
+ * pipes, timers, ...). Each wait path - sigsuspend, the -t doorbell,
+ * the io_uring loop and reading a command line - services them.
+ */
+typedef void watchfn_t(int fd, void *arg);
+struct watch_t {
+    int fd;
+    watchfn_t *fn;
+    void *arg;
+    unsigned serial;        /* unique per watchfd call */
+    int armed;              /* io_uring poll in flight (-u) */
+};
+
+#define MAXWATCH 1024       /* max watched descriptors */
+
+int watchfd(int fd, watchfn_t *fn, void *arg);
+void unwatchfd(int fd);
+int nwatched(void);
+struct watch_t *getwatch(int i);
+void runwatch(struct watch_t *w);
+int pollwatched(int fd, const sigset_t *mask);
+
+/*
+ * The last NEXITS jobs to terminate, oldest first, for the wait
+ * builtin. status is what a shell reports: the exit code, or 128 plus
+ * the signal number. getexit(i) is NULL once record i is overwritten.
+ */
+struct exit_t {
+    pid_t pid;
+    int jid;
+    int status;
+};
+
+#define NEXITS 256
+
+extern unsigned nexits;     /* records ever made */
+extern int interrupted;     /* ctrl-c arrived with no foreground job */
+
+const struct exit_t *getexit(unsigned i);
+const struct exit_t *findexit(pid_t pid, int jid);
+
+void startreaper(void);
+void reapchildren(void);
+void pushsignal(int sig);
+int drainevents(void);
+void blockjobsigs(sigset_t *prev);
+void unblockjobsigs(void);
+void waitevents(const sigset_t *prev);
+
+#endif
@@ -0,0 +1,112 @@
+#include "evlog.h"
+#include "helper-routines.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static_assert(sizeof(struct evlog_hdr) <= EVLOG_HDRSIZE, "evlog header too big");
+static_assert(sizeof(std::atomic<long long>) == sizeof(long long), "evlog ts must be a plain word");
+
+/**********************************
+ * Memory-mapped job lifecycle log
+ **********************************/
+
+int evlog_on = 0;                    /* logging enabled (-l FILE) */
+static int logfd = -1;
+static char *base = NULL;            /* start of the mapping */
+static unsigned long long cap = 0;   /* records the mapping can hold */
+static pid_t owner = 0;              /* the shell; only it grows the file */
+
+#define LOGSIZE(n) (EVLOG_HDRSIZE + (size_t)(n) * sizeof(struct evlog_rec))
+
+/* evlog_grow - Make room for at least n records. Returns 0 on failure */
+static int evlog_grow(unsigned long long n)
+{
+    unsigned long long newcap = cap;
+    void *p;
+
+    while (newcap < n)
+	newcap += EVLOG_CHUNK;
+    if (ftruncate(logfd, LOGSIZE(newcap)) < 0)
+	return 0;
+    p = mremap(base, LOGSIZE(cap), LOGSIZE(newcap), MREMAP_MAYMOVE);
+    if (p == MAP_FAILED)
+	return 0;
+    base = (char *)p;
+    cap = newcap;
+    return 1;
+}
+
+/*
+ * evlog_open - Map path as the event log, appending to it if it is
+ *    already a tsh log and starting it if it's new or empty. Any other
+ *    file is left alone (EINVAL). Returns 1 on success.
+ */
+int evlog_open(const char *path)
+{
+    struct evlog_hdr *h, hdr;
+    struct stat st;
+
+    if ((logfd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0)
+	return 0;
+    if (fstat(logfd, &st) < 0)
+	return 0;
+    if (st.st_size > 0 && (pread(logfd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) ||
+			   memcmp(hdr.magic, EVLOG_MAGIC, sizeof(EVLOG_MAGIC)) != 0 ||
+			   hdr.recsize != sizeof(struct evlog_rec))) {
+	close(logfd);
+	logfd = -1;
+	errno = EINVAL;             /* not ours: leave it alone */
+	return 0;
+    }
+
+    cap = st.st_size >= (off_t)EVLOG_HDRSIZE ?
+	(st.st_size - EVLOG_HDRSIZE) / sizeof(struct evlog_rec) : 0;
+    if (cap < EVLOG_CHUNK)
+	cap = EVLOG_CHUNK;
+    if (ftruncate(logfd, st.st_size > (off_t)LOGSIZE(cap) ? st.st_size : LOGSIZE(cap)) < 0)
+	return 0;
+    base = (char *)mmap(NULL, LOGSIZE(cap), PROT_READ | PROT_WRITE, MAP_SHARED, logfd, 0);
+    if (base == MAP_FAILED)
+	return 0;
+
+    h = (struct evlog_hdr *)base;
+    if (st.st_size == 0) {
+	memcpy(h->magic, EVLOG_MAGIC, sizeof(EVLOG_MAGIC));
+	h->recsize = sizeof(struct evlog_rec);
+    }
+
+    owner = getpid();
+    evlog_on = 1;
+    evlog_write(nowns(), LOG_START, getpid(), 0, 0, "tsh");
+    return 1;
+}
+
+/*
+ * evlog_write - Append one record. Forked children may call this too:
+ *    they share the mapping, but never grow it, so a child that finds
+ *    no room just drops its record.
+ */
+void evlog_write(long long ts, int kind, pid_t pid, int jid, int arg, const char *text)
+{
+    struct evlog_hdr *h = (struct evlog_hdr *)base;
+    unsigned long long slot = h->nrec.fetch_add(1, std::memory_order_relaxed);
+    struct evlog_rec *r;
+
+    if (slot >= cap && (getpid() != owner || !evlog_grow(slot + 1)))
+	return;
+    r = (struct evlog_rec *)(base + LOGSIZE(slot));
+    r->kind = kind;
+    r->pid = pid;
+    r->jid = jid;
+    r->arg = arg;
+    strncpy(r->text, text ? text : "", EVLOG_TEXT);
+    r->ts.store(ts, std::memory_order_release);
+}
+/******************************
+ * end job lifecycle log
+ ******************************/
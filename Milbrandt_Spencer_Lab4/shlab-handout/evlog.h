@@ -0,0 +1,62 @@
+//-*-c++-*-
+#ifndef _evlog_h_
+#define _evlog_h_
+
+#include <sys/types.h> // needed for pid_t
+#include <atomic>
+
+/*
+ * Binary job-lifecycle log (tsh -l FILE, read back with tshlog).
+ *
+ * The file is a header followed by fixed-size records and is mapped
+ * MAP_SHARED, so logging a record is a handful of stores. Writers
+ * reserve a slot with an atomic add on nrec, fill it in and publish it
+ * by storing ts last; a record whose ts is still 0 was never finished
+ * and is skipped by readers. The file only grows (ftruncate + mremap)
+ * once every EVLOG_CHUNK records.
+ */
+#define EVLOG_MAGIC   "TSHLOG1"
+#define EVLOG_HDRSIZE 64          /* records start at this offset */
+#define EVLOG_CHUNK   16384       /* records added per growth step */
+#define EVLOG_TEXT    24          /* bytes of command text per record */
+
+/* Record kinds */
+#define LOG_START 1  /* shell opened the log (pid = shell) */
+#define LOG_PARSE 2  /* eval parsed a command line (arg = 1 if it ends in &) */
+#define LOG_SPAWN 3  /* fork returned in the parent */
+#define LOG_EXEC  4  /* child is about to exec (written by the child) */
+#define LOG_STOP  5  /* job stopped (arg = signal) */
+#define LOG_CONT  6  /* bg/fg sent SIGCONT */
+#define LOG_FWD   7  /* ctrl-c/ctrl-z forwarded to the fg job (arg = signal) */
+#define LOG_REAP  8  /* waitpid returned the job's status (handler time) */
+#define LOG_EXIT  9  /* job removed from the list (arg = wait status) */
+#define LOG_HOLD  10 /* admit held a bg command (pid 0, arg = number held) */
+#define LOG_ADMIT 11 /* admit started a held command (pid 0, arg = ms held) */
+#define LOG_SHED  12 /* admit stopped a job for memory (arg = RSS in MB) */
+
+struct evlog_hdr {
+    char magic[8];
+    unsigned int recsize;                 /* sizeof(struct evlog_rec) */
+    unsigned int pad;
+    std::atomic<unsigned long long> nrec; /* slots reserved so far */
+};
+
+struct evlog_rec {
+    std::atomic<long long> ts;  /* CLOCK_MONOTONIC ns, 0 = unfinished */
+    int kind;                   /* LOG_* */
+    pid_t pid;                  /* job (or shell) PID */
+    int jid;                    /* job ID, 0 if none yet */
+    int arg;                    /* kind-specific */
+    char text[EVLOG_TEXT];      /* command prefix, NUL padded */
+};
+
+extern int evlog_on;
+
+int evlog_open(const char *path);
+void evlog_write(long long ts, int kind, pid_t pid, int jid, int arg, const char *text);
+
+/* Hot-path wrapper: one predictable branch when logging is off */
+#define EVLOG(ts, kind, pid, jid, arg, text) \
+    do { if (__builtin_expect(evlog_on, 0)) evlog_write(ts, kind, pid, jid, arg, text); } while (0)
+
+#endif
@@ -0,0 +1,578 @@
+#include "glob.h"
+#include "globals.h"
+#include "helper-routines.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <vector>
+
+/*********************************
+ * Pathname expansion
+ *********************************/
+
+#define REGION_BLOCK (1 << 20)      /* region grows by at least this much */
+
+/*
+ * The per-command region: a bump allocator over blocks that are kept
+ * from one command to the next. Resetting it is two stores.
+ */
+struct block_t {
+    char *mem;
+    size_t size;
+};
+
+static std::vector<block_t> blocks;
+static size_t cur, used;            /* current block, bytes used in it */
+static char *lastp;                 /* most recent allocation, for rgrow */
+
+/* ralloc - n bytes from the region, 16-byte aligned */
+static void *ralloc(size_t n)
+{
+    n = (n + 15) & ~(size_t)15;
+    while (cur < blocks.size() && used + n > blocks[cur].size) {
+	cur++;
+	used = 0;
+    }
+    if (cur == blocks.size()) {
+	block_t b = { (char *)malloc(std::max((size_t)REGION_BLOCK, n)),
+		      std::max((size_t)REGION_BLOCK, n) };
+
+	if (b.mem == NULL)
+	    unix_error("glob: malloc error");
+	blocks.push_back(b);
+	used = 0;
+    }
+    lastp = blocks[cur].mem + used;
+    used += n;
+    return lastp;
+}
+
+/* rgrow - Make p (old bytes) n bytes long: in place if it was the last allocation */
+static void *rgrow(void *p, size_t old, size_t n)
+{
+    void *q;
+
+    if (p == lastp && (size_t)(lastp - blocks[cur].mem) + n <= blocks[cur].size) {
+	used = (lastp - blocks[cur].mem) + ((n + 15) & ~(size_t)15);
+	return p;
+    }
+    q = ralloc(n);
+    memcpy(q, p, old);
+    return q;
+}
+
+/* rreset - Start the region over */
+static void rreset(void)
+{
+    cur = used = 0;
+    lastp = NULL;
+}
+
+/*
+ * Directory listings: the entries other than "." and "..", each a
+ * d_type byte, the name and a NUL, back to back.
+ */
+struct listing_t {          /* A cached listing */
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtim, ctim;
+    char *names;            /* NULL if the slot is free */
+    size_t size;
+    unsigned long long stamp;   /* last use, for LRU */
+    int busy;               /* being walked: don't evict */
+};
+
+struct list_t {             /* A listing being walked */
+    const char *names;
+    size_t size;
+    int slot;               /* its cache slot, or -1 if it is in the region */
+};
+
+struct dirent64_t {         /* What getdents64 returns */
+    unsigned long long d_ino;
+    long long d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+static struct listing_t cache[GLOB_CACHE];
+static size_t cachebytes;
+static unsigned long long stamps;
+static char *dents;                 /* the getdents64 buffer */
+
+/*
+ * Pattern components, compiled. A PATTERN's NFA has a bit per
+ * position: bit i set means the first i items have matched. A '*'
+ * item loops on itself and can also be skipped. DFA states (sets of
+ * positions) are made as they're reached, GLOB_STATES at most; if
+ * that fills up it is started over.
+ */
+#define C_LITERAL 0
+#define C_PATTERN 1
+#define C_RECURSE 2                 /* ** */
+
+struct dstate_t {
+    unsigned long long mask;
+    short next[256];                /* -1 until the transition is made */
+};
+
+struct comp_t {
+    int kind;
+    char *lit;                      /* C_LITERAL: the name, unescaped */
+    int dotok;                      /* starts with a literal '.' */
+    unsigned long long acc[256];    /* positions that accept each byte */
+    unsigned long long star, final;
+    struct dstate_t *st;
+    int nstates;
+};
+
+static struct comp_t *comps;
+static int ncomps, dirsonly;
+static char path[4096];             /* the path being built */
+static char **out;                  /* the new argv */
+static size_t nout, capout;
+static unsigned long long nnames;   /* directory entries looked at (-v) */
+
+/* closure - Add the positions reachable by skipping '*'s */
+static inline unsigned long long closure(const struct comp_t *c, unsigned long long m)
+{
+    unsigned long long n;
+
+    while ((n = m | ((m & c->star) << 1)) != m)
+	m = n;
+    return m;
+}
+
+/* addstate - Add a DFA state for mask; returns its index */
+static int addstate(struct comp_t *c, unsigned long long mask)
+{
+    struct dstate_t *s = &c->st[c->nstates];
+
+    s->mask = mask;
+    memset(s->next, 0xff, sizeof(s->next));
+    return c->nstates++;
+}
+
+/* dfastep - Make the transition from state s on byte b */
+static int dfastep(struct comp_t *c, int s, unsigned char b)
+{
+    unsigned long long m = c->st[s].mask & c->acc[b];
+    int t;
+
+    m = closure(c, ((m & ~c->star) << 1) | (m & c->star));
+    for (t = 0; t < c->nstates; t++)
+	if (c->st[t].mask == m)
+	    break;
+    if (t < c->nstates) {
+	c->st[s].next[b] = t;
+	return t;
+    }
+    if (c->nstates == GLOB_STATES) {    /* full: start over */
+	c->nstates = 0;
+	addstate(c, closure(c, 1));
+	return addstate(c, m);
+    }
+    t = addstate(c, m);
+    c->st[s].next[b] = t;
+    return t;
+}
+
+/* match - Does component c match name? */
+static int match(struct comp_t *c, const char *name)
+{
+    int s = 0, t;
+
+    if (name[0] == '.' && !c->dotok)
+	return 0;
+    if (c->st == NULL) {
+	c->st = (struct dstate_t *)ralloc(GLOB_STATES * sizeof(struct dstate_t));
+	addstate(c, closure(c, 1));
+    }
+    for (; *name != '\0'; name++) {
+	if ((t = c->st[s].next[(unsigned char)*name]) < 0)
+	    t = dfastep(c, s, *name);
+	s = t;
+	if (c->st[s].mask == 0)
+	    return 0;
+    }
+    return (c->st[s].mask & c->final) != 0;
+}
+
+/* setclass - Parse the "[...]" at p into acc bit; returns what follows it, or NULL */
+static const char *setclass(struct comp_t *c, const char *p, const char *end, unsigned long long bit)
+{
+    unsigned char in[256];
+    int neg, i, lo, hi;
+    const char *q = p + 1;
+
+    memset(in, 0, sizeof(in));
+    if ((neg = q < end && (*q == '!' || *q == '^')))
+	q++;
+    for (i = 0; q < end && (*q != ']' || i == 0); i++) {
+	lo = hi = (unsigned char)*q++;
+	if (q + 1 < end && *q == '-' && q[1] != ']') {
+	    hi = (unsigned char)q[1];
+	    q += 2;
+	}
+	for (; lo <= hi; lo++)
+	    in[lo] = 1;
+    }
+    if (q >= end)
+	return NULL;                /* no ']': not a class */
+    for (i = 1; i < 256; i++)
+	if (in[i] != neg)
+	    c->acc[i] |= bit;
+    return q + 1;
+}
+
+/* compile - Compile component p..end into c. 0 if it has too many positions */
+static int compile(struct comp_t *c, const char *p, const char *end)
+{
+    const char *q;
+    char *l;
+    int pos = 0, meta = 0, i;
+
+    memset(c, 0, sizeof(*c));
+    if (end - p == 2 && p[0] == '*' && p[1] == '*') {
+	c->kind = C_RECURSE;
+	return 1;
+    }
+    c->lit = l = (char *)ralloc(end - p + 1);
+    c->dotok = *p == '.';
+    for (; p < end; p++) {
+	unsigned long long bit = 1ULL << pos;
+
+	if (pos == GLOB_POS)
+	    return 0;
+	if (*p == '*') {
+	    meta = 1;
+	    if (pos > 0 && (c->star & (bit >> 1)))
+		continue;           /* ** inside a name is just * */
+	    c->star |= bit;
+	    for (i = 1; i < 256; i++)
+		c->acc[i] |= bit;
+	}
+	else if (*p == '?') {
+	    meta = 1;
+	    for (i = 1; i < 256; i++)
+		c->acc[i] |= bit;
+	}
+	else if (*p == '[' && (q = setclass(c, p, end, bit)) != NULL) {
+	    meta = 1;
+	    p = q - 1;
+	}
+	else {
+	    if (*p == '\\' && p + 1 < end)
+		p++;
+	    c->acc[(unsigned char)*p] |= bit;
+	    *l++ = *p;
+	}
+	pos++;
+    }
+    *l = '\0';
+    c->kind = meta ? C_PATTERN : C_LITERAL;
+    c->final = 1ULL << pos;
+    return 1;
+}
+
+/* emit - Add path[0, len) (and a '/' if only directories were asked for) */
+static void emit(size_t len)
+{
+    char *s = (char *)ralloc(len + 2);
+
+    memcpy(s, path, len);
+    if (dirsonly)
+	s[len++] = '/';
+    s[len] = '\0';
+    if (nout == capout) {
+	out = (char **)rgrow(out, capout * sizeof(char *), 2 * capout * sizeof(char *));
+	capout *= 2;
+    }
+    out[nout++] = s;
+}
+
+/* join - Append name to path[0, len); returns the new length, 0 if too long */
+static size_t join(size_t len, const char *name)
+{
+    size_t n = strlen(name);
+
+    if (len > 0 && path[len-1] != '/')
+	path[len++] = '/';
+    if (len + n + 2 > sizeof(path))
+	return 0;
+    memcpy(path + len, name, n + 1);
+    return len + n;
+}
+
+/* isdir - Is the entry of type t at path a directory? follow: through symlinks */
+static int isdir(unsigned char t, int follow)
+{
+    struct stat st;
+
+    if (t == DT_DIR)
+	return 1;
+    if (t != DT_UNKNOWN && (t != DT_LNK || !follow))
+	return 0;
+    return (follow ? stat(path, &st) : lstat(path, &st)) == 0 && S_ISDIR(st.st_mode);
+}
+
+/* cacheput - Keep a copy of the listing just read, if there's room */
+static void cacheput(const struct stat *st, const char *names, size_t size)
+{
+    struct timespec now;
+    int i, victim;
+
+    /* A directory changed within the last second may change again
+       without its times moving: don't trust its listing later */
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    if (size > GLOB_CACHEMAX || now.tv_sec - st->st_mtim.tv_sec < 1 ||
+	now.tv_sec - st->st_ctim.tv_sec < 1)
+	return;
+    for (;;) {
+	victim = -1;
+	for (i = 0; i < GLOB_CACHE; i++) {
+	    if (cache[i].busy)
+		continue;
+	    if (cache[i].names == NULL) {
+		if (cachebytes + size <= GLOB_CACHEMAX) {
+		    victim = i;
+		    break;
+		}
+		continue;
+	    }
+	    if (victim < 0 || cache[i].stamp < cache[victim].stamp)
+		victim = i;
+	}
+	if (victim < 0)
+	    return;                 /* everything is in use */
+	if (cache[victim].names == NULL)
+	    break;
+	free(cache[victim].names);
+	cachebytes -= cache[victim].size;
+	cache[victim].names = NULL;
+    }
+    if ((cache[victim].names = (char *)malloc(size ? size : 1)) == NULL)
+	return;
+    memcpy(cache[victim].names, names, size);
+    cache[victim].size = size;
+    cache[victim].dev = st->st_dev;
+    cache[victim].ino = st->st_ino;
+    cache[victim].mtim = st->st_mtim;
+    cache[victim].ctim = st->st_ctim;
+    cache[victim].stamp = ++stamps;
+    cachebytes += size;
+}
+
+/*
+ * listdir - The listing of the directory at path: from the cache if
+ *    it hasn't changed, else read with getdents64 into the region.
+ *    0 if it can't be read. listdone must follow.
+ */
+static int listdir(struct list_t *l)
+{
+    struct stat st;
+    size_t cap = 65536;
+    char *names;
+    long n, i;
+    int fd, s;
+
+    if ((fd = open(path[0] ? path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0)
+	return 0;
+    if (fstat(fd, &st) < 0) {
+	close(fd);
+	return 0;
+    }
+    for (s = 0; s < GLOB_CACHE; s++) {
+	struct listing_t *c = &cache[s];
+
+	if (c->names != NULL && c->ino == st.st_ino && c->dev == st.st_dev &&
+	    c->mtim.tv_sec == st.st_mtim.tv_sec && c->mtim.tv_nsec == st.st_mtim.tv_nsec &&
+	    c->ctim.tv_sec == st.st_ctim.tv_sec && c->ctim.tv_nsec == st.st_ctim.tv_nsec) {
+	    close(fd);
+	    c->stamp = ++stamps;
+	    c->busy++;
+	    l->names = c->names;
+	    l->size = c->size;
+	    l->slot = s;
+	    return 1;
+	}
+    }
+
+    if (dents == NULL && (dents = (char *)malloc(GLOB_DENTS)) == NULL)
+	unix_error("glob: malloc error");
+    names = (char *)ralloc(cap);
+    l->size = 0;
+    while ((n = syscall(SYS_getdents64, fd, dents, GLOB_DENTS)) > 0) {
+	for (i = 0; i < n; ) {
+	    struct dirent64_t *d = (struct dirent64_t *)(dents + i);
+	    size_t len = strlen(d->d_name);
+
+	    i += d->d_reclen;
+	    if (d->d_name[0] == '.' && (len == 1 || (len == 2 && d->d_name[1] == '.')))
+		continue;
+	    if (l->size + len + 2 > cap) {
+		names = (char *)rgrow(names, l->size, 2 * cap);
+		cap *= 2;
+	    }
+	    names[l->size] = d->d_type;
+	    memcpy(names + l->size + 1, d->d_name, len + 1);
+	    l->size += len + 2;
+	}
+    }
+    close(fd);
+    l->names = names;
+    l->slot = -1;
+    cacheput(&st, names, l->size);
+    return 1;
+}
+
+/* listdone - Done walking l */
+static void listdone(struct list_t *l)
+{
+    if (l->slot >= 0)
+	cache[l->slot].busy--;
+}
+
+/* walk - Expand components k.. under path[0, len) */
+static void walk(size_t len, int k)
+{
+    struct comp_t *c = &comps[k];
+    int last = k == ncomps - 1;
+    struct list_t l;
+    struct stat st;
+    const char *p, *end;
+    size_t n;
+
+    if (c->kind == C_LITERAL) {
+	if ((n = join(len, c->lit)) == 0)
+	    return;
+	if (!last)
+	    walk(n, k + 1);
+	else if (stat(path, &st) == 0 && (!dirsonly || S_ISDIR(st.st_mode)))
+	    emit(n);
+	path[len] = '\0';
+	return;
+    }
+
+    if (c->kind == C_RECURSE && !last)
+	walk(len, k + 1);           /* ** as no directories at all */
+    if (!listdir(&l))
+	return;
+    for (p = l.names, end = l.names + l.size; p < end; p += strlen(p + 1) + 2) {
+	unsigned char type = *p;
+	const char *name = p + 1;
+
+	nnames++;
+	if (c->kind == C_RECURSE) {
+	    if (name[0] == '.' || (n = join(len, name)) == 0)
+		continue;
+	    if (last && (!dirsonly || isdir(type, 0)))
+		emit(n);
+	    if (isdir(type, 0))
+		walk(n, k);
+	}
+	else {
+	    if (!match(c, name) || (n = join(len, name)) == 0)
+		continue;
+	    if (last ? !dirsonly || isdir(type, 1) : isdir(type, 1)) {
+		if (last)
+		    emit(n);
+		else
+		    walk(n, k + 1);
+	    }
+	}
+	path[len] = '\0';
+    }
+    listdone(&l);
+}
+
+/* globword - Add the paths word matches to out; 0 if it can't be a pattern */
+static int globword(const char *word)
+{
+    const char *p = word, *q;
+    size_t len = 0;
+    int n;
+
+    for (n = 1, q = word; *q != '\0'; q++)
+	n += *q == '/';
+    comps = (struct comp_t *)ralloc(n * sizeof(struct comp_t));
+    ncomps = 0;
+    if (*p == '/') {
+	path[len++] = '/';
+	while (*p == '/')
+	    p++;
+    }
+    path[len] = '\0';
+    while (*p != '\0') {
+	q = strchrnul(p, '/');
+	if (!compile(&comps[ncomps++], p, q))
+	    return 0;
+	for (p = q; *p == '/'; p++)
+	    ;
+    }
+    dirsonly = p > word && p[-1] == '/';
+    if (ncomps == 0)
+	return 0;
+    walk(len, 0);
+    return 1;
+}
+
+/* byname - Sort order of expanded paths */
+static bool byname(const char *a, const char *b)
+{
+    return strcmp(a, b) < 0;
+}
+
+/*
+ * globexpand - Expand the unquoted words with wildcards in them.
+ *    Returns argv itself if there are none, else a new argv in the
+ *    region, good until the next command.
+ */
+char **globexpand(char **argv, const char *quoted)
+{
+    size_t start;
+    long long t0;
+    int i, any = 0;
+
+    for (i = 0; argv[i] != NULL; i++)
+	any |= !quoted[i] && strpbrk(argv[i], "*?[") != NULL;
+    if (!any)
+	return argv;
+
+    rreset();
+    capout = 64;
+    nout = 0;
+    out = (char **)ralloc(capout * sizeof(char *));
+    for (i = 0; argv[i] != NULL; i++) {
+	start = nout;
+	if (!quoted[i] && strpbrk(argv[i], "*?[") != NULL) {
+	    t0 = nowns();
+	    nnames = 0;
+	    if (globword(argv[i]))
+		std::sort(out + start, out + nout, byname);
+	    if (verbose)
+		printf("glob: %s: %llu names, %zu matches in %.1f ms\n", argv[i],
+		       nnames, nout - start, (nowns() - t0) / 1e6);
+	}
+	if (nout == start) {        /* no match: the word stays */
+	    path[0] = '\0';
+	    emit(0);
+	    out[nout - 1] = argv[i];
+	}
+    }
+    path[0] = '\0';
+    emit(0);
+    out[nout - 1] = NULL;
+    return out;
+}
+/*********************************
+ * end pathname expansion
+ *********************************/
@@ -0,0 +1,38 @@
+//-*-c++-*-
+#ifndef _glob_h_
+#define _glob_h_
+
+/*
+ * Pathname expansion. After variable expansion, each word that holds
+ * '*', '?' or '[' and didn't come in single quotes is replaced by the
+ * paths it matches, sorted; a word that matches nothing stays as it is.
+ *
+ *     *         any run of characters
+ *     ?         any one character
+ *     [...]     one of the set; [!...] or [^...] one not in it
+ *     **        a whole component: zero or more directories
+ *     \c        c itself
+ *
+ * Wildcards never match a leading '.', nor "." and "..", and '/' only
+ * ever separates components.
+ *
+ * Each pattern component is compiled into a bit-parallel NFA (one bit
+ * per position, at most GLOB_POS of them) from which a DFA is built
+ * lazily as names are fed through it, so matching a name costs one
+ * table lookup per character. Directories are read with getdents64,
+ * GLOB_DENTS bytes at a time. The last GLOB_CACHE listings are kept,
+ * keyed by device, inode and modification and change times, so a
+ * script that globs the same directory again doesn't re-read it.
+ *
+ * Everything else - the automata, the paths and the new argv - comes
+ * from one region that is reset at the start of the next command.
+ */
+#define GLOB_POS    63            /* pattern positions per component */
+#define GLOB_STATES 128           /* DFA states kept per component */
+#define GLOB_DENTS  (1 << 20)     /* getdents64 buffer */
+#define GLOB_CACHE  8             /* directory listings kept */
+#define GLOB_CACHEMAX (64 << 20)  /* bytes of listings kept, at most */
+
+char **globexpand(char **argv, const char *quoted);
+
+#endif
@@ -2,10 +2,16 @@
 #include "globals.h"
 #include <stdio.h>
 #include <strings.h>
+#include <string.h>
+#include <ctype.h>
 #include <memory.h> // strcpy and memcpy
 #include <unistd.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
 
 /***********************
  * Other helper routines
@@ -16,10 +22,21 @@
  */
 void usage(void) 
 {
-    printf("Usage: shell [-hvp]\n");
+    printf("Usage: shell [-hvptusT] [-c size] [-l logfile] [-b board] [-H histfile] [-S|-D|-A socket]\n");
     printf("   -h   print this message\n");
     printf("   -v   print additional diagnostic information\n");
     printf("   -p   do not emit a command prompt\n");
+    printf("   -t   reap children on a dedicated thread\n");
+    printf("   -u   wait for input, signals and children on io_uring\n");
+    printf("   -s   record job lifecycle latencies (see the stats builtin)\n");
+    printf("   -T   forward background job output line by line, tagged (see tag)\n");
+    printf("   -c   capture background job output, up to size bytes each (jobs -o)\n");
+    printf("   -l   append job lifecycle events to logfile (see tshlog)\n");
+    printf("   -b   publish the job list as shared memory /board (see tshtop)\n");
+    printf("   -H   keep command history in histfile (see history, !prefix)\n");
+    printf("   -S   serve jobs to local clients on a Unix socket (see server.h)\n");
+    printf("   -D   run a detached job session on a Unix socket (see session.h)\n");
+    printf("   -A   attach to the job session on a Unix socket\n");
     exit(1);
 }
 
@@ -41,6 +58,107 @@ void app_error(const char *msg)
     exit(1);
 }
 
+/*
+ * signum - Signal number for 9, KILL or SIGKILL; -1 if there's none
+ */
+int signum(const char *name)
+{
+    const char *abbrev;
+    char *end;
+    long sig;
+
+    if (isdigit((unsigned char)name[0])) {
+	sig = strtol(name, &end, 10);
+	return *end == '\0' && sig < NSIG ? (int)sig : -1;
+    }
+    if (!strncasecmp(name, "SIG", 3))
+	name += 3;
+    for (sig = 1; sig < NSIG; sig++)
+	if ((abbrev = sigabbrev_np(sig)) != NULL && !strcasecmp(name, abbrev))
+	    return sig;
+    return -1;
+}
+
+/*
+ * parsesize - A size like 4096, 64k, 2M, 1G or 1T (each unit 10 bits
+ *    more) in bytes; -1 if it's malformed or doesn't fit in a long long
+ */
+long long parsesize(const char *s)
+{
+    static const char units[] = "KMGT";
+    const char *u;
+    char *end;
+    long long n;
+    int shift;
+
+    if (!isdigit((unsigned char)s[0]))
+	return -1;
+    errno = 0;
+    n = strtoll(s, &end, 10);
+    if (errno == ERANGE)
+	return -1;
+    if (*end != '\0' && (u = strchr(units, toupper((unsigned char)*end))) != NULL) {
+	shift = 10 * (u - units + 1);
+	if (n > LLONG_MAX >> shift)
+	    return -1;
+	n <<= shift;
+	end++;
+    }
+    return *end == '\0' ? n : -1;
+}
+
+/*
+ * procscan - Call fn for every process on the system, in one pass over
+ *    /proc. Returns 0 if /proc can't be read.
+ */
+int procscan(procfn_t *fn, void *arg)
+{
+    char path[32], buf[1024], *p, *q;
+    struct procstat_t ps;
+    struct dirent *d;
+    ssize_t n;
+    DIR *dir;
+    int fd;
+
+    if ((dir = opendir("/proc")) == NULL)
+	return 0;
+    while ((d = readdir(dir)) != NULL) {
+	if (!isdigit((unsigned char)d->d_name[0]))
+	    continue;
+	snprintf(path, sizeof(path), "/proc/%d/stat", atoi(d->d_name));
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+	    continue;
+	n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (n <= 0)
+	    continue;
+	buf[n] = '\0';
+	/* pid (comm) state ppid pgrp ...; comm may itself hold ')' */
+	if ((p = strchr(buf, '(')) == NULL || (q = strrchr(buf, ')')) == NULL ||
+	    sscanf(q + 2, "%c %d %d", &ps.state, &ps.ppid, &ps.pgrp) != 3)
+	    continue;
+	ps.pid = atoi(buf);
+	n = q - p - 1 < (ssize_t)sizeof(ps.comm) ? q - p - 1 : sizeof(ps.comm) - 1;
+	memcpy(ps.comm, p + 1, n);
+	ps.comm[n] = '\0';
+	ps.tail = q;
+	fn(&ps, arg);
+    }
+    closedir(dir);
+    return 1;
+}
+
+/*
+ * nowns - CLOCK_MONOTONIC in nanoseconds (async-signal-safe)
+ */
+long long nowns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
 /*
  * Signal - wrapper for the sigaction function
  */
@@ -50,6 +168,9 @@ handler_t *Signal(int signum, handler_t *handler)
 
     action.sa_handler = handler;  
     sigemptyset(&action.sa_mask); /* block sigs of type being handled */
+    sigaddset(&action.sa_mask, SIGCHLD); /* job signal handlers never nest, */
+    sigaddset(&action.sa_mask, SIGINT);  /* so the event ring only ever */
+    sigaddset(&action.sa_mask, SIGTSTP); /* has one producer */
     action.sa_flags = SA_RESTART; /* restart syscalls if possible */
 
     if (sigaction(signum, &action, &old_action) < 0)
@@ -76,7 +197,7 @@ void sigquit_handler(int sig)
  */
 int parseline(const char *cmdline, char **argv) 
 {
-    char array[MAXLINE]; /* holds local copy of command line */
+    static char array[MAXLINE]; /* holds local copy of command line */
     char *buf = array;          /* ptr that traverses command line */
     char *delim;                /* points to first space delimiter */
     int argc;                   /* number of args */
@@ -123,3 +244,22 @@ int parseline(const char *cmdline, char **argv)
     }
     return bg;
 }
+
+/*
+ * quotedwords - For the words parseline just made of cmdline, set
+ *    quoted[i] to 1 if word i was in single quotes, else 0. A word's
+ *    offset in parseline's copy is its offset in cmdline, so the
+ *    character before it there is its opening quote, if it had one.
+ */
+void quotedwords(const char *cmdline, char **argv, char *quoted)
+{
+    size_t lead = strspn(cmdline, " ");
+    int i;
+
+    lead += cmdline[lead] == '\'';
+    for (i = 0; argv[i] != NULL; i++) {
+	size_t at = lead + (argv[i] - argv[0]);
+
+	quoted[i] = at > 0 && cmdline[at - 1] == '\'';
+    }
+}
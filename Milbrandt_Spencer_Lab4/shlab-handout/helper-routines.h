@@ -8,11 +8,25 @@
 
 /* Here are helper routines that we've provided for you */
 int parseline(const char *cmdline, char **argv); 
+void quotedwords(const char *cmdline, char **argv, char *quoted);
 void sigquit_handler(int sig);
 void usage(void);
 void unix_error(const char *msg);
 void app_error(const char *msg);
+long long nowns(void);
+int signum(const char *name);
+long long parsesize(const char *s);
 typedef void handler_t(int);
 handler_t *Signal(int signum, handler_t *handler);
 
+struct procstat_t {         /* One process, from /proc/PID/stat */
+    pid_t pid, ppid, pgrp;
+    char state;
+    char comm[32];
+    const char *tail;       /* the line from the ')' after comm on; only
+			       good during the call to procscan's fn */
+};
+typedef void procfn_t(const struct procstat_t *ps, void *arg);
+int procscan(procfn_t *fn, void *arg);
+
 #endif
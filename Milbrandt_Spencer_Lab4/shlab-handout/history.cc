@@ -0,0 +1,386 @@
+#include "history.h"
+#include "globals.h"
+#include "helper-routines.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <queue>
+#include <vector>
+
+static_assert(sizeof(struct hist_hdr) <= HISTORY_HDRSIZE, "history header too big");
+
+/*********************************
+ * Memory-mapped command history
+ *********************************/
+
+/*
+ * Records are 8-byte aligned and referred to by their offset / 8, in
+ * 32 bits; 0 is no record (it is the header).
+ */
+#define HISTORY_BASE  (HISTORY_HDRSIZE + HISTORY_BUCKETS * sizeof(unsigned int))
+#define RECSIZE(len)  ((sizeof(struct hist_rec) + (len) + 1 + 7) & ~(size_t)7)
+#define REC(o)        ((struct hist_rec *)(base + (size_t)(o) * 8))
+#define TEXT(o)       ((char *)(REC(o) + 1))
+
+int hist_on = 0;                    /* history enabled (-H FILE) */
+static int histfd = -1;
+static char *base = NULL;           /* start of the mapping */
+static size_t mapsize = 0;
+
+#define HDR     ((struct hist_hdr *)base)
+#define BUCKETS ((unsigned int *)(base + HISTORY_HDRSIZE))
+
+struct tnode_t {            /* Trie node; its edge label is TEXT(rec)[from, from + len) */
+    unsigned int rec;
+    unsigned int best;      /* most recently used line at or below it */
+    unsigned int term;      /* the line that ends here, 0 if none */
+    unsigned int child;     /* first child, 0 if none (node 0 is the root) */
+    unsigned int sib;       /* next sibling */
+    unsigned short from, len;
+};
+
+static std::vector<tnode_t> trie;   /* empty until the first recall */
+static unsigned long long indexed;  /* records below this offset are in it */
+
+/* histmap - Map up to the file's current size if it has grown. 0 on failure */
+static int histmap(void)
+{
+    struct stat st;
+    void *p;
+
+    if (fstat(histfd, &st) < 0)
+	return 0;
+    if ((size_t)st.st_size <= mapsize)
+	return 1;
+    p = base == NULL ? mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, histfd, 0) :
+	mremap(base, mapsize, st.st_size, MREMAP_MAYMOVE);
+    if (p == MAP_FAILED)
+	return 0;
+    base = (char *)p;
+    mapsize = st.st_size;
+    return 1;
+}
+
+/* histgrow - Make the file at least n bytes long, HISTORY_CHUNK at a time */
+static int histgrow(size_t n)
+{
+    size_t size = mapsize;
+
+    while (size < n)
+	size += HISTORY_CHUNK;
+    return size == mapsize || (ftruncate(histfd, size) == 0 && histmap());
+}
+
+/*
+ * histopen - Map path as the history file, starting it if it's empty.
+ *    The file is sized up and checked under the lock, so of two shells
+ *    opening a new file at once only the first one starts it.
+ *    Returns 1 on success.
+ */
+int histopen(const char *path)
+{
+    struct stat st;
+    int fresh;
+
+    if ((histfd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0)
+	return 0;
+    flock(histfd, LOCK_EX);
+    if (fstat(histfd, &st) < 0) {
+	flock(histfd, LOCK_UN);
+	return 0;
+    }
+    fresh = st.st_size == 0;
+    if (!fresh && (st.st_size < (off_t)HISTORY_BASE || !histmap() ||
+		   memcmp(HDR->magic, HISTORY_MAGIC, sizeof(HISTORY_MAGIC)) != 0)) {
+	flock(histfd, LOCK_UN);
+	errno = EINVAL;             /* not ours: leave it alone */
+	return 0;
+    }
+    if (!histmap() || !histgrow(HISTORY_BASE + HISTORY_CHUNK)) {
+	flock(histfd, LOCK_UN);
+	return 0;
+    }
+    if (fresh) {
+	memcpy(HDR->magic, HISTORY_MAGIC, sizeof(HISTORY_MAGIC));
+	HDR->end = HISTORY_BASE;
+    }
+    flock(histfd, LOCK_UN);
+    indexed = HISTORY_BASE;
+    hist_on = 1;
+    return 1;
+}
+
+/* hashline - FNV-1a of a line */
+static unsigned int hashline(const char *s, size_t len)
+{
+    unsigned long long h = 14695981039346656037ULL;
+
+    while (len-- > 0)
+	h = (h ^ (unsigned char)*s++) * 1099511628211ULL;
+    return (unsigned int)(h ^ (h >> 32));
+}
+
+/* newer - True if record a was used after record b */
+static inline int newer(unsigned int a, unsigned int b)
+{
+    return b == 0 || REC(a)->last > REC(b)->last;
+}
+
+/* newnode - Add a trie node for TEXT(rec)[from, from + len) */
+static unsigned int newnode(unsigned int rec, size_t from, size_t len)
+{
+    tnode_t n = { rec, rec, 0, 0, 0, (unsigned short)from, (unsigned short)len };
+
+    trie.push_back(n);
+    return trie.size() - 1;
+}
+
+/*
+ * trieadd - Put record o in the trie, or if it is there already note
+ *    that it was used again: every node on its path gets it as best if
+ *    it is newer than what they had.
+ */
+static void trieadd(unsigned int o)
+{
+    const char *s = TEXT(o);
+    size_t len = REC(o)->len, i = 0, k;
+    unsigned int n = 0, c, prev;    /* prev: c's previous sibling, 0 if first */
+
+    for (;;) {
+	if (newer(o, trie[n].best))
+	    trie[n].best = o;
+	if (i == len) {
+	    trie[n].term = o;
+	    return;
+	}
+	for (prev = 0, c = trie[n].child; c != 0; prev = c, c = trie[c].sib)
+	    if (TEXT(trie[c].rec)[trie[c].from] == s[i])
+		break;
+	if (c == 0) {               /* nothing starts this way: a new leaf */
+	    c = newnode(o, i, len - i);
+	    (prev ? trie[prev].sib : trie[n].child) = c;
+	    trie[c].term = o;
+	    return;
+	}
+	const char *label = TEXT(trie[c].rec) + trie[c].from;
+	for (k = 1; k < trie[c].len && i + k < len && label[k] == s[i + k]; k++)
+	    ;
+	if (k < trie[c].len) {      /* diverges inside the label: split it */
+	    unsigned int m = newnode(trie[c].rec, trie[c].from, k);
+
+	    trie[m].best = trie[c].best;
+	    trie[m].child = c;
+	    trie[m].sib = trie[c].sib;
+	    trie[c].sib = 0;
+	    trie[c].from += k;
+	    trie[c].len -= k;
+	    (prev ? trie[prev].sib : trie[n].child) = m;
+	    c = m;
+	}
+	i += k;
+	n = c;
+    }
+}
+
+/* trieupdate - Build the trie, or bring it up to date with the file */
+static void trieupdate(void)
+{
+    long long t0 = nowns();
+    unsigned long long n = 0, end;
+
+    flock(histfd, LOCK_SH);         /* so the file can't grow past the mapping */
+    if (!histmap()) {
+	flock(histfd, LOCK_UN);
+	return;
+    }
+    end = HDR->end;
+    if (trie.empty()) {
+	trie.reserve(2 * HDR->nrec + 1);
+	newnode(0, 0, 0);           /* the root, the empty prefix */
+    }
+    while (indexed < end) {
+	trieadd(indexed / 8);
+	indexed += RECSIZE(REC(indexed / 8)->len);
+	n++;
+    }
+    flock(histfd, LOCK_UN);
+    if (verbose && n > 1)
+	printf("history: indexed %llu lines in %.1f ms\n", n, (nowns() - t0) / 1e6);
+}
+
+/* triefind - The node under which every line starting with prefix is, or 0 */
+static unsigned int triefind(const char *p, size_t plen, int *found)
+{
+    unsigned int n = 0, c;
+    size_t i = 0, k;
+
+    trieupdate();
+    while (i < plen) {
+	for (c = trie[n].child; c != 0; c = trie[c].sib)
+	    if (TEXT(trie[c].rec)[trie[c].from] == p[i])
+		break;
+	if (c == 0)
+	    return *found = 0;
+	for (k = 0; k < trie[c].len && i + k < plen; k++)
+	    if (TEXT(trie[c].rec)[trie[c].from + k] != p[i + k])
+		return *found = 0;
+	i += k;
+	n = c;
+    }
+    *found = 1;
+    return n;
+}
+
+/*
+ * histadd - Enter a command line (newline optional). One that is in
+ *    the history already is only marked as used now.
+ */
+void histadd(const char *line)
+{
+    size_t len = strlen(line), need;
+    unsigned int h, b, o;
+    struct hist_rec *r;
+
+    while (len > 0 && (line[len-1] == '\n' || line[len-1] == ' ' || line[len-1] == '\t'))
+	len--;
+    if (!hist_on || len == 0)
+	return;
+    h = hashline(line, len);
+    b = h & (HISTORY_BUCKETS - 1);
+
+    flock(histfd, LOCK_EX);
+    if (!histmap())
+	goto out;
+    for (o = BUCKETS[b]; o != 0; o = REC(o)->next) {
+	if (REC(o)->hash == h && REC(o)->len == len && !memcmp(TEXT(o), line, len)) {
+	    REC(o)->last = ++HDR->seq;
+	    if (!trie.empty() && o * 8ULL < indexed)
+		trieadd(o);
+	    goto out;
+	}
+    }
+
+    need = RECSIZE(len);
+    if (!histgrow(HDR->end + need))
+	goto out;
+    o = HDR->end / 8;
+    r = REC(o);
+    r->len = len;
+    r->last = ++HDR->seq;
+    r->hash = h;
+    r->next = BUCKETS[b];
+    memcpy(TEXT(o), line, len);
+    TEXT(o)[len] = '\0';
+    BUCKETS[b] = o;                 /* published only once it's complete */
+    HDR->end += need;
+    HDR->nrec++;
+  out:
+    flock(histfd, LOCK_UN);
+}
+
+/*
+ * histexpand - If cmdline is "!prefix" (or "!!"), replace it with the
+ *    most recent line starting with prefix, and echo that. Returns 0
+ *    (after saying so) if there is none, else 1.
+ */
+int histexpand(char *cmdline, int size)
+{
+    char *p = cmdline + 1;
+    size_t plen = strcspn(p, "\n");
+    unsigned int n, best;
+    int found;
+
+    if (cmdline[0] != '!' || plen == 0)
+	return 1;
+    if (!hist_on) {
+	printf("%.*s: history is off\n", (int)plen + 1, cmdline);
+	return 0;
+    }
+    n = triefind(p, !strncmp(p, "!", plen) ? 0 : plen, &found);
+    if (!found || (best = trie[n].best) == 0) {
+	printf("%.*s: event not found\n", (int)plen + 1, cmdline);
+	return 0;
+    }
+    snprintf(cmdline, size, "%s\n", TEXT(best));
+    printf("%s", cmdline);
+    fflush(stdout);                 /* before the command's own output */
+    return 1;
+}
+
+/* lastfirst - Order records by when they were used, oldest first */
+static bool lastfirst(unsigned int a, unsigned int b)
+{
+    return REC(a)->last < REC(b)->last;
+}
+
+/* printlines - Print records (oldest first), each with its last-use stamp */
+static void printlines(std::vector<unsigned int> &recs)
+{
+    size_t i;
+
+    std::sort(recs.begin(), recs.end(), lastfirst);
+    for (i = 0; i < recs.size(); i++)
+	printf("%7u  %s\n", REC(recs[i])->last, TEXT(recs[i]));
+}
+
+/*
+ * histshow - history [N]: the N most recently used lines. One pass
+ *    over the records, keeping the newest N in a heap.
+ */
+void histshow(int n)
+{
+    std::priority_queue<unsigned int, std::vector<unsigned int>, bool (*)(unsigned int, unsigned int)> heap(
+	[](unsigned int a, unsigned int b) { return REC(a)->last > REC(b)->last; });
+    std::vector<unsigned int> recs;
+    unsigned long long off, end;
+
+    if (!hist_on || n <= 0)
+	return;
+    flock(histfd, LOCK_SH);
+    if (!histmap()) {
+	flock(histfd, LOCK_UN);
+	return;
+    }
+    end = HDR->end;
+    for (off = HISTORY_BASE; off < end; off += RECSIZE(REC(off / 8)->len)) {
+	heap.push(off / 8);
+	if (heap.size() > (size_t)n)
+	    heap.pop();
+    }
+    flock(histfd, LOCK_UN);
+    for (; !heap.empty(); heap.pop())
+	recs.push_back(heap.top());
+    printlines(recs);
+}
+
+/* histprefix - history -p PREFIX: every line starting with prefix */
+void histprefix(const char *prefix)
+{
+    std::vector<unsigned int> recs, stack;
+    unsigned int n, c;
+    int found;
+
+    if (!hist_on)
+	return;
+    n = triefind(prefix, strlen(prefix), &found);
+    if (!found)
+	return;
+    for (stack.push_back(n); !stack.empty(); ) {
+	n = stack.back();
+	stack.pop_back();
+	if (trie[n].term != 0)
+	    recs.push_back(trie[n].term);
+	for (c = trie[n].child; c != 0; c = trie[c].sib)
+	    stack.push_back(c);
+    }
+    printlines(recs);
+}
+/*********************************
+ * end command history
+ *********************************/
@@ -0,0 +1,48 @@
+//-*-c++-*-
+#ifndef _history_h_
+#define _history_h_
+
+/*
+ * Command history (tsh -H FILE, the history builtin, !prefix).
+ *
+ * The file is mapped MAP_SHARED and only ever appended to: a header,
+ * a fixed table of HISTORY_BUCKETS hash chain heads, then the records,
+ * each a distinct command line. A line that is already there isn't
+ * added again; its record's last-use stamp is bumped instead. The
+ * hash table is part of the file, so opening even a huge history
+ * reads nothing up front. Shells sharing a file append under flock.
+ *
+ * Prefix recall goes through a path-compressed trie whose edge labels
+ * point into the mapped records, and whose nodes each know the most
+ * recently used line below them: "!prefix" is one walk down the trie.
+ * The trie lives in memory and is built on the first recall, and then
+ * kept up to date, including with lines other shells append.
+ */
+#define HISTORY_MAGIC   "TSHHIS1"
+#define HISTORY_HDRSIZE 64
+#define HISTORY_BUCKETS (1 << 20) /* hash chain heads */
+#define HISTORY_CHUNK   (4 << 20) /* bytes added per growth step */
+
+struct hist_hdr {
+    char magic[8];
+    unsigned long long end;       /* file offset past the last record */
+    unsigned int nrec;            /* distinct lines */
+    unsigned int seq;             /* last-use stamp of the newest line */
+};
+
+struct hist_rec {                 /* Followed by len bytes of text and a NUL */
+    unsigned int len;
+    unsigned int last;            /* seq when it was last entered */
+    unsigned int next;            /* next record on its hash chain */
+    unsigned int hash;
+};
+
+extern int hist_on;
+
+int histopen(const char *path);
+void histadd(const char *line);
+int histexpand(char *cmdline, int size);
+void histshow(int n);
+void histprefix(const char *prefix);
+
+#endif
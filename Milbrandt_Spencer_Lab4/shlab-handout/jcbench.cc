@@ -0,0 +1,60 @@
+/*
+ * jcbench.c - Spawn/wait throughput of the libtsh JobController
+ *
+ * usage: jcbench [-n jobs] [-w window] [command]
+ * Runs <jobs> copies of command (default /bin/true), keeping at most
+ * <window> of them alive at once, and reports jobs per second.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "jobctl.h"
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    int njobs = 10000, window = 64, c, started = 0, done = 0, failed = 0;
+    const char *command = "/bin/true";
+    JobController jc;
+    double t0, t1;
+
+    while ((c = getopt(argc, argv, "n:w:")) != EOF) {
+	switch (c) {
+	case 'n': njobs = atoi(optarg); break;
+	case 'w': window = atoi(optarg); break;
+	default:
+	    fprintf(stderr, "Usage: %s [-n jobs] [-w window] [command]\n", argv[0]);
+	    exit(1);
+	}
+    }
+    if (optind < argc)
+	command = argv[optind];
+    if (njobs < 1 || window < 1 || window > MAXJOBS) {
+	fprintf(stderr, "%s: bad -n or -w\n", argv[0]);
+	exit(1);
+    }
+
+    t0 = now();
+    while (done + failed < njobs) {
+	while (started < njobs && jc.count() < window) {
+	    if (jc.spawn(command) == 0)
+		failed++;
+	    started++;
+	}
+	if (jc.waitany(NULL, NULL))
+	    done++;
+    }
+    t1 = now();
+
+    printf("%d jobs (%d failed) in %.3fs: %.0f jobs/s\n",
+	   njobs, failed, t1 - t0, njobs / (t1 - t0));
+    return 0;
+}
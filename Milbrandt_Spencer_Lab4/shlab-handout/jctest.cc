@@ -0,0 +1,168 @@
+/*
+ * jctest.c - Unit tests for the libtsh JobController
+ *
+ * usage: jctest
+ * Runs each check against real children (the myspin/mystop helpers
+ * and /bin/true) and prints one line per failed check. Exits 0 when
+ * everything passed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "jobctl.h"
+#include "helper-routines.h"
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+	printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+	failures++; \
+    } \
+} while (0)
+
+/* A job's exit status comes back through waitany */
+static void test_exit(void)
+{
+    JobController jc;
+    int jid, got, status;
+
+    jid = jc.spawn("/bin/sh -c 'exit 3'");
+    CHECK(jid > 0);
+    CHECK(jc.count() == 1);
+    CHECK(jc.waitany(&got, &status) == 1);
+    CHECK(got == jid);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 3);
+    CHECK(jc.count() == 0);
+    CHECK(jc.job(jid) == NULL);
+    CHECK(jc.waitany(&got, &status, 0) == 0);
+}
+
+/* Commands that can't be exec'd never become jobs */
+static void test_notfound(void)
+{
+    JobController jc;
+
+    CHECK(jc.spawn("./no-such-program") == 0);
+    CHECK(jc.count() == 0);
+}
+
+/* stop, cont and signal act on the whole process group */
+static void test_control(void)
+{
+    JobController jc;
+    int jid, got, status;
+    struct job_t *j;
+
+    jid = jc.spawn("./myspin 10");
+    CHECK(jid > 0);
+    CHECK(jc.stop(jid));
+    CHECK((j = jc.job(jid)) != NULL && j->state == ST);
+    CHECK(jc.cont(jid));
+    CHECK((j = jc.job(jid)) != NULL && j->state == BG);
+    CHECK(jc.waitany(&got, &status, 100) == 0);   /* still running */
+    CHECK(jc.signal(jid, SIGINT));
+    CHECK(jc.waitany(&got, &status) == 1);
+    CHECK(got == jid && WIFSIGNALED(status) && WTERMSIG(status) == SIGINT);
+    CHECK(!jc.stop(jid));
+    CHECK(!jc.signal(jid + 1, SIGINT));
+}
+
+/* Job IDs count up; foreach sees every live job */
+static void test_enumerate(void)
+{
+    JobController jc;
+    int jids[4], i, seen = 0;
+
+    for (i = 0; i < 4; i++) {
+	jids[i] = jc.spawn("./myspin 5");
+	CHECK(jids[i] == i + 1);
+    }
+    jc.foreach([&](struct job_t *j) { seen++; CHECK(j->state == BG); });
+    CHECK(seen == 4);
+    for (i = 0; i < 4; i++)
+	jc.signal(jids[i], SIGKILL);
+    CHECK(jc.waitall() == 4);
+    CHECK(jc.count() == 0);
+}
+
+/* Two controllers don't see each other's jobs or steal other children */
+static void test_isolation(void)
+{
+    JobController a, b;
+    int ja, jb, got, status;
+    pid_t other;
+
+    if ((other = fork()) == 0)
+	_exit(7);
+    ja = a.spawn("/bin/true");
+    jb = b.spawn("./myspin 5");
+    CHECK(ja == 1 && jb == 1);
+    CHECK(a.waitall() == 1);
+    CHECK(b.count() == 1);
+    b.signal(jb, SIGKILL);
+    CHECK(b.waitany(&got, &status) == 1);
+    CHECK(waitpid(other, &status, 0) == other);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 7);
+}
+
+/* fd() becomes readable when a job exits, for callers with their own loop */
+static void test_fd(void)
+{
+    JobController jc;
+    struct pollfd pfd;
+    int got, status;
+
+    CHECK(jc.spawn("./myspin 1") == 1);
+    pfd.fd = jc.fd();
+    pfd.events = POLLIN;
+    CHECK(pfd.fd >= 0);
+    CHECK(poll(&pfd, 1, 0) == 0);           /* still running */
+    CHECK(poll(&pfd, 1, 5000) == 1 && (pfd.revents & POLLIN));
+    CHECK(jc.reap() == 1);
+    CHECK(jc.waitany(&got, &status) == 1 && got == 1 && WIFEXITED(status));
+    CHECK(jc.count() == 0);
+}
+
+static void alarm_handler(int sig)
+{
+}
+
+/* Signals don't stretch waitany's timeout */
+static void test_timeout(void)
+{
+    JobController jc;
+    struct itimerval it = { { 0, 20000 }, { 0, 20000 } };
+    long long t0;
+    int jid, got, status;
+
+    jid = jc.spawn("./myspin 5");
+    Signal(SIGALRM, alarm_handler);
+    setitimer(ITIMER_REAL, &it, NULL);
+    t0 = nowns();
+    CHECK(jc.waitany(&got, &status, 200) == 0);
+    CHECK(nowns() - t0 < 1000000000LL);
+    memset(&it, 0, sizeof(it));
+    setitimer(ITIMER_REAL, &it, NULL);
+    jc.signal(jid, SIGKILL);
+    CHECK(jc.waitany(&got, &status) == 1 && got == jid);
+}
+
+int main(void)
+{
+    test_exit();
+    test_notfound();
+    test_control();
+    test_enumerate();
+    test_isolation();
+    test_fd();
+    test_timeout();
+    if (failures == 0)
+	printf("jctest: all checks passed\n");
+    return failures != 0;
+}
@@ -0,0 +1,283 @@
+#include "jobctl.h"
+#include "helper-routines.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+/**********************************
+ * libtsh job control
+ **********************************/
+
+/* forkjob - see jobctl.h */
+pid_t forkjob(char **argv, int outfd, void (*inchild)(char **argv))
+{
+    pid_t pid;
+    sigset_t empty;
+
+    if ((pid = fork()) != 0) {
+	if (pid > 0)
+	    setpgid(pid, pid);              /* both sides, so it's set whoever runs first */
+	return pid;
+    }
+
+    setpgid(0, 0);                      /* own process group for ctrl-c/ctrl-z */
+    sigemptyset(&empty);
+    sigprocmask(SIG_SETMASK, &empty, NULL);
+    if (outfd >= 0) {
+	dup2(outfd, STDOUT_FILENO);
+	dup2(outfd, STDERR_FILENO);
+    }
+    if (inchild != NULL)
+	inchild(argv);
+    execvp(argv[0], argv);
+    return 0;
+}
+
+/* execjob - see jobctl.h. The exec error comes back through a CLOEXEC pipe */
+pid_t execjob(char **argv, int outfd)
+{
+    int errpipe[2], err;
+    pid_t pid;
+
+    if (pipe2(errpipe, O_CLOEXEC) < 0)
+	return -1;
+    if ((pid = forkjob(argv, outfd, NULL)) == 0) {
+	err = errno;
+	write(errpipe[1], &err, sizeof(err));
+	_exit(127);
+    }
+    err = errno;
+    close(errpipe[1]);
+    if (pid > 0 && read(errpipe[0], &err, sizeof(err)) == sizeof(err)) {
+	waitpid(pid, NULL, 0);
+	pid = -1;
+    }
+    close(errpipe[0]);
+    errno = err;
+    return pid;
+}
+
+/* waitstatus - see jobctl.h */
+int waitstatus(const siginfo_t *info)
+{
+    switch (info->si_code) {
+    case CLD_EXITED:
+	return (info->si_status & 0xff) << 8;
+    case CLD_KILLED:
+	return info->si_status & 0x7f;
+    case CLD_DUMPED:
+	return (info->si_status & 0x7f) | 0x80;
+    case CLD_STOPPED:
+    case CLD_TRAPPED:
+	return ((info->si_status & 0xff) << 8) | 0x7f;
+    default:
+	return 0xffff;                  /* continued */
+    }
+}
+
+JobController::JobController(int verbose)
+    : njobs(0), verbose(verbose)
+{
+    int i;
+
+    /* calloc'd slots are already clear (pid 0, UNDEF) and stay untouched until used */
+    jobs = (struct job_t *)calloc(MAXJOBS, sizeof(struct job_t));
+    pidfds = (int *)malloc(MAXJOBS * sizeof(int));
+    if (jobs == NULL || pidfds == NULL)
+	app_error("JobController: out of memory");
+    for (i = 0; i < MAXJOBS; i++)
+	pidfds[i] = -1;
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+	unix_error("JobController: epoll_create1 error");
+}
+
+JobController::~JobController()
+{
+    int i;
+
+    for (i = 0; i < MAXJOBS; i++)
+	if (pidfds[i] >= 0)
+	    close(pidfds[i]);
+    close(epfd);
+    free(pidfds);
+    free(jobs);
+}
+
+/*
+ * spawn - Launch argv as a new job. A command that can't be exec'd
+ *    is never added to the list.
+ */
+int JobController::spawn(char **argv, int state, int outfd)
+{
+    char cmdline[MAXLINE];
+    size_t len = 0;
+    int pidfd, i;
+    pid_t pid;
+    struct job_t *job;
+    struct epoll_event ev;
+
+    for (i = 0; argv[i] != NULL && len < MAXLINE - 2; i++)
+	len += snprintf(cmdline + len, MAXLINE - 1 - len, i ? " %s" : "%s", argv[i]);
+    if (len > MAXLINE - 2)
+	len = MAXLINE - 2;
+    cmdline[len++] = '\n';
+    cmdline[len] = '\0';
+
+    if ((pid = execjob(argv, outfd)) < 0)
+	return 0;
+
+    if ((pidfd = syscall(SYS_pidfd_open, pid, 0)) < 0 ||
+	!addjob(jobs, pid, state, cmdline)) {
+	if (pidfd >= 0)
+	    close(pidfd);
+	kill(-pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+	return 0;
+    }
+    job = getjobpid(jobs, pid);
+    i = job - jobs;
+    pidfds[i] = pidfd;
+    ev.events = EPOLLIN;
+    ev.data.u32 = i;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, pidfd, &ev);
+    njobs++;
+    if (verbose)
+	printf("Added job [%d] %d %s", job->jid, job->pid, job->cmdline);
+    return job->jid;
+}
+
+/* spawn - Parse cmdline the way tsh does and launch it */
+int JobController::spawn(const char *cmdline, int state, int outfd)
+{
+    char buf[MAXLINE];
+    char *argv[MAXARGS];
+    size_t len = strlen(cmdline);
+
+    if (len + 2 > MAXLINE)
+	return 0;
+    memcpy(buf, cmdline, len);
+    if (len == 0 || buf[len-1] != '\n')
+	buf[len++] = '\n';
+    buf[len] = '\0';
+    parseline(buf, argv);
+    if (argv[0] == NULL)
+	return 0;
+    return spawn(argv, state, outfd);
+}
+
+struct job_t *JobController::job(int jid)
+{
+    return getjobjid(jobs, jid);
+}
+
+/* stop - Stop a job's process group (SIGSTOP can't be ignored) */
+int JobController::stop(int jid)
+{
+    struct job_t *j = getjobjid(jobs, jid);
+
+    if (j == NULL || kill(-j->pid, SIGSTOP) < 0)
+	return 0;
+    j->state = ST;
+    return 1;
+}
+
+/* cont - Continue a stopped job in the background */
+int JobController::cont(int jid)
+{
+    struct job_t *j = getjobjid(jobs, jid);
+
+    if (j == NULL || kill(-j->pid, SIGCONT) < 0)
+	return 0;
+    j->state = BG;
+    return 1;
+}
+
+int JobController::signal(int jid, int sig)
+{
+    struct job_t *j = getjobjid(jobs, jid);
+
+    return j != NULL && kill(-j->pid, sig) == 0;
+}
+
+/*
+ * reap - Collect every job whose pidfd has become readable. Only
+ *    exits wake a pidfd; stops are applied when stop() is called.
+ */
+int JobController::reap(void)
+{
+    struct epoll_event evs[64];
+    siginfo_t info;
+    int i, n, total = 0;
+
+    while ((n = epoll_wait(epfd, evs, 64, 0)) > 0) {
+	for (i = 0; i < n; i++) {
+	    int slot = evs[i].data.u32;
+	    struct job_t *j = &jobs[slot];
+	    int status;
+
+	    memset(&info, 0, sizeof(info));
+	    if (waitid((idtype_t)P_PIDFD, pidfds[slot], &info, WEXITED | WNOHANG) < 0 ||
+		info.si_pid == 0)
+		continue;
+	    status = waitstatus(&info);
+	    if (!updatejob(j, status))
+		continue;
+	    finished.push_back(std::make_pair(j->jid, status));
+	    epoll_ctl(epfd, EPOLL_CTL_DEL, pidfds[slot], NULL);
+	    close(pidfds[slot]);
+	    pidfds[slot] = -1;
+	    deletejob(jobs, j->pid);
+	    njobs--;
+	    total++;
+	}
+    }
+    return total;
+}
+
+int JobController::waitany(int *jid, int *status, int timeout)
+{
+    struct epoll_event ev;
+    long long deadline = timeout >= 0 ? nowns() + timeout * 1000000LL : 0;
+    int left = timeout, n;
+
+    reap();
+    while (finished.empty()) {
+	if (njobs == 0)
+	    return 0;
+	if (timeout >= 0 && (left = (deadline - nowns() + 999999) / 1000000) <= 0)
+	    return 0;                   /* timed out */
+	if ((n = epoll_wait(epfd, &ev, 1, left)) == 0 || (n < 0 && errno != EINTR))
+	    return 0;                   /* timed out, or epoll failed */
+	reap();
+    }
+    if (jid != NULL)
+	*jid = finished.front().first;
+    if (status != NULL)
+	*status = finished.front().second;
+    finished.pop_front();
+    return 1;
+}
+
+/* waitall - Wait for every job; returns how many finished */
+int JobController::waitall(void)
+{
+    int n = 0;
+
+    while (waitany(NULL, NULL))
+	n++;
+    return n;
+}
+/**********************
+ * end libtsh job control
+ **********************/
@@ -0,0 +1,89 @@
+//-*-c++-*-
+#ifndef _jobctl_h_
+#define _jobctl_h_
+
+#include <sys/types.h> // needed for pid_t
+#include <signal.h>
+#include <deque>
+#include "jobs.h"
+
+/*
+ * libtsh - tsh's job control as a library.
+ *
+ * forkjob is the launch path tsh itself uses. JobController wraps a
+ * private job list for programs that want to run and manage process
+ * groups without being a shell: it installs no signal handlers and
+ * only ever waits for its own children (through pidfds), so it can
+ * live inside a bigger program that has children of its own.
+ */
+
+/*
+ * forkjob - Fork a child in its own process group and exec argv in
+ *    it. If outfd isn't -1 the child's stdout and stderr go to it, and
+ *    inchild (if given) runs in the child just before the exec.
+ *    Returns the child's pid in the parent, -1 if fork failed, and 0
+ *    in the child if the exec failed (errno set; the caller must exit).
+ */
+pid_t forkjob(char **argv, int outfd, void (*inchild)(char **argv));
+
+/*
+ * execjob - forkjob, but only return once the child has exec'd. A
+ *    child whose exec failed is reaped here; the result is then -1
+ *    with errno set to the exec's error (or to the fork's).
+ */
+pid_t execjob(char **argv, int outfd);
+
+/* waitstatus - Turn a waitid() siginfo into a waitpid()-style status */
+int waitstatus(const siginfo_t *info);
+
+class JobController {
+public:
+    JobController(int verbose = 0);
+    ~JobController();
+
+    /* Launch argv (or a parsed cmdline) as a new job. Returns its jid, or 0 */
+    int spawn(char **argv, int state = BG, int outfd = -1);
+    int spawn(const char *cmdline, int state = BG, int outfd = -1);
+
+    /* Job control. Return 1 on success, 0 if there is no such job */
+    int stop(int jid);
+    int cont(int jid);
+    int signal(int jid, int sig);
+
+    /* Apply every pending exit without blocking; returns how many */
+    int reap(void);
+
+    /*
+     * Wait up to timeout ms (-1 = forever) for a job to finish and
+     * report its jid and waitpid-style status. Signals don't extend
+     * the wait. Returns 0 if there are no jobs left, on timeout, or if
+     * epoll fails.
+     */
+    int waitany(int *jid, int *status, int timeout = -1);
+    int waitall(void);
+
+    /* Enumeration */
+    struct job_t *job(int jid);
+    int count(void) const { return njobs; }
+    template <typename F> void foreach(F f) {
+	for (int i = 0; i < MAXJOBS; i++)
+	    if (jobs[i].pid != 0)
+		f(&jobs[i]);
+    }
+
+    /* Readable whenever a job has exited; for the caller's own poll loop */
+    int fd(void) const { return epfd; }
+
+private:
+    struct job_t *jobs;     /* this controller's job list */
+    int *pidfds;            /* pidfd per job list slot, -1 if unused */
+    int njobs;
+    int epfd;               /* epoll set of the live pidfds */
+    int verbose;
+    std::deque<std::pair<int, int> > finished;   /* (jid, status) not yet waited for */
+
+    JobController(const JobController &);
+    JobController &operator=(const JobController &);
+};
+
+#endif
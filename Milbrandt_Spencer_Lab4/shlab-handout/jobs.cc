@@ -1,22 +1,31 @@
 #include "jobs.h"
+#include "outbuf.h"
+#include "helper-routines.h"
 #include <stdio.h>
+#include <string.h>
 #include <strings.h>
 #include <memory.h> // strcpy and memcpy
+#include <sys/wait.h>
 
 
 /***********************************************
  * Helper routines that manipulate the job list
+ *
+ * Everything here works on the table it is handed and keeps no state
+ * of its own, so a program can own several job lists (see jobctl.h).
  **********************************************/
 
-struct job_t jobs[MAXJOBS]; /* The job list */
-static int nextjid = 1;            /* next job ID to allocate */
-
-
 /* clearjob - Clear the entries in a job struct */
 void clearjob(struct job_t *job) {
     job->pid = 0;
     job->jid = 0;
     job->state = UNDEF;
+    job->start = 0;
+    job->firstchld = 0;
+    job->owner = 0;
+    job->cpu = -1;
+    job->status = -1;
+    job->demoted = 0;
     job->cmdline[0] = '\0';
 }
 
@@ -39,30 +48,35 @@ int maxjid(struct job_t *jobs)
     return max;
 }
 
-/* addjob - Add a job to the job list */
+/*
+ * addjob - Add a job to the job list. The new job ID is one past the
+ *    largest one in use (wrapping to 1 after MAXJOBS), found in the
+ *    same pass that looks for a free slot.
+ */
 int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline) 
 {
-    int i;
+    int i, free = -1, max = 0;
     
     if (pid < 1)
 	return 0;
 
     for (i = 0; i < MAXJOBS; i++) {
-	if (jobs[i].pid == 0) {
-	    jobs[i].pid = pid;
-	    jobs[i].state = state;
-	    jobs[i].jid = nextjid++;
-	    if (nextjid > MAXJOBS)
-		nextjid = 1;
-	    strcpy(jobs[i].cmdline, cmdline);
-  	    if(verbose){
-	        printf("Added job [%d] %d %s\n", jobs[i].jid, jobs[i].pid, jobs[i].cmdline);
-            }
-            return 1;
-	}
+	if (jobs[i].jid > max)
+	    max = jobs[i].jid;
+	if (jobs[i].pid == 0 && free < 0)
+	    free = i;
     }
-    printf("Tried to create too many jobs\n");
-    return 0;
+    if (free < 0) {
+	printf("Tried to create too many jobs\n");
+	return 0;
+    }
+
+    jobs[free].pid = pid;
+    jobs[free].state = state;
+    jobs[free].start = nowns();
+    jobs[free].jid = max + 1 > MAXJOBS ? 1 : max + 1;
+    strcpy(jobs[free].cmdline, cmdline);
+    return 1;
 }
 
 /* deletejob - Delete a job whose PID=pid from the job list */
@@ -76,7 +90,6 @@ int deletejob(struct job_t *jobs, pid_t pid)
     for (i = 0; i < MAXJOBS; i++) {
 	if (jobs[i].pid == pid) {
 	    clearjob(&jobs[i]);
-	    nextjid = maxjid(jobs)+1;
 	    return 1;
 	}
     }
@@ -118,45 +131,58 @@ struct job_t *getjobjid(struct job_t *jobs, int jid)
     return NULL;
 }
 
-/* pid2jid - Map process ID to job ID */
-int pid2jid(pid_t pid) 
+/*
+ * updatejob - Apply a waitpid status to a job. Returns 1 if the job
+ *    has finished and should be deleted, 0 if it was only stopped or
+ *    continued.
+ */
+int updatejob(struct job_t *job, int status)
 {
-    int i;
-
-    if (pid < 1)
+    if (WIFSTOPPED(status)) {
+	job->state = ST;
 	return 0;
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].pid == pid) {
-            return jobs[i].jid;
-        }
-    return 0;
+    }
+    if (WIFCONTINUED(status)) {
+	if (job->state == ST)
+	    job->state = BG;
+	return 0;
+    }
+    return 1;
 }
 
-/* listjobs - Print the job list */
+/* listjobs - Print the job list (one writev for the whole listing) */
 void listjobs(struct job_t *jobs) 
 {
     int i;
     
     for (i = 0; i < MAXJOBS; i++) {
 	if (jobs[i].pid != 0) {
-	    printf("[%d] (%d) ", jobs[i].jid, jobs[i].pid);
+	    obputs("[");
+	    obint(jobs[i].jid);
+	    obputs("] (");
+	    obint(jobs[i].pid);
+	    obputs(") ");
 	    switch (jobs[i].state) {
 		case BG: 
-		    printf("Running ");
+		    obputs("Running ");
 		    break;
 		case FG: 
-		    printf("Foreground ");
+		    obputs("Foreground ");
 		    break;
 		case ST: 
-		    printf("Stopped ");
+		    obputs("Stopped ");
 		    break;
 	    default:
-		    printf("listjobs: Internal error: job[%d].state=%d ", 
-			   i, jobs[i].state);
+		    obputs("listjobs: Internal error: job[");
+		    obint(i);
+		    obputs("].state=");
+		    obint(jobs[i].state);
+		    obputs(" ");
 	    }
-	    printf("%s", jobs[i].cmdline);
+	    obref(jobs[i].cmdline, strlen(jobs[i].cmdline));
 	}
     }
+    obflush();
 }
 /******************************
  * end job list helper routines
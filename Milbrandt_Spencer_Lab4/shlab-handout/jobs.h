@@ -25,9 +25,15 @@ struct job_t {              /* The job struct */
     pid_t pid;              /* job PID */
     int jid;                /* job ID [1, 2, ...] */
     int state;              /* UNDEF, BG, FG, or ST */
+    long long start;        /* CLOCK_MONOTONIC ns when the job was added */
+    long long firstchld;    /* ns of its first SIGCHLD, 0 until then */
+    int owner;              /* submitting tsh -S client, 0 = terminal */
+    int cpu;                /* CPU tsh pinned it to, -1 if none (place.h) */
+    int status;             /* leader's wait status once it is gone but
+                               its group isn't (tree.h), -1 until then */
+    int demoted;            /* running under the bg priority policy (prio.h) */
     char cmdline[MAXLINE];  /* command line */
 };
-extern struct job_t jobs[MAXJOBS]; /* The job list */
 
 
 void clearjob(struct job_t *job);
@@ -38,7 +44,7 @@ int deletejob(struct job_t *jobs, pid_t pid);
 pid_t fgpid(struct job_t *jobs);
 struct job_t *getjobpid(struct job_t *jobs, pid_t pid);
 struct job_t *getjobjid(struct job_t *jobs, int jid); 
-int pid2jid(pid_t pid); 
+int updatejob(struct job_t *job, int status);
 void listjobs(struct job_t *jobs);
 
 
@@ -0,0 +1,125 @@
+#include "jobspec.h"
+#include "tsh.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+
+/************************************
+ * Job specs
+ ************************************/
+
+#define SEL_ALL     1
+#define SEL_STOPPED 2
+#define SEL_RUNNING 4
+#define SEL_CUR     8
+#define SEL_PREV    16
+
+/* findin - Index of v in the sorted list, or -1 */
+static int findin(const int *list, int n, int v)
+{
+    const int *p = std::lower_bound(list, list + n, v);
+
+    return p < list + n && *p == v ? p - list : -1;
+}
+
+/*
+ * jobselect - Resolve specs (NULL-terminated) into sel. Returns -1 if
+ *    one isn't a job spec at all, else the number of %N, %+ and %-
+ *    specs that matched no job (each is reported). PIDs that aren't
+ *    jobs are left in sel->pids for the caller to deal with.
+ */
+int jobselect(char **specs, struct jobsel_t *sel)
+{
+    int jids[MAXARGS], pids[MAXARGS], jfound[MAXARGS], pfound[MAXARGS];
+    int nj = 0, np = 0, want = 0, missing = 0, i, k;
+    static char picked[MAXJOBS];
+    struct job_t *cur = NULL, *prev = NULL;
+    char **s;
+
+    for (s = specs; *s != NULL && nj < MAXARGS && np < MAXARGS; s++) {
+	if (!strcmp(*s, "%+") || !strcmp(*s, "%%"))
+	    want |= SEL_CUR;
+	else if (!strcmp(*s, "%-"))
+	    want |= SEL_PREV;
+	else if ((*s)[0] == '%' && isdigit((*s)[1]))
+	    jids[nj++] = atoi(*s + 1);
+	else if (isdigit((*s)[0]))
+	    pids[np++] = atoi(*s);
+	else if (!strcmp(*s, "all"))
+	    want |= SEL_ALL;
+	else if (!strcmp(*s, "stopped"))
+	    want |= SEL_STOPPED;
+	else if (!strcmp(*s, "running"))
+	    want |= SEL_RUNNING;
+	else
+	    return -1;
+    }
+    std::sort(jids, jids + nj);
+    std::sort(pids, pids + np);
+    memset(jfound, 0, nj * sizeof(jfound[0]));
+    memset(pfound, 0, np * sizeof(pfound[0]));
+
+    /* The one pass: match everything, and find the newest two on the way */
+    sel->njobs = 0;
+    sel->newest = NULL;
+    for (i = 0; i < MAXJOBS; i++) {
+	struct job_t *job = &jobs[i];
+	int m = 0;
+
+	picked[i] = 0;
+	if (job->pid == 0)
+	    continue;
+	if (cur == NULL || job->start > cur->start) {
+	    prev = cur;
+	    cur = job;
+	}
+	else if (prev == NULL || job->start > prev->start)
+	    prev = job;
+
+	if ((want & SEL_ALL) || ((want & SEL_STOPPED) && job->state == ST) ||
+	    ((want & SEL_RUNNING) && job->state == BG))
+	    m = 1;
+	if (nj > 0 && (k = findin(jids, nj, job->jid)) >= 0)
+	    m = jfound[k] = 1;
+	if (np > 0 && (k = findin(pids, np, job->pid)) >= 0)
+	    m = pfound[k] = 1;
+	if (m) {
+	    picked[i] = 1;
+	    sel->jobs[sel->njobs++] = job;
+	}
+    }
+    if ((want & SEL_CUR) && cur != NULL && !picked[cur - jobs]) {
+	picked[cur - jobs] = 1;
+	sel->jobs[sel->njobs++] = cur;
+    }
+    if ((want & SEL_PREV) && prev != NULL && !picked[prev - jobs])
+	sel->jobs[sel->njobs++] = prev;
+    for (i = 0; i < sel->njobs; i++)
+	if (sel->newest == NULL || sel->jobs[i]->start > sel->newest->start)
+	    sel->newest = sel->jobs[i];
+
+    /* Report what didn't match */
+    for (k = 0; k < nj; k++)
+	if (!jfound[k] && (k == 0 || jids[k] != jids[k - 1])) {
+	    printf("%%%d: No such job\n", jids[k]);
+	    missing++;
+	}
+    if ((want & SEL_CUR) && cur == NULL) {
+	printf("%%+: No such job\n");
+	missing++;
+    }
+    if ((want & SEL_PREV) && prev == NULL) {
+	printf("%%-: No such job\n");
+	missing++;
+    }
+    sel->npids = 0;
+    for (k = 0; k < np; k++)
+	if (!pfound[k] && (k == 0 || pids[k] != pids[k - 1]))
+	    sel->pids[sel->npids++] = pids[k];
+    return missing;
+}
+/************************************
+ * end job specs
+ ************************************/
@@ -0,0 +1,35 @@
+//-*-c++-*-
+#ifndef _jobspec_h_
+#define _jobspec_h_
+
+#include <sys/types.h> // needed for pid_t
+
+/*
+ * Job specs, as kill, bg and fg take them:
+ *
+ *     %N        job N
+ *     PID       the job whose leader is PID
+ *     %+ (%%)   the current job: the newest one
+ *     %-        the previous job: the one before it
+ *     all       every job
+ *     stopped   every stopped job
+ *     running   every job running in the background
+ *
+ * jobselect resolves a whole argument list in one pass over the job
+ * table, so the cost doesn't grow with the number of specs, and a
+ * job named twice is only selected once.
+ */
+
+struct job_t;
+
+struct jobsel_t {           /* What a list of specs came to */
+    struct job_t **jobs;    /* selected jobs, in table order (caller's array of MAXJOBS) */
+    int njobs;
+    struct job_t *newest;   /* the newest of them, NULL if none */
+    pid_t *pids;            /* PIDs that aren't jobs (caller's array of MAXARGS) */
+    int npids;
+};
+
+int jobselect(char **specs, struct jobsel_t *sel);
+
+#endif
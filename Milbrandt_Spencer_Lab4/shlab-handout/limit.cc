@@ -0,0 +1,290 @@
+#include "limit.h"
+#include "tsh.h"
+#include "helper-routines.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <dirent.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define NLIMITS 5
+#define UNSET   (-2LL)      /* not limited by us: inherited from the shell */
+
+/************************************
+ * Job resource limits
+ ************************************/
+
+static const struct {
+    const char *name;
+    int res;
+    int bytes;              /* value is a size */
+} limits[NLIMITS] = {
+    { "cpu",    RLIMIT_CPU,    0 },
+    { "as",     RLIMIT_AS,     1 },
+    { "nofile", RLIMIT_NOFILE, 0 },
+    { "nproc",  RLIMIT_NPROC,  0 },
+    { "core",   RLIMIT_CORE,   1 },
+};
+
+static long long deflim[NLIMITS] = { UNSET, UNSET, UNSET, UNSET, UNSET };
+static long long nextlim[NLIMITS] = { UNSET, UNSET, UNSET, UNSET, UNSET };
+
+static long long joblim[MAXJOBS][NLIMITS];  /* what each job slot's job got */
+static char limited[MAXJOBS];               /* it got any */
+static char why[MAXJOBS][80];               /* how it ended, if the limits explain it */
+
+/* effective - Limit i for the job about to be forked */
+static long long effective(int i)
+{
+    return nextlim[i] != UNSET ? nextlim[i] : deflim[i];
+}
+
+/* fmtlimit - Limit i's value v as text: 2G, 1024, unlimited */
+static const char *fmtlimit(int i, long long v, char *buf, size_t size)
+{
+    static const char units[] = "KMGT";
+    int u = -1;
+
+    if (v == (long long)RLIM_INFINITY)
+	return "unlimited";
+    while (limits[i].bytes && v >= 1024 && v % 1024 == 0 && u < 3) {
+	v /= 1024;
+	u++;
+    }
+    if (u >= 0)
+	snprintf(buf, size, "%lld%c", v, units[u]);
+    else
+	snprintf(buf, size, "%lld", v);
+    return buf;
+}
+
+/*
+ * parselimit - "unlimited", "-" (UNSET), or a number into *v, with
+ *    K/M/G/T for a size in bytes. Returns -1 if it is bad or doesn't
+ *    fit, else 0.
+ */
+static int parselimit(int i, const char *s, long long *v)
+{
+    char *end;
+
+    if (!strcmp(s, "unlimited")) {
+	*v = RLIM_INFINITY;
+	return 0;
+    }
+    if (!strcmp(s, "-")) {
+	*v = UNSET;
+	return 0;
+    }
+    if (limits[i].bytes)
+	return (*v = parsesize(s)) < 0 ? -1 : 0;
+    if (!isdigit(s[0]))
+	return -1;
+    errno = 0;
+    *v = strtoll(s, &end, 10);
+    return errno == ERANGE || *end != '\0' ? -1 : 0;
+}
+
+/*
+ * limitset - Take RES=VALUE arguments (NULL-terminated) as the limits
+ *    for every new job, or with next for the next one only. Returns 0
+ *    (and changes nothing) if one doesn't parse.
+ */
+int limitset(char **args, int next)
+{
+    long long v[NLIMITS];
+    char **a;
+    int i;
+
+    memcpy(v, next ? nextlim : deflim, sizeof(v));
+    for (a = args; *a != NULL; a++) {
+	const char *eq = strchr(*a, '=');
+
+	for (i = 0; i < NLIMITS; i++)
+	    if (eq != NULL && (size_t)(eq - *a) == strlen(limits[i].name) &&
+		!strncmp(*a, limits[i].name, eq - *a))
+		break;
+	if (i == NLIMITS || parselimit(i, eq + 1, &v[i]) < 0)
+	    return 0;
+    }
+    memcpy(next ? nextlim : deflim, v, sizeof(v));
+    return 1;
+}
+
+/*
+ * limitchild - In the new child: apply the limits. They can't go above
+ *    the shell's own hard limits; a CPU limit's hard limit is a second
+ *    past the soft one, so SIGXCPU comes first.
+ */
+void limitchild(void)
+{
+    struct rlimit rl;
+    rlim_t soft, hard;
+    int i;
+
+    for (i = 0; i < NLIMITS; i++) {
+	if (effective(i) == UNSET || getrlimit(limits[i].res, &rl) < 0)
+	    continue;
+	soft = hard = effective(i);
+	if (limits[i].res == RLIMIT_CPU && soft != RLIM_INFINITY)
+	    hard = soft + 1;
+	if (rl.rlim_max != RLIM_INFINITY && (hard == RLIM_INFINITY || hard > rl.rlim_max))
+	    hard = rl.rlim_max;
+	if (soft == RLIM_INFINITY || soft > hard)
+	    soft = hard;
+	rl.rlim_cur = soft;
+	rl.rlim_max = hard;
+	setrlimit(limits[i].res, &rl);
+    }
+}
+
+/*
+ * limitadd - In the parent: job was just forked with the limits; note
+ *    them and forget the one-command ones. NULL just forgets them.
+ */
+void limitadd(struct job_t *job)
+{
+    int i, slot;
+
+    if (job != NULL) {
+	slot = job - jobs;
+	limited[slot] = 0;
+	why[slot][0] = '\0';
+	for (i = 0; i < NLIMITS; i++)
+	    if ((joblim[slot][i] = effective(i)) != UNSET)
+		limited[slot] = 1;
+    }
+    for (i = 0; i < NLIMITS; i++)
+	nextlim[i] = UNSET;
+}
+
+/*
+ * limitexit - job's leader ended with status after cpu ns of CPU time.
+ *    Work out whether its limits explain it, for limitwhy.
+ */
+void limitexit(struct job_t *job, int status, long long cpu)
+{
+    int slot = job - jobs, sig = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+    long long *lim = joblim[slot];
+    char buf[32], *p = why[slot];
+    size_t left = sizeof(why[slot]);
+    int i, n;
+
+    why[slot][0] = '\0';
+    if (!limited[slot])
+	return;
+    if (lim[0] >= 0 && lim[0] != (long long)RLIM_INFINITY &&
+	(sig == SIGXCPU || (sig == SIGKILL && cpu >= lim[0] * 1000000000LL))) {
+	snprintf(why[slot], sizeof(why[slot]), "CPU limit of %lld s reached, %.1f s used",
+		 lim[0], cpu / 1e9);
+	return;
+    }
+    if (sig != SIGSEGV && sig != SIGABRT && sig != SIGBUS && sig != SIGKILL &&
+	!(WIFEXITED(status) && WEXITSTATUS(status) != 0))
+	return;
+    /* Running out of memory, descriptors or processes shows up like this */
+    for (i = 1; i < NLIMITS && left > 1; i++) {
+	if (lim[i] == UNSET || lim[i] == (long long)RLIM_INFINITY || limits[i].res == RLIMIT_CORE)
+	    continue;
+	n = snprintf(p, left, "%s%s=%s", p == why[slot] ? "ran with " : " ",
+		     limits[i].name, fmtlimit(i, lim[i], buf, sizeof(buf)));
+	if (n < 0 || (size_t)n >= left)
+	    break;
+	p += n;
+	left -= n;
+    }
+}
+
+/* limitwhy - The reason limitexit found for job's end, or NULL */
+const char *limitwhy(struct job_t *job)
+{
+    return why[job - jobs][0] != '\0' ? why[job - jobs] : NULL;
+}
+
+/* limitdel - job is leaving the list */
+void limitdel(struct job_t *job)
+{
+    limited[job - jobs] = 0;
+    why[job - jobs][0] = '\0';
+}
+
+/* usage - What job's leader is using of limit i, as text, or NULL */
+static const char *usage(struct job_t *job, int i, char *buf, size_t size)
+{
+    char path[64];
+    long long v = -1;
+    struct dirent *d;
+    FILE *fp;
+    DIR *dir;
+
+    switch (limits[i].res) {
+    case RLIMIT_CPU:
+	snprintf(path, sizeof(path), "/proc/%d/schedstat", job->pid);
+	if ((fp = fopen(path, "r")) != NULL) {
+	    if (fscanf(fp, "%lld", &v) == 1)
+		snprintf(buf, size, "%.1f s used", v / 1e9);
+	    fclose(fp);
+	}
+	break;
+    case RLIMIT_AS:
+	snprintf(path, sizeof(path), "/proc/%d/statm", job->pid);
+	if ((fp = fopen(path, "r")) != NULL) {
+	    if (fscanf(fp, "%lld", &v) == 1)
+		snprintf(buf, size, "%lldM mapped", v * sysconf(_SC_PAGESIZE) >> 20);
+	    fclose(fp);
+	}
+	break;
+    case RLIMIT_NOFILE:
+	snprintf(path, sizeof(path), "/proc/%d/fd", job->pid);
+	if ((dir = opendir(path)) != NULL) {
+	    for (v = 0; (d = readdir(dir)) != NULL; )
+		v += isdigit(d->d_name[0]) != 0;
+	    closedir(dir);
+	    snprintf(buf, size, "%lld open", v);
+	}
+	break;
+    }
+    return v >= 0 ? buf : NULL;
+}
+
+/* limitlist - For jobs: each limited job's limits and what it is using */
+void limitlist(struct job_t *jobs)
+{
+    char val[32], use[32];
+    const char *u;
+    int slot, i;
+
+    for (slot = 0; slot < MAXJOBS; slot++) {
+	if (jobs[slot].pid == 0 || !limited[slot])
+	    continue;
+	printf("[%d] (%d) limits:", jobs[slot].jid, jobs[slot].pid);
+	for (i = 0; i < NLIMITS; i++) {
+	    if (joblim[slot][i] == UNSET)
+		continue;
+	    printf(" %s=%s", limits[i].name, fmtlimit(i, joblim[slot][i], val, sizeof(val)));
+	    if ((u = usage(&jobs[slot], i, use, sizeof(use))) != NULL)
+		printf(" (%s)", u);
+	}
+	printf("\n");
+    }
+}
+
+/* limitshow - Print the limits new jobs get ("-" = the shell's own) */
+void limitshow(void)
+{
+    char buf[32];
+    int i;
+
+    printf("limit:");
+    for (i = 0; i < NLIMITS; i++)
+	printf(" %s=%s", limits[i].name,
+	       deflim[i] == UNSET ? "-" : fmtlimit(i, deflim[i], buf, sizeof(buf)));
+    printf("\n");
+}
+/************************************
+ * end job resource limits
+ ************************************/
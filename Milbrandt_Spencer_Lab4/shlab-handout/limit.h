@@ -0,0 +1,31 @@
+//-*-c++-*-
+#ifndef _limit_h_
+#define _limit_h_
+
+/*
+ * Resource limits for jobs (the limit builtin). "limit RES=VALUE ..."
+ * sets limits every new job gets; "limit RES=VALUE ... -- cmd ..."
+ * gives them to one command on top of those. RES is cpu (seconds),
+ * as (address space), nofile, nproc or core; sizes take K, M, G or T,
+ * any value can be "unlimited", and "-" clears one. They are applied
+ * with setrlimit in the child, between the fork and the exec.
+ *
+ * A CPU limit is a soft limit (SIGXCPU) with the hard limit, SIGKILL,
+ * a second later. The CPU time a job used comes with its exit status
+ * (wait4), so a job killed by its CPU limit is reported as such; for
+ * one that dies or fails under its other limits the notice names them.
+ * jobs lists each limited job's usage against its limits.
+ */
+
+struct job_t;
+
+int limitset(char **args, int next);
+void limitchild(void);
+void limitadd(struct job_t *job);
+void limitexit(struct job_t *job, int status, long long cpu);
+const char *limitwhy(struct job_t *job);
+void limitdel(struct job_t *job);
+void limitlist(struct job_t *jobs);
+void limitshow(void);
+
+#endif
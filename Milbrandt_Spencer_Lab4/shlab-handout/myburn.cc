@@ -0,0 +1,44 @@
+/* 
+ * myburn.c - A CPU- and memory-bound worker for testing job placement
+ * 
+ * usage: myburn <MB> <passes>
+ * Fills an array of <MB> megabytes, then makes <passes> read-modify-
+ * write sweeps over it and prints the rate it managed in MB/s.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+int main(int argc, char **argv) 
+{
+    struct timespec t0, t1;
+    unsigned long *a, sum = 0;
+    long mb, passes, n, i, p;
+    double secs;
+
+    if (argc != 3) {
+	fprintf(stderr, "Usage: %s <MB> <passes>\n", argv[0]);
+	exit(0);
+    }
+    mb = atol(argv[1]);
+    passes = atol(argv[2]);
+    n = mb * 1024 * 1024 / sizeof(*a);
+    if (n < 1 || passes < 1 || (a = (unsigned long *)malloc(n * sizeof(*a))) == NULL) {
+	fprintf(stderr, "%s: bad size\n", argv[0]);
+	exit(1);
+    }
+    for (i = 0; i < n; i++)
+	a[i] = i;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (p = 0; p < passes; p++)
+	for (i = 0; i < n; i++) {
+	    a[i] = a[i] * 2862933555777941757UL + 3037000493UL;
+	    sum += a[i] >> 60;
+	}
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("myburn: %.0f MB/s (%lu)\n", mb * passes / secs, sum % 10);
+    exit(0);
+}
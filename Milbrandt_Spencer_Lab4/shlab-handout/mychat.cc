@@ -0,0 +1,60 @@
+/* 
+ * mychat.c - A chatty job for testing tagged output (tsh -T)
+ * 
+ * usage: mychat <bytes> [linelen]
+ * Writes <bytes> bytes (rounded down to whole lines) to stdout as
+ * numbered lines of <linelen> bytes each: an 8-digit sequence number,
+ * a space, 'x' padding and a newline. Lines go out many per write.
+ *
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHUNK (64 * 1024)
+
+int main(int argc, char **argv) 
+{
+    static char buf[CHUNK];
+    long bytes, lines, seq = 0;
+    int len = 100, per, n, i, j, w;
+    char *p;
+
+    if (argc < 2 || argc > 3) {
+	fprintf(stderr, "Usage: %s <bytes> [linelen]\n", argv[0]);
+	exit(0);
+    }
+    bytes = atol(argv[1]);
+    if (argc == 3)
+	len = atoi(argv[2]);
+    if (len < 10 || len > CHUNK) {
+	fprintf(stderr, "%s: linelen must be 10..%d\n", argv[0], CHUNK);
+	exit(1);
+    }
+    lines = bytes / len;
+    per = CHUNK / len;
+
+    /* Every line is the same but for its number */
+    for (i = 0; i < per; i++) {
+	p = buf + i * len;
+	memset(p, 'x', len - 1);
+	p[8] = ' ';
+	p[len - 1] = '\n';
+    }
+    while (seq < lines) {
+	n = lines - seq < per ? lines - seq : per;
+	for (i = 0; i < n; i++) {
+	    long s = seq + i;
+
+	    p = buf + i * len;
+	    for (j = 7; j >= 0; j--, s /= 10)
+		p[j] = '0' + s % 10;
+	}
+	for (p = buf, i = n * len; i > 0; p += w, i -= w)
+	    if ((w = write(STDOUT_FILENO, p, i)) <= 0)
+		exit(1);
+	seq += n;
+    }
+    exit(0);
+}
@@ -0,0 +1,35 @@
+/* 
+ * mylat.c - A latency-sensitive job for testing foreground response
+ * 
+ * usage: mylat <n>
+ * Sleeps 1 ms <n> times and prints how late it woke up: the median,
+ * the 99th percentile and the worst case, in microseconds.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+
+int main(int argc, char **argv) 
+{
+    struct timespec t0, t1, ms = { 0, 1000000 };
+    long *late;
+    int i, n;
+
+    if (argc != 2 || (n = atoi(argv[1])) < 1) {
+	fprintf(stderr, "Usage: %s <n>\n", argv[0]);
+	exit(0);
+    }
+    late = (long *)malloc(n * sizeof(*late));
+    for (i = 0; i < n; i++) {
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	clock_nanosleep(CLOCK_MONOTONIC, 0, &ms, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	late[i] = ((t1.tv_sec - t0.tv_sec) * 1000000000L + t1.tv_nsec - t0.tv_nsec - ms.tv_nsec) / 1000;
+    }
+    std::sort(late, late + n);
+    printf("mylat: late by p50 %ld us, p99 %ld us, max %ld us\n",
+	   late[n / 2], late[n * 99 / 100], late[n - 1]);
+    exit(0);
+}
@@ -0,0 +1,113 @@
+#include "outbuf.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+/*******************************
+ * Batched notification output
+ *******************************/
+
+static char buf[OUTBUF_SIZE];          /* formatting space */
+static size_t used = 0;                /* bytes of buf in use */
+static struct iovec iov[OUTBUF_IOV];   /* pending output, in order */
+static int niov = 0;
+
+/* obspan - Queue len bytes at p, merging with the previous span if adjacent */
+static void obspan(const char *p, size_t len)
+{
+    if (niov > 0 && (char *)iov[niov-1].iov_base + iov[niov-1].iov_len == p) {
+	iov[niov-1].iov_len += len;
+	return;
+    }
+    if (niov == OUTBUF_IOV)
+	obflush();
+    iov[niov].iov_base = (void *)p;
+    iov[niov].iov_len = len;
+    niov++;
+}
+
+/* obcopy - Copy len bytes into the formatting buffer and queue them */
+static void obcopy(const char *s, size_t len)
+{
+    if (len > OUTBUF_SIZE - used || niov == OUTBUF_IOV) {
+	obflush();
+	if (len > OUTBUF_SIZE) {   /* too big to buffer; queue it in place */
+	    obspan(s, len);
+	    obflush();
+	    return;
+	}
+    }
+    memcpy(buf + used, s, len);
+    obspan(buf + used, len);
+    used += len;
+}
+
+/* obputs - Queue a copy of string s */
+void obputs(const char *s)
+{
+    obcopy(s, strlen(s));
+}
+
+/*
+ * obref - Queue len bytes at s without copying. The memory must stay
+ *    unchanged until the next obflush.
+ */
+void obref(const char *s, size_t len)
+{
+    if (len > 0)
+	obspan(s, len);
+}
+
+/* obint - Queue the decimal form of v */
+void obint(long v)
+{
+    char tmp[24];
+    char *p = tmp + sizeof(tmp);
+    unsigned long u = v < 0 ? 0UL - (unsigned long)v : (unsigned long)v;
+
+    do {
+	*--p = '0' + u % 10;
+	u /= 10;
+    } while (u != 0);
+    if (v < 0)
+	*--p = '-';
+    obcopy(p, tmp + sizeof(tmp) - p);
+}
+
+/* obflush - Write everything queued with one writev */
+void obflush(void)
+{
+    struct iovec *v = iov;
+    int n = niov;
+
+    if (n == 0)
+	return;
+    fflush(stdout);
+
+    while (n > 0) {
+	ssize_t rc = writev(STDOUT_FILENO, v, n);
+
+	if (rc < 0) {
+	    if (errno == EINTR)
+		continue;
+	    break;
+	}
+	/* Skip what was written and retry the rest after a short write */
+	while (n > 0 && (size_t)rc >= v->iov_len) {
+	    rc -= v->iov_len;
+	    v++;
+	    n--;
+	}
+	if (n > 0) {
+	    v->iov_base = (char *)v->iov_base + rc;
+	    v->iov_len -= rc;
+	}
+    }
+    niov = 0;
+    used = 0;
+}
+/*********************************
+ * end batched notification output
+ *********************************/
@@ -0,0 +1,22 @@
+//-*-c++-*-
+#ifndef _outbuf_h_
+#define _outbuf_h_
+
+#include <stddef.h>
+
+/*
+ * Batched notification output. Text is formatted into a preallocated
+ * buffer (or referenced in place with obref) and handed to the kernel
+ * with a single writev when obflush is called, instead of one write
+ * per printf. Anything still sitting in stdio's stdout buffer is
+ * flushed first so the two streams stay in order.
+ */
+#define OUTBUF_SIZE 65536  /* bytes of formatting space */
+#define OUTBUF_IOV   1024  /* iovecs per writev (IOV_MAX on Linux) */
+
+void obputs(const char *s);
+void obref(const char *s, size_t len);
+void obint(long v);
+void obflush(void);
+
+#endif
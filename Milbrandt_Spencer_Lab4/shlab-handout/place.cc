@@ -0,0 +1,223 @@
+#include "place.h"
+#include "jobs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#define MAXNODES 1024
+
+int place_mode = PLACE_OFF;     /* "place rr|least|off" */
+
+/************************************
+ * CPU and NUMA placement
+ ************************************/
+
+static int inited = 0;
+static cpu_set_t allowed;           /* the shell's own affinity mask */
+static int cpunode[CPU_SETSIZE];    /* NUMA node of each CPU */
+static int nnodes = 1;
+static int load[CPU_SETSIZE];       /* placed jobs alive on each CPU */
+static int lastcpu = -1;            /* where the previous job went */
+
+/* Placement of the job about to be forked */
+static int nextcpu = -1;            /* CPU we picked, -1 if none */
+static int nextnode = -1;           /* node to prefer memory from, -1 for any */
+static int haveset = 0;             /* nextset applies */
+static cpu_set_t nextset;
+
+/*
+ * parsecpus - Parse a CPU list like "0-3,8,10-11" (as in sysfs) into
+ *    set. Returns 0 if it isn't one.
+ */
+static int parsecpus(const char *s, cpu_set_t *set)
+{
+    char *end;
+    long lo, hi;
+
+    CPU_ZERO(set);
+    while (*s != '\0' && *s != '\n') {
+	if (!isdigit(*s))
+	    return 0;
+	lo = hi = strtol(s, &end, 10);
+	if (*end == '-') {
+	    if (!isdigit(end[1]))
+		return 0;
+	    hi = strtol(end + 1, &end, 10);
+	}
+	if (hi < lo || hi >= CPU_SETSIZE)
+	    return 0;
+	for (; lo <= hi; lo++)
+	    CPU_SET(lo, set);
+	if (*end == ',')
+	    end++;
+	else if (*end != '\0' && *end != '\n')
+	    return 0;
+	s = end;
+    }
+    return CPU_COUNT(set) > 0;
+}
+
+/* placeinit - Learn which CPUs we may use and which node each is on */
+static void placeinit(void)
+{
+    char path[300], buf[4096];
+    struct dirent *d;
+    cpu_set_t set;
+    FILE *fp;
+    DIR *dir;
+    int node, cpu, max = -1;
+
+    inited = 1;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+	CPU_ZERO(&allowed);
+	CPU_SET(0, &allowed);
+    }
+    memset(cpunode, 0, sizeof(cpunode));
+    if ((dir = opendir("/sys/devices/system/node")) == NULL)
+	return;
+    while ((d = readdir(dir)) != NULL) {
+	if (strncmp(d->d_name, "node", 4) != 0 || !isdigit(d->d_name[4]))
+	    continue;
+	node = atoi(d->d_name + 4);
+	snprintf(path, sizeof(path), "/sys/devices/system/node/%s/cpulist", d->d_name);
+	if (node >= MAXNODES || (fp = fopen(path, "r")) == NULL)
+	    continue;
+	if (fgets(buf, sizeof(buf), fp) != NULL && parsecpus(buf, &set))
+	    for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+		if (CPU_ISSET(cpu, &set))
+		    cpunode[cpu] = node;
+	fclose(fp);
+	if (node > max)
+	    max = node;
+    }
+    closedir(dir);
+    nnodes = max + 1 > 1 ? max + 1 : 1;
+}
+
+/* pickcpu - The allowed CPU for the next job under the current mode */
+static int pickcpu(void)
+{
+    int i, cpu, best = -1;
+
+    for (i = 1; i <= CPU_SETSIZE; i++) {
+	cpu = (lastcpu + i) % CPU_SETSIZE;  /* start after the last one */
+	if (!CPU_ISSET(cpu, &allowed))
+	    continue;
+	if (place_mode == PLACE_RR)
+	    return cpu;
+	if (best < 0 || load[cpu] < load[best])
+	    best = cpu;
+    }
+    return best;
+}
+
+/* setnode - Prefer memory from node, if this machine has more than one */
+static void setnode(int node)
+{
+    nextnode = nnodes > 1 ? node : -1;
+}
+
+/*
+ * placecpus - Pin the next job to list (the --cpus override); NULL
+ *    drops a pending override. Returns 0 if list isn't a CPU list.
+ */
+int placecpus(const char *list)
+{
+    int cpu, node = -1;
+
+    if (!inited)
+	placeinit();
+    haveset = 0;
+    if (list == NULL)
+	return 1;
+    if (!parsecpus(list, &nextset))
+	return 0;
+    haveset = 1;
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {   /* all on one node? */
+	if (!CPU_ISSET(cpu, &nextset))
+	    continue;
+	if (node >= 0 && cpunode[cpu] != node) {
+	    node = -1;
+	    break;
+	}
+	node = cpunode[cpu];
+    }
+    setnode(node);
+    return 1;
+}
+
+/* placenext - Decide where the job about to be forked goes */
+void placenext(int bg)
+{
+    nextcpu = -1;
+    if (haveset || !bg || place_mode == PLACE_OFF)
+	return;
+    if (!inited)
+	placeinit();
+    if ((nextcpu = pickcpu()) < 0)
+	return;
+    CPU_ZERO(&nextset);
+    CPU_SET(nextcpu, &nextset);
+    haveset = 1;
+    setnode(cpunode[nextcpu]);
+}
+
+/* placechild - In the new child: apply the placement */
+void placechild(void)
+{
+    unsigned long mask[MAXNODES / (8 * sizeof(unsigned long))];
+
+    if (!haveset)
+	return;
+    sched_setaffinity(0, sizeof(nextset), &nextset);
+    if (nextnode >= 0) {
+	memset(mask, 0, sizeof(mask));
+	mask[nextnode / (8 * sizeof(unsigned long))] |= 1UL << (nextnode % (8 * sizeof(unsigned long)));
+	syscall(SYS_set_mempolicy, MPOL_PREFERRED, mask, (unsigned long)MAXNODES);
+    }
+}
+
+/* placeadd - Job pid is on the list (pid is 0 if the fork failed); count it where it went */
+void placeadd(struct job_t *jobs, pid_t pid)
+{
+    struct job_t *job;
+
+    if (pid != 0 && nextcpu >= 0 && (job = getjobpid(jobs, pid)) != NULL) {
+	job->cpu = nextcpu;
+	load[nextcpu]++;
+	lastcpu = nextcpu;
+    }
+    nextcpu = -1;
+    haveset = 0;
+}
+
+/* placedel - A placed job has terminated */
+void placedel(struct job_t *job)
+{
+    if (job->cpu >= 0 && load[job->cpu] > 0)
+	load[job->cpu]--;
+}
+
+/* placeshow - The place builtin's listing */
+void placeshow(void)
+{
+    static const char *modes[] = { "off", "rr", "least" };
+    int cpu;
+
+    if (!inited)
+	placeinit();
+    printf("place: %s, %d CPUs on %d node%s\n", modes[place_mode],
+	   CPU_COUNT(&allowed), nnodes, nnodes > 1 ? "s" : "");
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++)
+	if (CPU_ISSET(cpu, &allowed) && load[cpu] > 0)
+	    printf("cpu %d (node %d): %d jobs\n", cpu, cpunode[cpu], load[cpu]);
+}
+/************************************
+ * end CPU and NUMA placement
+ ************************************/
@@ -0,0 +1,33 @@
+//-*-c++-*-
+#ifndef _place_h_
+#define _place_h_
+
+#include <sys/types.h> // needed for pid_t
+
+/*
+ * CPU placement of background jobs (the place builtin, --cpus).
+ * With placement on, each new background job is pinned to one CPU
+ * of the shell's own affinity mask: the next one in turn (rr), or
+ * the one with the fewest placed jobs still alive (least). On a
+ * machine with more than one NUMA node the job also prefers memory
+ * from that CPU's node. "--cpus LIST cmd ..." pins one command to
+ * LIST (e.g. 0-3,8), placement on or not. The decision is made in
+ * the parent and applied in the child just before the exec.
+ */
+
+#define PLACE_OFF   0
+#define PLACE_RR    1   /* round robin */
+#define PLACE_LEAST 2   /* fewest placed jobs */
+
+extern int place_mode;
+
+struct job_t;
+
+int placecpus(const char *list);
+void placenext(int bg);
+void placechild(void);
+void placeadd(struct job_t *jobs, pid_t pid);
+void placedel(struct job_t *job);
+void placeshow(void);
+
+#endif
@@ -0,0 +1,194 @@
+#include "prio.h"
+#include "jobs.h"
+#include "helper-routines.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+/* From linux/ioprio.h, which older uapi headers don't have */
+#define IOPRIO_CLASS_NONE  0
+#define IOPRIO_CLASS_BE    2
+#define IOPRIO_CLASS_IDLE  3
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_WHO_PGRP    2
+
+struct prio_t bgprio = { 0, SCHED_BATCH, 10, IOPRIO_CLASS_IDLE };
+
+/************************************
+ * Background job priority
+ ************************************/
+
+static int nextbg = 0;      /* the job about to be forked is a bg job */
+
+static const char *schednames[] = { "other", "fifo", "rr", "batch", "iso", "idle" };
+static const char *ionames[] = { "none", "rt", "be", "idle" };
+
+/* ioprio - The I/O priority value for a class (BE at its default level, 4) */
+static int ioprio(int ioclass)
+{
+    return ioclass << IOPRIO_CLASS_SHIFT | (ioclass == IOPRIO_CLASS_BE ? 4 : 0);
+}
+
+/* setthread - Give one thread a scheduling class */
+static int setthread(pid_t tid, int sched)
+{
+    struct sched_param sp;
+
+    memset(&sp, 0, sizeof(sp));
+    return sched_setscheduler(tid, sched, &sp);
+}
+
+struct groupsched_t {        /* What setgroup asks of each process */
+    pid_t pgid;
+    int sched;
+    int ok;
+};
+
+/* setproc - procscan: give each thread of ps the class, if it's in the group */
+static void setproc(const struct procstat_t *ps, void *arg)
+{
+    struct groupsched_t *g = (struct groupsched_t *)arg;
+    char path[32];
+    struct dirent *t;
+    DIR *task;
+
+    if (ps->pgrp != g->pgid)
+	return;
+    snprintf(path, sizeof(path), "/proc/%d/task", (int)ps->pid);
+    if ((task = opendir(path)) == NULL)
+	return;
+    while ((t = readdir(task)) != NULL)
+	if (isdigit(t->d_name[0]) && setthread(atoi(t->d_name), g->sched) < 0 && errno != ESRCH)
+	    g->ok = 0;
+    closedir(task);
+}
+
+/*
+ * setgroup - Give every thread of every process in group pgid the
+ *    scheduling class. Returns 0 if one of them refused.
+ */
+static int setgroup(pid_t pgid, int sched)
+{
+    struct groupsched_t g = { pgid, sched, 1 };
+
+    if (!procscan(setproc, &g))
+	return setthread(pgid, sched) == 0;
+    return g.ok;
+}
+
+/* prionext - Say whether the job about to be forked runs in the background */
+void prionext(int bg)
+{
+    nextbg = bg;
+}
+
+/* priochild - In the new child: take the background policy if it applies */
+void priochild(void)
+{
+    if (!bgprio.on || !nextbg)
+	return;
+    setthread(0, bgprio.sched);
+    if (bgprio.nice != 0)
+	setpriority(PRIO_PROCESS, 0, getpriority(PRIO_PROCESS, 0) + bgprio.nice);
+    if (bgprio.ioclass != IOPRIO_CLASS_NONE)
+	syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio(bgprio.ioclass));
+}
+
+/* prioadd - In the parent: job was just forked; note whether priochild demoted it */
+void prioadd(struct job_t *job)
+{
+    job->demoted = bgprio.on && nextbg;
+}
+
+/*
+ * priojob - Move job to the background policy (bg) or back to the
+ *    shell's own priority. Without force, bg does nothing while the
+ *    policy is off and promotion only undoes a demotion. Returns 0 if
+ *    the kernel refused some of it.
+ */
+int priojob(struct job_t *job, int bg, int force)
+{
+    int ok = 1, nice = getpriority(PRIO_PROCESS, 0);
+
+    if (!force && (bg ? !bgprio.on : !job->demoted))
+	return 1;
+    ok &= setgroup(job->pid, bg ? bgprio.sched : SCHED_OTHER);
+    ok &= setpriority(PRIO_PGRP, job->pid, bg ? nice + bgprio.nice : nice) == 0;
+    if (!bg || bgprio.ioclass != IOPRIO_CLASS_NONE)
+	ok &= syscall(SYS_ioprio_set, IOPRIO_WHO_PGRP, job->pid,
+		      ioprio(bg ? bgprio.ioclass : IOPRIO_CLASS_NONE)) == 0;
+    job->demoted = bg;
+    return ok;
+}
+
+/* prioshow - Print the policy, or what job's leader is running with */
+void prioshow(struct job_t *job)
+{
+    int sched, io;
+
+    if (job == NULL) {
+	if (bgprio.on)
+	    printf("prio: on, sched %s, nice +%d, io %s\n", schednames[bgprio.sched],
+		   bgprio.nice, ionames[bgprio.ioclass]);
+	else
+	    printf("prio: off\n");
+	return;
+    }
+    sched = sched_getscheduler(job->pid) & ~SCHED_RESET_ON_FORK;
+    io = syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, job->pid);
+    if (sched < 0 || io < 0) {
+	printf("[%d] (%d): %s\n", job->jid, job->pid, strerror(errno));
+	return;
+    }
+    printf("[%d] (%d) sched %s, nice %d, io %s\n", job->jid, job->pid,
+	   sched < 6 ? schednames[sched] : "?", getpriority(PRIO_PROCESS, job->pid),
+	   ionames[(io >> IOPRIO_CLASS_SHIFT) & 3]);
+}
+
+/*
+ * prioset - Change the policy from the prio builtin's arguments:
+ *    on|off, sched other|batch|idle, nice N, io none|be|idle.
+ *    Returns 0 on a bad argument.
+ */
+int prioset(char **argv)
+{
+    int i;
+
+    if (!strcmp(argv[0], "on") && argv[1] == NULL)
+	bgprio.on = 1;
+    else if (!strcmp(argv[0], "off") && argv[1] == NULL)
+	bgprio.on = 0;
+    else if (!strcmp(argv[0], "sched") && argv[1] != NULL && argv[2] == NULL) {
+	for (i = 0; i < 6; i++)
+	    if (!strcmp(argv[1], schednames[i]))
+		break;
+	if (i != SCHED_OTHER && i != SCHED_BATCH && i != SCHED_IDLE)
+	    return 0;
+	bgprio.sched = i;
+    }
+    else if (!strcmp(argv[0], "nice") && argv[1] != NULL && argv[2] == NULL &&
+	     isdigit(argv[1][0]) && atoi(argv[1]) <= 19)
+	bgprio.nice = atoi(argv[1]);
+    else if (!strcmp(argv[0], "io") && argv[1] != NULL && argv[2] == NULL) {
+	for (i = 0; i < 4; i++)
+	    if (!strcmp(argv[1], ionames[i]))
+		break;
+	if (i != IOPRIO_CLASS_NONE && i != IOPRIO_CLASS_BE && i != IOPRIO_CLASS_IDLE)
+	    return 0;
+	bgprio.ioclass = i;
+    }
+    else
+	return 0;
+    return 1;
+}
+/************************************
+ * end background job priority
+ ************************************/
@@ -0,0 +1,38 @@
+//-*-c++-*-
+#ifndef _prio_h_
+#define _prio_h_
+
+/*
+ * Background job priority (the prio builtin). With the policy on,
+ * background jobs run under a lower scheduling class (SCHED_BATCH by
+ * default, or SCHED_IDLE), a nice increment and an I/O priority class
+ * (idle by default), so the job in the foreground stays responsive.
+ * A job started with & gets the policy in the child before its exec.
+ * fg promotes a job back to normal priority and bg demotes it again.
+ * Both apply to every thread in the job's process group. A job that was
+ * demoted is promoted on fg even if the policy has been turned off
+ * since; one that never was is left alone.
+ *
+ * Going back up is not always allowed: without CAP_SYS_NICE the kernel
+ * only lowers a nice value as far as RLIMIT_NICE permits.
+ */
+
+struct job_t;
+
+struct prio_t {             /* What background jobs get */
+    int on;
+    int sched;              /* SCHED_OTHER, SCHED_BATCH or SCHED_IDLE */
+    int nice;               /* added to the shell's nice value */
+    int ioclass;            /* IOPRIO_CLASS_* (see prio.cc), 0 = leave alone */
+};
+
+extern struct prio_t bgprio;
+
+void prionext(int bg);
+void priochild(void);
+void prioadd(struct job_t *job);
+int priojob(struct job_t *job, int bg, int force);
+void prioshow(struct job_t *job);
+int prioset(char **argv);
+
+#endif
@@ -0,0 +1,614 @@
+#include "server.h"
+#include "tsh.h"
+#include "jobs.h"
+#include "events.h"
+#include "tree.h"
+#include "helper-routines.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <map>
+#include <string>
+
+/*****************************************
+ * Job server on a Unix-domain socket (-S)
+ *****************************************/
+
+#define MAXEVENTS 64
+#define READSIZE  65536
+#define SESS_TAIL 1024      /* output bytes a session keeps per job */
+#define CLIENT_OUTMAX (16 << 20) /* unsent bytes a client may have queued;
+                                   more than the biggest attach reply */
+
+struct client_t {           /* One connected client */
+    int fd;                 /* its socket */
+    int id;                 /* owner id stamped on its jobs */
+    int armed;              /* EPOLLOUT is being watched */
+    int attached;           /* sent "attach": sees every session job */
+    std::string in;         /* partial request line */
+    std::string out;        /* replies the socket hasn't taken yet */
+};
+
+struct capture_t {          /* Output pipe of a "run -o" (or session) job */
+    int client;             /* owner id, 0 if it didn't ask for -o */
+    int jid;
+    pid_t pid;
+};
+
+struct tail_t {             /* The newest output of a session job */
+    int jid;
+    int open;               /* its output pipe is still open */
+    int live;               /* it is still in the job list */
+    std::string buf;        /* at most SESS_TAIL bytes */
+    std::string done;       /* how it ended, if no one was attached to see */
+};
+
+static int epfd, lfd;
+static int nextclient = 1;
+static int session;                        /* -D: jobs outlive their clients */
+static const char *sockpath;
+static std::map<int, client_t *> byfd;     /* socket fd -> client */
+static std::map<int, client_t *> byid;     /* owner id -> client */
+static std::map<int, capture_t> pipes;     /* pipe fd -> job it captures */
+static std::map<pid_t, tail_t> tails;      /* job PID -> its tail (-D) */
+
+static void dropclient(client_t *c);
+
+/* watch - Add fd to the epoll set (or change its events) */
+static void watch(int fd, unsigned events, int op)
+{
+    struct epoll_event ev;
+
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(epfd, op, fd, &ev) < 0 && op == EPOLL_CTL_ADD)
+	unix_error("epoll_ctl error");
+}
+
+/* flushclient - Send as much of c->out as the socket will take */
+static void flushclient(client_t *c)
+{
+    while (!c->out.empty()) {
+	ssize_t rc = send(c->fd, c->out.data(), c->out.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+
+	if (rc < 0) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno == EAGAIN || errno == EWOULDBLOCK)
+		break;
+	    dropclient(c);
+	    return;
+	}
+	c->out.erase(0, rc);
+    }
+    if (c->out.size() > CLIENT_OUTMAX) {
+	dropclient(c);              /* it has stopped reading */
+	return;
+    }
+    if (c->armed != !c->out.empty()) {
+	c->armed = !c->out.empty();
+	watch(c->fd, c->armed ? EPOLLIN | EPOLLOUT : EPOLLIN, EPOLL_CTL_MOD);
+    }
+}
+
+/* reply - Queue a reply line for c */
+static void reply(client_t *c, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+static void reply(client_t *c, const char *fmt, ...)
+{
+    char line[MAXLINE + 64];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    c->out += line;
+    c->out += '\n';
+}
+
+/* dropclient - Disconnect c and hang up on its jobs (not in a session) */
+static void dropclient(client_t *c)
+{
+    int i;
+
+    for (i = 0; i < MAXJOBS && !session; i++) {
+	if (jobs[i].pid != 0 && jobs[i].owner == c->id) {
+	    kill(-jobs[i].pid, SIGHUP);
+	    kill(-jobs[i].pid, SIGCONT);
+	    jobs[i].owner = -1;
+	}
+    }
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    byfd.erase(c->fd);
+    byid.erase(c->id);
+    delete c;
+}
+
+/* tailgc - Forget t once its job and its output are both over and reported */
+static void tailgc(std::map<pid_t, tail_t>::iterator t)
+{
+    if (!t->second.open && !t->second.live && t->second.done.empty())
+	tails.erase(t);
+}
+
+/*
+ * serverhook - jobhook: tell the owner about a stop or termination. In
+ *    a session every attached client is told too; if none is, the end
+ *    of the job is kept for the next one that attaches.
+ */
+static void serverhook(struct job_t *job, int status)
+{
+    std::map<int, client_t *>::iterator it;
+    std::map<pid_t, tail_t>::iterator t;
+    char line[64];
+    int seen = 0;
+
+    if (WIFEXITED(status))
+	snprintf(line, sizeof(line), "done %d %d exit %d", job->jid, job->pid, WEXITSTATUS(status));
+    else if (WIFSIGNALED(status))
+	snprintf(line, sizeof(line), "done %d %d signal %d", job->jid, job->pid, WTERMSIG(status));
+    else if (WIFSTOPPED(status))
+	snprintf(line, sizeof(line), "stopped %d %d %d", job->jid, job->pid, WSTOPSIG(status));
+    else
+	return;
+
+    if (!session) {
+	if ((it = byid.find(job->owner)) != byid.end())
+	    reply(it->second, "%s", line);
+	return;
+    }
+    for (it = byfd.begin(); it != byfd.end(); ++it) {
+	if (it->second->id == job->owner || it->second->attached) {
+	    reply(it->second, "%s", line);
+	    seen |= it->second->attached;
+	}
+    }
+    if (WIFSTOPPED(status) || (t = tails.find(job->pid)) == tails.end())
+	return;
+    t->second.live = 0;
+    if (!seen)
+	t->second.done = line;
+    tailgc(t);
+}
+
+/* sendtail - Queue "tail JID LEN" and t's bytes for c */
+static void sendtail(client_t *c, const tail_t &t)
+{
+    if (t.buf.empty())
+	return;
+    reply(c, "tail %d %zu", t.jid, t.buf.size());
+    c->out += t.buf;
+}
+
+/* joblines - Queue a "JID PID STATE CMDLINE" line per job c may see */
+static void joblines(client_t *c, int tails_too)
+{
+    std::map<pid_t, tail_t>::iterator t;
+    int i;
+
+    for (i = 0; i < MAXJOBS; i++) {
+	if (jobs[i].pid != 0 && (session || jobs[i].owner == c->id)) {
+	    int len = strlen(jobs[i].cmdline);
+
+	    reply(c, "%d %d %s %.*s", jobs[i].jid, jobs[i].pid,
+		  jobs[i].state == ST ? "Stopped" : "Running",
+		  len > 0 && jobs[i].cmdline[len-1] == '\n' ? len - 1 : len, jobs[i].cmdline);
+	    if (tails_too && (t = tails.find(jobs[i].pid)) != tails.end())
+		sendtail(c, t->second);
+	}
+    }
+}
+
+/*
+ * attachcmd - "attach": the snapshot. First the jobs that ended while
+ *    no one was attached, each with its tail, then the job list with
+ *    the tails, then "ok". It all goes into c's reply buffer in one
+ *    pass over the job list, and out in as few sends as the socket
+ *    allows.
+ */
+static void attachcmd(client_t *c)
+{
+    std::map<pid_t, tail_t>::iterator t;
+
+    c->attached = 1;
+    c->out.reserve(c->out.size() + tails.size() * 128);
+    for (t = tails.begin(); t != tails.end(); ) {
+	std::map<pid_t, tail_t>::iterator cur = t++;
+
+	if (cur->second.done.empty())
+	    continue;
+	reply(c, "%s", cur->second.done.c_str());
+	sendtail(c, cur->second);
+	cur->second.done.clear();
+	tailgc(cur);
+    }
+    joblines(c, 1);
+    reply(c, "ok");
+}
+
+/* shutdowncmd - "shutdown": hang up on every job and end the session */
+static void shutdowncmd(client_t *c)
+{
+    int i;
+
+    for (i = 0; i < MAXJOBS; i++) {
+	if (jobs[i].pid != 0) {
+	    kill(-jobs[i].pid, SIGHUP);
+	    kill(-jobs[i].pid, SIGCONT);
+	}
+    }
+    reply(c, "ok");
+    flushclient(c);
+    unlink(sockpath);
+    exit(0);
+}
+
+/* ownjob - Look up "%JID" among c's jobs */
+static struct job_t *ownjob(client_t *c, const char *spec)
+{
+    struct job_t *job;
+
+    if (spec == NULL || spec[0] != '%' || !isdigit(spec[1]))
+	return NULL;
+    job = getjobjid(jobs, atoi(spec + 1));
+    return job != NULL && (session || job->owner == c->id) ? job : NULL;
+}
+
+/* runcmd - "run [-o] CMDLINE" */
+static void runcmd(client_t *c, char *rest)
+{
+    char cmdline[MAXLINE];
+    char *argv[MAXARGS];
+    int capture = 0, forward = 0, p[2] = { -1, -1 };
+    pid_t pid;
+    struct job_t *job;
+
+    if (!strncmp(rest, "-o ", 3)) {
+	capture = forward = 1;
+	rest += 3;
+    }
+    capture |= session;     /* a session keeps every job's tail */
+    if (strlen(rest) + 2 > MAXLINE) {
+	reply(c, "error command too long");
+	return;
+    }
+    snprintf(cmdline, sizeof(cmdline), "%s\n", rest);
+    parseline(cmdline, argv);
+    if (argv[0] == NULL) {
+	reply(c, "error empty command");
+	return;
+    }
+
+    if (capture && pipe2(p, O_CLOEXEC) < 0) {
+	reply(c, "error pipe: %s", strerror(errno));
+	return;
+    }
+    pid = spawnjob(argv, cmdline, BG, p[1]);
+    if (capture)
+	close(p[1]);
+    if (pid == 0 || (job = getjobpid(jobs, pid)) == NULL) {
+	if (capture)
+	    close(p[0]);
+	reply(c, "error cannot start job");
+	return;
+    }
+    job->owner = c->id;
+    reply(c, "job %d %d", job->jid, pid);
+
+    if (capture) {
+	fcntl(p[0], F_SETFL, O_NONBLOCK);
+	pipes[p[0]] = capture_t{ forward ? c->id : 0, job->jid, pid };
+	watch(p[0], EPOLLIN, EPOLL_CTL_ADD);
+    }
+    if (session) {
+	tail_t &t = tails[pid];
+
+	t.jid = job->jid;
+	t.open = t.live = 1;
+	t.buf.clear();
+	t.done.clear();
+    }
+}
+
+/* request - Carry out one request line from c */
+static void request(client_t *c, char *line)
+{
+    char *cmd = line, *arg;
+    struct job_t *job;
+    int sig;
+
+    if ((arg = strchr(line, ' ')) != NULL)
+	*arg++ = '\0';
+
+    if (!strcmp(cmd, "run") && arg != NULL) {
+	runcmd(c, arg);
+    }
+    else if (!strcmp(cmd, "jobs")) {
+	joblines(c, 0);
+	reply(c, "ok");
+    }
+    else if (session && !strcmp(cmd, "attach")) {
+	attachcmd(c);
+    }
+    else if (session && !strcmp(cmd, "shutdown")) {
+	shutdowncmd(c);
+    }
+    else if (!strcmp(cmd, "kill") || !strcmp(cmd, "stop") || !strcmp(cmd, "bg")) {
+	char *spec = arg != NULL ? strtok(arg, " ") : NULL;
+	char *signame = strtok(NULL, " ");
+
+	if ((job = ownjob(c, spec)) == NULL) {
+	    reply(c, "error %s: no such job", spec ? spec : "");
+	    return;
+	}
+	if (!strcmp(cmd, "stop"))
+	    sig = SIGTSTP;
+	else if (!strcmp(cmd, "bg"))
+	    sig = SIGCONT;
+	else if (signame == NULL)
+	    sig = SIGTERM;
+	else if ((sig = signum(signame[0] == '-' ? signame + 1 : signame)) <= 0) {
+	    reply(c, "error kill: %s: bad signal", signame);
+	    return;
+	}
+	if (kill(-job->pid, sig) < 0) {
+	    reply(c, "error kill: %s", strerror(errno));
+	    return;
+	}
+	if (sig == SIGCONT)
+	    job->state = BG;
+	reply(c, "ok");
+    }
+    else {
+	reply(c, "error unknown request");
+    }
+}
+
+/* readclient - Read from c and handle every complete request line */
+static void readclient(client_t *c)
+{
+    char buf[READSIZE];
+    size_t start = 0, nl;
+    ssize_t n;
+    int eof = 0;
+
+    for (;;) {
+	n = read(c->fd, buf, sizeof(buf));
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	    break;
+	if (n <= 0) {
+	    eof = 1;
+	    break;
+	}
+	c->in.append(buf, n);
+    }
+
+    while ((nl = c->in.find('\n', start)) != std::string::npos) {
+	c->in[nl] = '\0';
+	if (nl > start && c->in[nl-1] == '\r')
+	    c->in[nl-1] = '\0';
+	request(c, &c->in[start]);
+	start = nl + 1;
+    }
+    c->in.erase(0, start);
+    if (c->in.size() > MAXLINE) {
+	reply(c, "error request too long");
+	c->in.clear();
+    }
+    if (eof)
+	dropclient(c);
+    else
+	flushclient(c);
+}
+
+/*
+ * forward1 - Send c a job's output, or with n < 0 its end. A client
+ *    that has stopped reading is disconnected once CLIENT_OUTMAX bytes
+ *    are waiting for it, rather than buffered for without limit (a
+ *    session job carries on, and its tail is still kept).
+ */
+static void forward1(client_t *c, const capture_t &cap, const char *buf, ssize_t n)
+{
+    if (n < 0) {
+	reply(c, "eof %d", cap.jid);
+    } else {
+	reply(c, "out %d %zd", cap.jid, n);
+	c->out.append(buf, n);
+    }
+    if (c->out.size() > CLIENT_OUTMAX)
+	dropclient(c);
+}
+
+/* forward - ... to the job's owner if it asked, and attached clients */
+static void forward(const capture_t &cap, const char *buf, ssize_t n)
+{
+    std::map<int, client_t *>::iterator it;
+
+    if (!session) {
+	if ((it = byid.find(cap.client)) != byid.end())
+	    forward1(it->second, cap, buf, n);
+	return;
+    }
+    for (it = byfd.begin(); it != byfd.end(); ) {
+	client_t *c = (it++)->second;   /* forward1 may drop it */
+
+	if (c->id == cap.client || c->attached)
+	    forward1(c, cap, buf, n);
+    }
+}
+
+/*
+ * readpipe - Forward output of a "run -o" job to its owner. A session
+ *    job's goes to the attached clients, and its last SESS_TAIL bytes
+ *    are kept for the ones that attach later.
+ */
+static void readpipe(int fd)
+{
+    char buf[READSIZE];
+    capture_t cap = pipes[fd];
+    std::map<pid_t, tail_t>::iterator t = tails.find(cap.pid);
+    ssize_t n;
+
+    while ((n = read(fd, buf, sizeof(buf))) != 0) {
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    if (errno == EAGAIN || errno == EWOULDBLOCK)
+		return;
+	    break;
+	}
+	forward(cap, buf, n);
+	if (t != tails.end()) {
+	    std::string &tb = t->second.buf;
+
+	    if (n >= SESS_TAIL)
+		tb.assign(buf + n - SESS_TAIL, SESS_TAIL);
+	    else {
+		if (tb.size() + n > SESS_TAIL)
+		    tb.erase(0, tb.size() + n - SESS_TAIL);
+		tb.append(buf, n);
+	    }
+	}
+    }
+
+    /* EOF (or error): the job has closed its output */
+    forward(cap, NULL, -1);
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+    close(fd);
+    pipes.erase(fd);
+    if (t != tails.end()) {
+	t->second.open = 0;
+	tailgc(t);
+    }
+}
+
+/* acceptclients - Accept every pending connection */
+static void acceptclients(void)
+{
+    int fd;
+
+    while ((fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+	client_t *c = new client_t;
+
+	c->fd = fd;
+	c->id = nextclient++;
+	c->armed = 0;
+	c->attached = 0;
+	byfd[fd] = c;
+	byid[c->id] = c;
+	watch(fd, EPOLLIN, EPOLL_CTL_ADD);
+    }
+}
+
+/*
+ * daemonize - Carry on as a session daemon: the parent reports our pid
+ *    and exits, we leave the terminal's session and let go of stdio.
+ */
+static void daemonize(const char *path)
+{
+    pid_t pid;
+    int fd;
+
+    fflush(stdout);
+    if ((pid = fork()) < 0)
+	unix_error("fork error");
+    if (pid > 0) {
+	printf("tsh: session %s (pid %d)\n", path, pid);
+	exit(0);
+    }
+    setsid();
+    treeinit();             /* not inherited across fork */
+    if ((fd = open("/dev/null", O_RDWR)) >= 0) {
+	dup2(fd, STDIN_FILENO);
+	dup2(fd, STDOUT_FILENO);
+	dup2(fd, STDERR_FILENO);
+	if (fd > STDERR_FILENO)
+	    close(fd);
+    }
+}
+
+/*
+ * serve - Run the job server on path until killed. The job signals
+ *    stay blocked except inside epoll_pwait, so SIGCHLD wakes the
+ *    loop exactly like it wakes waitfg. With sess it detaches from
+ *    the terminal first and keeps jobs and their output tails for
+ *    clients to attach to.
+ */
+void serve(const char *path, int sess)
+{
+    struct sockaddr_un addr;
+    struct epoll_event evs[MAXEVENTS];
+    sigset_t prev;
+    int i, n;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+	app_error("serve: socket path too long");
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    if ((lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+	unix_error("socket error");
+    if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	unix_error("bind error");
+    if (listen(lfd, SOMAXCONN) < 0)
+	unix_error("listen error");
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+	unix_error("epoll_create1 error");
+    watch(lfd, EPOLLIN, EPOLL_CTL_ADD);
+
+    session = sess;
+    sockpath = path;
+    if (session)
+	daemonize(path);
+    jobhook = serverhook;
+    blockjobsigs(&prev);
+
+    for (;;) {
+	n = epoll_pwait(epfd, evs, MAXEVENTS, -1, &prev);
+	if (n < 0 && errno != EINTR)
+	    unix_error("epoll_pwait error");
+
+	for (i = 0; i < n; i++) {
+	    int fd = evs[i].data.fd;
+	    std::map<int, client_t *>::iterator it;
+
+	    if (fd == lfd) {
+		acceptclients();
+	    }
+	    else if ((it = byfd.find(fd)) != byfd.end()) {
+		if (evs[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+		    readclient(it->second);
+		else
+		    flushclient(it->second);
+	    }
+	    else if (pipes.count(fd)) {
+		readpipe(fd);
+	    }
+	}
+
+	/* Job state changes queue replies through serverhook */
+	drainevents();
+	for (std::map<int, client_t *>::iterator it = byfd.begin(); it != byfd.end(); ) {
+	    client_t *c = (it++)->second;
+
+	    if (!c->out.empty())
+		flushclient(c);
+	}
+    }
+}
+/***************
+ * end server
+ ***************/
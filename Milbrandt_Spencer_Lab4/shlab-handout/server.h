@@ -0,0 +1,41 @@
+//-*-c++-*-
+#ifndef _server_h_
+#define _server_h_
+
+/*
+ * tsh -S PATH - serve jobs to local clients over a Unix-domain socket.
+ *
+ * Requests and replies are single text lines. Each client only sees
+ * and addresses the jobs it submitted.
+ *
+ *   run [-o] CMDLINE   start CMDLINE as a background job
+ *                      -> "job JID PID"
+ *                      later "done JID PID exit N", "done JID PID signal N"
+ *                      or "stopped JID PID SIG" as the job changes state.
+ *                      With -o the job's stdout/stderr are streamed back
+ *                      as "out JID LEN" followed by LEN raw bytes, and
+ *                      "eof JID" once the job has closed them.
+ *   jobs               -> "JID PID STATE CMDLINE" per job, then "ok"
+ *   kill %JID [SIG]    send SIG, a number or name (default TERM) -> "ok"
+ *   stop %JID          send SIGTSTP -> "ok"
+ *   bg %JID            continue a stopped job -> "ok"
+ *
+ * Errors are reported as "error MESSAGE". Jobs of a client that
+ * disconnects are sent SIGHUP.
+ *
+ * tsh -D PATH runs the same server as a session daemon (see session.h):
+ * it leaves the terminal, its jobs outlive the clients that started
+ * them, and any client can address any of them. Every job's output is
+ * captured and its last SESS_TAIL bytes kept. Two more requests:
+ *
+ *   attach             -> for each job that ended with no client
+ *                      attached, its "done" line; then the "jobs"
+ *                      lines; each followed by "tail JID LEN" and LEN
+ *                      bytes if the job has output; then "ok". From
+ *                      then on the client gets every job's "done",
+ *                      "stopped", "out" and "eof" messages.
+ *   shutdown           hang up on every job and exit -> "ok"
+ */
+void serve(const char *path, int sess);
+
+#endif
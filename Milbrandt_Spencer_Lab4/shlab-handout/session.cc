@@ -0,0 +1,237 @@
+#include "session.h"
+#include "globals.h"
+#include "helper-routines.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <deque>
+#include <string>
+
+/**********************************
+ * Session client (tsh -A)
+ **********************************/
+
+#define READSIZE 65536
+
+static char prompt[] = "tsh> ";
+
+static int sfd;                         /* the session's socket */
+static int showprompt;
+static int snapshot = 1;                /* still reading the attach reply */
+static int njobs;                       /* jobs in the snapshot */
+static size_t nbytes;                   /* bytes in the snapshot */
+static long long t0;                    /* when attach was sent */
+static std::deque<std::string> waiting; /* requests not answered yet: the
+                                           command line of a run, else "" */
+
+/* sendline - Send one request line to the session; cmd is for a run */
+static void sendline(const std::string &line, const std::string &cmd)
+{
+    std::string req = line + "\n";
+    size_t off = 0;
+    ssize_t n;
+
+    while (off < req.size()) {
+	if ((n = send(sfd, req.data() + off, req.size() - off, MSG_NOSIGNAL)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    unix_error("session send error");
+	}
+	off += n;
+    }
+    waiting.push_back(cmd);
+}
+
+/* answered - A request got its last reply line; prompt once all have */
+static void answered(void)
+{
+    if (!waiting.empty())
+	waiting.pop_front();
+    if (waiting.empty() && showprompt) {
+	printf("%s", prompt);
+	fflush(stdout);
+    }
+}
+
+/*
+ * message - Print the message at the front of buf, which holds len
+ *    bytes from the session. Returns the bytes it took up, 0 if the
+ *    message isn't all there yet.
+ */
+static size_t message(const char *buf, size_t len)
+{
+    const char *nl = (const char *)memchr(buf, '\n', len);
+    char line[MAXLINE + 64];
+    int jid, pid, n;
+    size_t used, size;
+
+    if (nl == NULL)
+	return 0;
+    used = nl - buf + 1;
+    snprintf(line, sizeof(line), "%.*s", (int)(nl - buf), buf);
+    if (snapshot)
+	nbytes += used;
+
+    if (sscanf(line, "out %d %zu", &jid, &size) == 2 ||
+	sscanf(line, "tail %d %zu", &jid, &size) == 2) {
+	if (len - used < size)
+	    return 0;
+	fwrite(buf + used, 1, size, stdout);
+	if (line[0] == 't' && size > 0 && buf[used + size - 1] != '\n')
+	    printf("\n");
+	if (snapshot)
+	    nbytes += size;
+	return used + size;
+    }
+    if (sscanf(line, "done %d %d exit %d", &jid, &pid, &n) == 3)
+	printf("Job [%d] (%d) exited with status %d\n", jid, pid, n);
+    else if (sscanf(line, "done %d %d signal %d", &jid, &pid, &n) == 3)
+	printf("Job [%d] (%d) terminated by signal %d\n", jid, pid, n);
+    else if (sscanf(line, "stopped %d %d %d", &jid, &pid, &n) == 3)
+	printf("Job [%d] (%d) stopped by signal %d\n", jid, pid, n);
+    else if (sscanf(line, "job %d %d", &jid, &pid) == 2) {
+	printf("[%d] (%d) %s", jid, pid, waiting.empty() ? "\n" : waiting.front().c_str());
+	answered();
+    }
+    else if (isdigit(line[0])) {        /* JID PID STATE CMDLINE */
+	char *pidp = strchr(line, ' '), *state = pidp ? strchr(pidp + 1, ' ') : NULL;
+
+	if (state != NULL) {
+	    *pidp++ = *state++ = '\0';
+	    printf("[%s] (%s) %s\n", line, pidp, state);
+	    njobs += snapshot;
+	}
+    }
+    else if (!strncmp(line, "error ", 6)) {
+	printf("%s\n", line + 6);
+	answered();
+    }
+    else if (!strcmp(line, "ok")) {
+	if (snapshot) {
+	    snapshot = 0;
+	    if (verbose)
+		printf("attach: %d jobs, %zu bytes in %.3f ms\n", njobs, nbytes,
+		       (nowns() - t0) / 1e6);
+	}
+	answered();
+    }
+    /* eof JID: nothing to print */
+    return used;
+}
+
+/*
+ * command - One line typed at the client. detach and quit end it;
+ *    requests the session knows go as they are; anything else is a
+ *    command line to run in the background ("&" or not).
+ */
+static void command(char *line)
+{
+    static const char *requests[] = { "jobs", "kill", "stop", "bg", "shutdown", NULL };
+    char word[16];
+    size_t len = strlen(line);
+    int i;
+
+    while (len > 0 && (isspace(line[len-1]) || line[len-1] == '&'))
+	line[--len] = '\0';
+    while (isspace(*line))
+	line++;
+    if (sscanf(line, "%15s", word) != 1) {
+	if (waiting.empty() && showprompt)
+	    printf("%s", prompt);
+	return;
+    }
+    if (!strcmp(word, "detach") || !strcmp(word, "quit"))
+	exit(0);
+    for (i = 0; requests[i] != NULL; i++)
+	if (!strcmp(word, requests[i]))
+	    break;
+    if (requests[i] != NULL) {
+	sendline(line, "");
+	return;
+    }
+    sendline(std::string("run ") + line, std::string(line) + "\n");
+}
+
+/*
+ * attach - Attach to the session on path and relay between it and the
+ *    user until they detach. At end of input the client waits for the
+ *    answers to what it sent, so a script can be piped in.
+ */
+void attach(const char *path, int emit_prompt)
+{
+    struct sockaddr_un addr;
+    struct pollfd pfd[2];
+    std::string in, typed;
+    char buf[READSIZE];
+    size_t used, nl;
+    ssize_t n;
+    int eof = 0;
+
+    showprompt = emit_prompt;
+    if (strlen(path) >= sizeof(addr.sun_path))
+	app_error("attach: socket path too long");
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if ((sfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+	unix_error("socket error");
+    if (connect(sfd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	unix_error(path);
+
+    t0 = nowns();
+    sendline("attach", "");
+    pfd[0].fd = sfd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = STDIN_FILENO;
+    pfd[1].events = POLLIN;
+
+    for (;;) {
+	fflush(stdout);
+	if (eof && waiting.empty())
+	    exit(0);
+	if (poll(pfd, eof ? 1 : 2, -1) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    unix_error("poll error");
+	}
+
+	if (pfd[0].revents) {
+	    if ((n = read(sfd, buf, sizeof(buf))) <= 0) {
+		printf("tsh: session closed\n");
+		exit(0);
+	    }
+	    in.append(buf, n);
+	    for (used = 0; used < in.size(); ) {
+		size_t m = message(in.data() + used, in.size() - used);
+
+		if (m == 0)
+		    break;
+		used += m;
+	    }
+	    in.erase(0, used);
+	}
+
+	if (!eof && pfd[1].revents) {
+	    if ((n = read(STDIN_FILENO, buf, sizeof(buf))) <= 0) {
+		eof = 1;
+		continue;
+	    }
+	    typed.append(buf, n);
+	    while ((nl = typed.find('\n')) != std::string::npos) {
+		std::string line = typed.substr(0, nl);
+
+		typed.erase(0, nl + 1);
+		command(&line[0]);
+	    }
+	}
+    }
+}
+/**********************************
+ * end session client
+ **********************************/
@@ -0,0 +1,23 @@
+//-*-c++-*-
+#ifndef _session_h_
+#define _session_h_
+
+/*
+ * Detachable sessions. tsh -D PATH starts a session daemon: a tsh job
+ * server (see server.h) that leaves the terminal, so its jobs and
+ * their output survive the terminal, the shell the user typed into
+ * and any client going away.
+ *
+ * tsh -A PATH attaches to it. The client prints the snapshot the
+ * daemon sends - jobs that ended while no one was attached, then the
+ * job list, each job with the tail of its output - and then works
+ * like a prompt: command lines start background jobs in the session,
+ * jobs, kill, stop and bg go to the daemon, and the session's notices
+ * and job output are printed as they come. detach, quit or end of
+ * input detaches and leaves everything running; shutdown ends the
+ * session and its jobs. With -v it reports how long the attach took.
+ */
+
+void attach(const char *path, int emit_prompt);
+
+#endif
@@ -0,0 +1,98 @@
+#include "stats.h"
+#include <stdio.h>
+#include <string.h>
+
+/***************************************
+ * Latency histograms for the stats builtin
+ ***************************************/
+
+int stats_on = 0;   /* instrumentation enabled (-s or "stats on") */
+
+struct hist_t {
+    unsigned long long count;
+    long long max;
+    unsigned long long bucket[HIST_BUCKETS];
+};
+
+static struct hist_t hists[NSEGS];
+static const char *segname[NSEGS] = { "parse", "spawn", "exec", "run", "reap", "wake" };
+
+/* bucketof - Map a latency in ns to its histogram bucket */
+static int bucketof(unsigned long long v)
+{
+    int e;
+
+    if (v < HIST_SUB)
+	return (int)v;
+    e = 63 - __builtin_clzll(v);   /* position of the top bit */
+    return (e - HIST_SUBBITS + 1) * HIST_SUB + (int)((v >> (e - HIST_SUBBITS)) & (HIST_SUB - 1));
+}
+
+/* bucketmax - Largest value that falls in bucket b */
+static unsigned long long bucketmax(int b)
+{
+    int e;
+
+    if (b < HIST_SUB)
+	return b;
+    e = b / HIST_SUB + HIST_SUBBITS - 1;
+    return ((unsigned long long)(HIST_SUB + b % HIST_SUB + 1) << (e - HIST_SUBBITS)) - 1;
+}
+
+/* statrecord - Add one sample to segment seg */
+void statrecord(int seg, long long ns)
+{
+    struct hist_t *h = &hists[seg];
+
+    if (ns < 0)
+	ns = 0;
+    h->count++;
+    h->bucket[bucketof(ns)]++;
+    if (ns > h->max)
+	h->max = ns;
+}
+
+/* statreset - Clear every histogram */
+void statreset(void)
+{
+    memset(hists, 0, sizeof(hists));
+}
+
+/* percentile - Upper bound of the bucket holding the p-th percentile */
+static long long percentile(struct hist_t *h, double p)
+{
+    unsigned long long want = (unsigned long long)(h->count * p + 0.5);
+    unsigned long long seen = 0;
+    int b;
+
+    if (want == 0)
+	want = 1;
+    for (b = 0; b < HIST_BUCKETS; b++) {
+	seen += h->bucket[b];
+	if (seen >= want)
+	    return (long long)bucketmax(b) < h->max ? (long long)bucketmax(b) : h->max;
+    }
+    return h->max;
+}
+
+/* statprint - Print p50/p90/p99/max per segment, in microseconds */
+void statprint(void)
+{
+    int i;
+
+    printf("%-6s %10s %10s %10s %10s %10s\n", "seg", "count", "p50(us)", "p90(us)", "p99(us)", "max(us)");
+    for (i = 0; i < NSEGS; i++) {
+	struct hist_t *h = &hists[i];
+
+	if (h->count == 0) {
+	    printf("%-6s %10d %10s %10s %10s %10s\n", segname[i], 0, "-", "-", "-", "-");
+	    continue;
+	}
+	printf("%-6s %10llu %10.1f %10.1f %10.1f %10.1f\n", segname[i], h->count,
+	       percentile(h, 0.50) / 1e3, percentile(h, 0.90) / 1e3,
+	       percentile(h, 0.99) / 1e3, h->max / 1e3);
+    }
+}
+/*******************
+ * end stats builtin
+ *******************/
@@ -0,0 +1,41 @@
+//-*-c++-*-
+#ifndef _stats_h_
+#define _stats_h_
+
+/*
+ * Job lifecycle latency segments. Each is the time between two
+ * consecutive instrumentation points:
+ *     parse : eval() parse start -> parse end
+ *     spawn : parse end -> fork returns in the parent
+ *     exec  : fork return -> exec succeeded in the child
+ *     run   : exec -> first SIGCHLD for the job
+ *     reap  : SIGCHLD (handler timestamp) -> job list updated
+ *     wake  : job list updated -> waitfg returns
+ */
+#define SEG_PARSE 0
+#define SEG_SPAWN 1
+#define SEG_EXEC  2
+#define SEG_RUN   3
+#define SEG_REAP  4
+#define SEG_WAKE  5
+#define NSEGS     6
+
+/*
+ * Log-linear (HDR-style) buckets: values below 2^HIST_SUBBITS ns get
+ * a bucket each, every power of two above that is split into
+ * 2^HIST_SUBBITS equal buckets (about 3% relative error).
+ */
+#define HIST_SUBBITS  5
+#define HIST_SUB      (1 << HIST_SUBBITS)
+#define HIST_BUCKETS  ((64 - HIST_SUBBITS + 1) * HIST_SUB)
+
+extern int stats_on;
+
+/* One predictable branch when instrumentation is off */
+#define STATS_ON (__builtin_expect(stats_on, 0))
+
+void statrecord(int seg, long long ns);
+void statreset(void);
+void statprint(void);
+
+#endif
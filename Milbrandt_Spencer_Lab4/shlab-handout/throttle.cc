@@ -0,0 +1,227 @@
+#include "throttle.h"
+#include "events.h"
+#include "jobs.h"
+#include "helper-routines.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/timerfd.h>
+#include <vector>
+
+#define SLACK 200000LL      /* ns: stops this close to due are done early */
+
+/************************************
+ * CPU throttling
+ ************************************/
+
+struct throttle_t {         /* One throttled job */
+    struct job_t *job;      /* its slot; still ours while job->pid == pid */
+    pid_t pid;
+    int pct;                /* share of each period it may run */
+    int paused;             /* we stopped it and haven't continued it */
+    long long cpu0;         /* its CPU time when throttling began, ns */
+    long long t0;           /* and when that was, ns */
+};
+
+static std::vector<throttle_t> thr;     /* sorted by pct */
+static int tfd = -1;
+static long long period = THROTTLE_PERIOD * 1000000LL;
+static long long pstart;                /* start of the current period, ns */
+static size_t nextstop;                 /* thr[nextstop] is the next to stop */
+
+/*
+ * cpuns - CPU time pid has had so far, in ns. schedstat counts it
+ *    exactly; the tick-sampled utime in stat can be far off for a job
+ *    whose running slices are in step with the timer tick.
+ */
+static long long cpuns(pid_t pid)
+{
+    char path[64];
+    long long ns = 0;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "/proc/%d/schedstat", pid);
+    if ((fp = fopen(path, "r")) == NULL)
+	return 0;
+    if (fscanf(fp, "%lld", &ns) != 1)
+	ns = 0;
+    fclose(fp);
+    return ns;
+}
+
+/* alive - True if t's job still exists */
+static int alive(struct throttle_t *t)
+{
+    return t->job->pid == t->pid;
+}
+
+/* arm - Set the timer for the next stop, or the end of the period */
+static void arm(void)
+{
+    struct itimerspec its;
+    long long at = pstart + period;
+
+    if (nextstop < thr.size())
+	at = pstart + period * thr[nextstop].pct / 100;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = at / 1000000000LL;
+    its.it_value.tv_nsec = at % 1000000000LL;
+    timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/* resume - Continue t's job if we are what's holding it */
+static void resume(struct throttle_t *t)
+{
+    if (t->paused && alive(t) && t->job->state != ST)
+	kill(-t->pid, SIGCONT);
+    t->paused = 0;
+}
+
+/* tick - The timer fired: start a new period and/or stop jobs whose share is used up */
+static void tick(int fd, void *arg)
+{
+    unsigned long long n;
+    long long now = nowns();
+    size_t i, k;
+
+    read(fd, &n, sizeof(n));
+    if (now >= pstart + period) {
+	/* Drop jobs that are gone, continue the rest */
+	for (i = k = 0; i < thr.size(); i++) {
+	    if (!alive(&thr[i]))
+		continue;
+	    resume(&thr[i]);
+	    thr[k++] = thr[i];
+	}
+	thr.resize(k);
+	if (thr.empty()) {
+	    unwatchfd(tfd);
+	    close(tfd);
+	    tfd = -1;
+	    return;
+	}
+	pstart = now - (now - pstart) % period;
+	nextstop = 0;
+    }
+    for (; nextstop < thr.size(); nextstop++) {
+	struct throttle_t *t = &thr[nextstop];
+
+	if (pstart + period * t->pct / 100 > now + SLACK)
+	    break;
+	if (alive(t) && t->job->state != ST && !t->paused) {
+	    kill(-t->pid, SIGSTOP);
+	    t->paused = 1;
+	}
+    }
+    arm();
+}
+
+/*
+ * throttlejob - Cap job at pct percent of the CPU; 100 lifts the cap.
+ *    Returns 0 if the timer couldn't be set up.
+ */
+int throttlejob(struct job_t *job, int pct)
+{
+    struct throttle_t t;
+    size_t i;
+
+    for (i = 0; i < thr.size(); i++) {
+	if (thr[i].pid != job->pid || !alive(&thr[i]))
+	    continue;
+	resume(&thr[i]);
+	thr.erase(thr.begin() + i);
+	if (nextstop > i)
+	    nextstop--;
+	break;
+    }
+    if (pct >= 100)
+	return 1;
+
+    if (tfd < 0) {
+	if ((tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+	    return 0;
+	if (!watchfd(tfd, tick, NULL)) {
+	    close(tfd);
+	    tfd = -1;
+	    return 0;
+	}
+	pstart = nowns();
+	nextstop = 0;
+    }
+    t.job = job;
+    t.pid = job->pid;
+    t.pct = pct;
+    t.paused = 0;
+    t.cpu0 = cpuns(job->pid);
+    t.t0 = nowns();
+    for (i = 0; i < thr.size() && thr[i].pct <= pct; i++)
+	;
+    thr.insert(thr.begin() + i, t);
+    if (i < nextstop)           /* its stop this period is already past */
+	nextstop++;
+    arm();
+    return 1;
+}
+
+/*
+ * throttlestop - childevent saw job stop with sig. Returns 1 if it is
+ *    one of the throttler's own stops, which don't change the job's state.
+ */
+int throttlestop(struct job_t *job, int sig)
+{
+    size_t i;
+
+    if (sig != SIGSTOP)
+	return 0;
+    for (i = 0; i < thr.size(); i++)
+	if (thr[i].pid == job->pid && alive(&thr[i]))
+	    return 1;
+    return 0;
+}
+
+/*
+ * throttlewake - A signal is about to go to the group led by pid. If the
+ *    throttler is holding it, continue it first: the SIGCONT of the
+ *    next period would throw away a pending SIGTSTP, and anything else
+ *    would only be acted on then.
+ */
+void throttlewake(pid_t pid)
+{
+    size_t i;
+
+    for (i = 0; i < thr.size(); i++)
+	if (thr[i].pid == pid && alive(&thr[i]) && thr[i].paused) {
+	    kill(-pid, SIGCONT);
+	    thr[i].paused = 0;
+	}
+}
+
+/* throttleperiod - Change the period; returns 0 if ms is out of range */
+int throttleperiod(int ms)
+{
+    if (ms < 1 || ms > 10000)
+	return 0;
+    period = ms * 1000000LL;
+    return 1;
+}
+
+/* throttleshow - List throttled jobs with the CPU share they actually got */
+void throttleshow(void)
+{
+    size_t i;
+
+    printf("throttle: period %lld ms\n", period / 1000000);
+    for (i = 0; i < thr.size(); i++) {
+	struct throttle_t *t = &thr[i];
+	long long ns = nowns() - t->t0;
+
+	if (!alive(t))
+	    continue;
+	printf("[%d] (%d) %d%%, used %.1f%% %s", t->job->jid, t->pid, t->pct,
+	       ns > 0 ? 100.0 * (cpuns(t->pid) - t->cpu0) / ns : 0.0, t->job->cmdline);
+    }
+}
+/************************************
+ * end CPU throttling
+ ************************************/
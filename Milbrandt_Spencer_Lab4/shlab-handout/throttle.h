@@ -0,0 +1,35 @@
+//-*-c++-*-
+#ifndef _throttle_h_
+#define _throttle_h_
+
+#include <sys/types.h> // needed for pid_t
+
+/*
+ * CPU throttling of jobs (the throttle builtin). A throttled job's
+ * process group runs for PCT percent of every period and is held with
+ * SIGSTOP for the rest. All throttled jobs share one timerfd, watched
+ * like any other descriptor, and one period: every job is continued
+ * at the start of a period and stopped when its share is used up, so
+ * a period costs one wakeup per distinct share however many jobs
+ * there are.
+ *
+ * The throttler only ever stops with SIGSTOP, so a stop by any other
+ * signal (ctrl-z's SIGTSTP, SIGTTIN, ...) is a real one: the job goes
+ * to ST as usual and the throttler leaves it alone until bg or fg has
+ * it running again. SIGSTOP stops of a throttled job are all taken to
+ * be the throttler's; use ctrl-z or kill -TSTP to stop one for good.
+ * Signals the shell forwards to a held job continue it first, so
+ * ctrl-z and ctrl-c take effect at once.
+ */
+
+#define THROTTLE_PERIOD 20  /* default period, in ms */
+
+struct job_t;
+
+int throttlejob(struct job_t *job, int pct);
+int throttlestop(struct job_t *job, int sig);
+void throttlewake(pid_t pid);
+int throttleperiod(int ms);
+void throttleshow(void);
+
+#endif
@@ -0,0 +1,180 @@
+#include "tree.h"
+#include "jobs.h"
+#include "helper-routines.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/************************************
+ * Descendant tracking
+ ************************************/
+
+/* addproc - procscan: keep ps */
+static void addproc(const struct procstat_t *ps, void *arg)
+{
+    std::vector<procstat_t> *procs = (std::vector<procstat_t> *)arg;
+
+    procs->push_back(*ps);
+    procs->back().tail = NULL;
+}
+
+/* readprocs - Every process on the system, in one pass over /proc */
+static void readprocs(std::vector<procstat_t> &procs)
+{
+    procs.clear();
+    procscan(addproc, &procs);
+}
+
+/*
+ * members - Mark the processes of job's tree: its process group and
+ *    everything descended from it, whatever group that is in now
+ */
+static void members(const std::vector<procstat_t> &procs, pid_t pgid, std::vector<char> &in)
+{
+    size_t i;
+    int grew = 1;
+
+    in.assign(procs.size(), 0);
+    for (i = 0; i < procs.size(); i++)
+	in[i] = procs[i].pgrp == pgid;
+    while (grew) {
+	grew = 0;
+	for (i = 0; i < procs.size(); i++) {
+	    size_t j;
+
+	    if (in[i])
+		continue;
+	    for (j = 0; j < procs.size(); j++)
+		if (in[j] && procs[j].pid == procs[i].ppid)
+		    break;
+	    if (j < procs.size())
+		in[i] = grew = 1;
+	}
+    }
+}
+
+/* printtree - Print procs[i] and, indented below it, its children in the tree */
+static void printtree(const std::vector<procstat_t> &procs, const std::vector<char> &in,
+		      size_t i, int depth)
+{
+    size_t j;
+
+    printf("    %*s%d %c %s\n", 2 * depth, "", procs[i].pid, procs[i].state, procs[i].comm);
+    for (j = 0; j < procs.size(); j++)
+	if (in[j] && procs[j].ppid == procs[i].pid)
+	    printtree(procs, in, j, depth + 1);
+}
+
+/* treeinit - Have orphaned descendants of our jobs re-parented to us */
+void treeinit(void)
+{
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+}
+
+/* treealive - True if anything, zombies included, is left in group pgid */
+int treealive(pid_t pgid)
+{
+    return kill(-pgid, 0) == 0 || errno == EPERM;
+}
+
+/*
+ * treekill - Send sig to the process groups of the n jobs in sel, and
+ *    to their descendants that have left for a group of their own. The
+ *    tree is read once, before anything is signalled, while everyone
+ *    still has the parent that ties them to their job. Each process
+ *    walks up its ancestors only until it meets one whose answer is
+ *    already known, so the whole pass is linear in the process count.
+ */
+void treekill(struct job_t **sel, int n, int sig)
+{
+    std::vector<procstat_t> procs;
+    std::unordered_map<pid_t, size_t> byid;
+    std::unordered_set<pid_t> groups;
+    std::vector<signed char> stray;     /* -1 unknown, 0 no, 1 in a tree */
+    std::vector<size_t> path;
+    size_t i, j;
+    int k, ans;
+
+    readprocs(procs);
+    for (k = 0; k < n; k++)
+	groups.insert(sel[k]->pid);
+    for (i = 0; i < procs.size(); i++)
+	byid[procs[i].pid] = i;
+    stray.assign(procs.size(), -1);
+    for (i = 0; i < procs.size(); i++) {
+	path.clear();
+	for (j = i; ; ) {
+	    std::unordered_map<pid_t, size_t>::iterator up;
+
+	    if (stray[j] >= 0) {
+		ans = stray[j];
+		break;
+	    }
+	    path.push_back(j);
+	    if (groups.count(procs[j].pgrp)) {
+		ans = 1;
+		break;
+	    }
+	    if ((up = byid.find(procs[j].ppid)) == byid.end()) {
+		ans = 0;
+		break;
+	    }
+	    j = up->second;
+	}
+	for (j = 0; j < path.size(); j++)
+	    stray[path[j]] = ans;
+    }
+
+    for (k = 0; k < n; k++)
+	kill(-sel[k]->pid, sig);
+    for (i = 0; i < procs.size(); i++)
+	if (stray[i] == 1 && !groups.count(procs[i].pgrp))
+	    kill(procs[i].pid, sig);
+}
+
+/* treeshow - jobs -t: the job list with each job's process tree */
+void treeshow(struct job_t *jobs)
+{
+    static const char *states[] = { "?", "Foreground", "Running", "Stopped" };
+    std::vector<procstat_t> procs;
+    std::vector<char> in;
+    size_t i, j;
+    int k;
+
+    readprocs(procs);
+    for (k = 0; k < MAXJOBS; k++) {
+	struct job_t *job = &jobs[k];
+
+	if (job->pid == 0)
+	    continue;
+	printf("[%d] (%d) %s %s", job->jid, job->pid, states[job->state & 3], job->cmdline);
+	if (job->status != -1) {
+	    if (WIFSIGNALED(job->status))
+		printf("    %d killed by signal %d\n", job->pid, WTERMSIG(job->status));
+	    else
+		printf("    %d exited %d\n", job->pid, WEXITSTATUS(job->status));
+	}
+	members(procs, job->pid, in);
+	for (i = 0; i < procs.size(); i++) {
+	    if (!in[i])
+		continue;
+	    for (j = 0; j < procs.size(); j++)
+		if (in[j] && procs[j].pid == procs[i].ppid)
+		    break;
+	    if (j == procs.size())          /* no parent in the tree: a root */
+		printtree(procs, in, i, job->status != -1);
+	}
+    }
+}
+/************************************
+ * end descendant tracking
+ ************************************/
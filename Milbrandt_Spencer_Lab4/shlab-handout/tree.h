@@ -0,0 +1,34 @@
+//-*-c++-*-
+#ifndef _tree_h_
+#define _tree_h_
+
+#include <sys/types.h> // needed for pid_t
+
+/*
+ * Descendant tracking. tsh makes itself a child subreaper, so a job's
+ * processes that outlive their parent are re-parented to the shell
+ * rather than to init, and the waitpid(-1) loop that reaps the jobs
+ * reaps them too. An orphan is attributed to the job whose process
+ * group it is in. A job is only finished once its whole group has
+ * exited: when the leader goes first its status is kept in the job,
+ * which stays in the list until the last of the group is reaped.
+ *
+ * Only the group is waited for. A descendant that moves to a group or
+ * session of its own (setpgid, setsid) is still reaped, but nothing
+ * ties its exit to the job, so the job can finish before it does. The
+ * checks cost a kill(-pgid, 0) per leader exit, one per waiting job on
+ * each orphan's exit, and a getpgid per orphan stop.
+ *
+ * jobs -t shows each job's process tree. treekill signals the groups
+ * of a set of jobs and any of their descendants that have moved to a
+ * process group of their own.
+ */
+
+struct job_t;
+
+void treeinit(void);
+int treealive(pid_t pgid);
+void treekill(struct job_t **sel, int n, int sig);
+void treeshow(struct job_t *jobs);
+
+#endif
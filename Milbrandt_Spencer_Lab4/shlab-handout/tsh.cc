@@ -10,16 +10,39 @@ using namespace std;
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <string>
 
 #include "globals.h"
+#include "tsh.h"
 #include "jobs.h"
+#include "events.h"
+#include "stats.h"
+#include "evlog.h"
+#include "board.h"
+#include "server.h"
+#include "session.h"
 #include "helper-routines.h"
+#include "jobctl.h"
+#include "uring.h"
+#include "capture.h"
+#include "dag.h"
+#include "place.h"
+#include "prio.h"
+#include "throttle.h"
+#include "admit.h"
+#include "tree.h"
+#include "jobspec.h"
+#include "limit.h"
+#include "history.h"
+#include "vars.h"
+#include "glob.h"
 
 //
 // Needed global variable definitions
@@ -27,31 +50,28 @@ using namespace std;
 
 static char prompt[] = "tsh> ";
 int verbose = 0;
+struct job_t jobs[MAXJOBS]; /* The job list */
+int laststatus = 0;         /* status of the last job waited for */
 
 //
 // You need to implement the functions eval, builtin_cmd, do_bgfg,
 // waitfg, sigchld_handler, sigstp_handler, sigint_handler
 //
-// The code below provides the "prototypes" for those functions
-// so that earlier code can refer to them. You need to fill in the
-// function bodies below.
+// tsh.h provides the "prototypes" for those functions so that
+// earlier code (and the other modules) can refer to them.
 //
 
-void eval(char *cmdline);
-int builtin_cmd(char **argv);
-void do_bgfg(char **argv);
-void waitfg(pid_t pid);
-
-void sigchld_handler(int sig);
-void sigtstp_handler(int sig);
-void sigint_handler(int sig);
-
 //
 // main - The shell's main routine
 //
 int main(int argc, char **argv)
 {
   int emit_prompt = 1; // emit prompt (default)
+  int reaper_thread = 0; // reap from a dedicated thread (-t)
+  int use_uring = 0; // run the main loop on io_uring (-u)
+  char *serverpath = NULL; // serve jobs on this socket (-S)
+  int session = 0; // ... as a detached session daemon (-D)
+  char *attachpath = NULL; // attach to the session on this socket (-A)
 
   //
   // Redirect stderr to stdout (so that driver will get all output
@@ -61,7 +81,7 @@ int main(int argc, char **argv)
 
   /* Parse the command line */
   char c;
-  while ((c = getopt(argc, argv, "hvp")) != EOF) {
+  while ((c = getopt(argc, argv, "hvptusTc:l:b:S:D:A:H:")) != EOF) {
     switch (c) {
     case 'h':             // print help message
       usage();
@@ -72,21 +92,73 @@ int main(int argc, char **argv)
     case 'p':             // don't print a prompt
       emit_prompt = 0;  // handy for automatic testing
       break;
+    case 't':             // reap children on a dedicated thread
+      reaper_thread = 1;
+      break;
+    case 'u':             // wait for input, signals and children on io_uring
+      use_uring = 1;
+      break;
+    case 's':             // start with latency instrumentation on
+      stats_on = 1;
+      break;
+    case 'T':             // forward bg job output line by line, tagged
+      tag_on = 1;
+      break;
+    case 'c':             // capture bg job output, SIZE bytes per job
+      if ((capture_cap = parsesize(optarg)) < 0)
+        usage();
+      break;
+    case 'l':             // append lifecycle events to a binary log
+      if (!evlog_open(optarg))
+        unix_error("evlog_open error");
+      break;
+    case 'H':             // keep command history in this file
+      if (!histopen(optarg))
+        unix_error("histopen error");
+      break;
+    case 'b':             // publish the job list to shared memory
+      if (!boardopen(optarg))
+        unix_error("boardopen error");
+      break;
+    case 'S':             // run as a job server on a Unix socket
+      serverpath = optarg;
+      break;
+    case 'D':             // run a detached job session on a Unix socket
+      serverpath = optarg;
+      session = 1;
+      break;
+    case 'A':             // attach to a job session
+      attachpath = optarg;
+      break;
     default:
       usage();
     }
   }
 
+  //
+  // A session client is not a shell itself
+  //
+  if (attachpath != NULL)
+    attach(attachpath, emit_prompt);
+
   //
   // Install the signal handlers
   //
 
   //
-  // These are the ones you will need to implement
+  // These are the ones you will need to implement. With -t they stay
+  // blocked and the reaper thread collects them instead; with -u the
+  // io_uring loop reads them (if this kernel lets us use io_uring).
   //
-  Signal(SIGINT,  sigint_handler);   // ctrl-c
-  Signal(SIGTSTP, sigtstp_handler);  // ctrl-z
-  Signal(SIGCHLD, sigchld_handler);  // Terminated or stopped child
+  if (use_uring && serverpath == NULL && uringstart()) {
+    ;
+  } else if (reaper_thread && serverpath == NULL) {
+    startreaper();
+  } else {
+    Signal(SIGINT,  sigint_handler);   // ctrl-c
+    Signal(SIGTSTP, sigtstp_handler);  // ctrl-z
+    Signal(SIGCHLD, sigchld_handler);  // Terminated or stopped child
+  }
 
   //
   // This one provides a clean way to kill the shell
@@ -98,10 +170,32 @@ int main(int argc, char **argv)
   //
   initjobs(jobs);
 
+  //
+  // The environment becomes the exported shell variables
+  //
+  varinit();
+
+  //
+  // Adopt whatever our jobs leave behind when their parents exit
+  //
+  treeinit();
+
+  //
+  // Server mode replaces the read/eval loop
+  //
+  if (serverpath != NULL)
+    serve(serverpath, session);
+
   //
   // Execute the shell's read/eval loop
   //
   for(;;) {
+    //
+    // Report anything that happened to background jobs
+    //
+    drainevents();
+    fflush(stdout);
+
     //
     // Read command line
     //
@@ -112,20 +206,25 @@ int main(int argc, char **argv)
 
     char cmdline[MAXLINE];
 
-    if ((fgets(cmdline, MAXLINE, stdin) == NULL) && ferror(stdin)) {
-      app_error("fgets error");
-    }
     //
     // End of file? (did user type ctrl-d?)
     //
-    if (feof(stdin)) {
+    if (!readline(cmdline, MAXLINE)) {
       fflush(stdout);
       exit(0);
     }
 
+    //
+    // Recall !prefix from the history, and add the line to it
+    //
+    if (!histexpand(cmdline, MAXLINE))
+      continue;
+    histadd(cmdline);
+
     //
     // Evaluate command line
     //
+    drainevents();
     eval(cmdline);
     fflush(stdout);
     fflush(stdout);
@@ -134,6 +233,61 @@ int main(int argc, char **argv)
   exit(0); //control never reaches here
 }
 
+/////////////////////////////////////////////////////////////////////////////
+//
+// Input read ahead of the current command line. The shell reads stdin
+// itself rather than through stdio so that it can tell whether a whole
+// line is already here without looking inside a FILE.
+//
+static char inbuf[MAXLINE];
+static int instart = 0, inlen = 0, ineof = 0;
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// readline - Read the next command line into cmdline, from the
+//    io_uring loop or with read. Returns 0 at end of input; a last
+//    line without a newline is dropped, as in uringline.
+//
+int readline(char *cmdline, int size)
+{
+  if (uring_on)
+    return uringline(cmdline, size);
+
+  for (;;) {
+    char *nl = (char *)memchr(inbuf + instart, '\n', inlen - instart);
+    if (nl != NULL || inlen - instart >= size - 1) {
+      int n = nl != NULL ? nl - (inbuf + instart) + 1 : inlen - instart;
+      if (n > size - 1)
+        n = size - 1;
+      memcpy(cmdline, inbuf + instart, n);
+      cmdline[n] = '\0';
+      instart += n;
+      return 1;
+    }
+    if (ineof)
+      return 0;
+    if (instart > 0) {          // slide the partial line down
+      memmove(inbuf, inbuf + instart, inlen - instart);
+      inlen -= instart;
+      instart = 0;
+    }
+
+    //
+    // Keep captured output drained while we wait for the rest
+    //
+    while (nwatched() > 0 && !pollwatched(STDIN_FILENO, NULL))
+      ;
+
+    ssize_t n = read(STDIN_FILENO, inbuf + inlen, sizeof(inbuf) - inlen);
+    if (n < 0 && errno != EINTR)
+      unix_error("read error");
+    if (n == 0)
+      ineof = 1;
+    else if (n > 0)
+      inlen += n;
+  }
+}
+
 /////////////////////////////////////////////////////////////////////////////
 //
 // eval - Evaluate the command line that the user has just typed in
@@ -148,60 +302,197 @@ int main(int argc, char **argv)
 //
 void eval(char *cmdline)
 {
-    char *argv[MAXARGS];
+    char *argv[MAXARGS], **args;
+    char quoted[MAXARGS];         /* which words were in single quotes */
     char buf[MAXLINE];
-    int bg;
+    int bg, outfd = -1;
     pid_t pid;
-    sigset_t mask;
-
-    /* Declare/initialize a signal set */
-    /* This is to stop the parent and child from 'racing' to finish first */
-    sigemptyset(&mask);
-    sigaddset(&mask, SIGCHLD);
+    long long t0 = 0;
 
+    if (STATS_ON)
+        t0 = nowns();
     strcpy(buf, cmdline);
     bg = parseline(buf, argv);
+    if (STATS_ON)
+        statrecord(SEG_PARSE, nowns() - t0);
+    EVLOG(nowns(), LOG_PARSE, 0, 0, bg, argv[0]);
 
     if (argv[0] == NULL)
         return;   /* Ignore empty lines */
 
-    //After parsing the command line, call builtin_cmd
+    /* $NAME, ${NAME:-WORD}, $? ...; NAME=VALUE lines set variables */
+    quotedwords(cmdline, argv, quoted);
+    if (!varexpand(argv, quoted) || argv[0] == NULL || varassign(argv))
+        return;
 
-    if (!builtin_cmd(argv)) {		 /* If user input is not a built in command, fork() */
+    /* limit RES=VALUE ... -- cmd ...: limits for this one command */
+    if (!strcmp(argv[0], "limit")) {
+        int k;
 
-        /* Parent blocks SIGCHLD signal temporarily */
-        sigprocmask(SIG_BLOCK, &mask, 0);
+        for (k = 1; argv[k] != NULL && strcmp(argv[k], "--"); k++)
+            ;
+        if (argv[k] != NULL) {
+            argv[k] = NULL;
+            if (argv[k + 1] == NULL || !limitset(argv + 1, 1)) {
+                printf("limit: usage: limit RES=VALUE ... -- command [args]\n");
+                return;
+            }
+            memmove(argv, argv + k + 1, (MAXARGS - k - 1) * sizeof(argv[0]));
+            memmove(quoted, quoted + k + 1, MAXARGS - k - 1);
+        }
+    }
 
-        if ((pid = fork()) < 0) {	/* Child runs user job */
-            printf("fork(): forking error\n");
+    /* --cpus LIST cmd ...: pin this one command */
+    if (!strcmp(argv[0], "--cpus")) {
+        if (argv[1] == NULL || argv[2] == NULL || !placecpus(argv[1])) {
+            printf("--cpus: usage: --cpus LIST command [args]\n");
             return;
         }
+        memmove(argv, argv + 2, (MAXARGS - 2) * sizeof(argv[0]));
+        memmove(quoted, quoted + 2, MAXARGS - 2);
+    }
 
-        if (pid == 0) {
-            //for the cntrl-c to work correctly
-            setpgid(0,0);				/* Change child process group id */
+    /* *, ?, [...] and ** */
+    args = globexpand(argv, quoted);
 
-            if (execvp(argv[0], argv) < 0) {
-                printf("%s: Command not found. \n", argv[0]);
-                exit(0);
-            }
+    //After parsing the command line, call builtin_cmd
 
-        } else {
-            /* Parent waits for foreground job to terminate */
-            if (bg == 1) {
-                addjob(jobs, pid, BG, cmdline);		/* If bg, add job to job list as bg */
-                printf("[%d] (%d) %s", pid2jid(pid), pid, cmdline);
-            } else {
-                addjob(jobs, pid, FG, cmdline);		/* If !bg, add job to job list as fg */
-            }
+    if (builtin_cmd(args)) {
+        placecpus(NULL);		/* nothing to pin */
+        limitadd(NULL);			/* or to limit */
+    }
+    else {		 /* If user input is not a built in command, fork() */
 
-            sigprocmask(SIG_UNBLOCK, &mask, 0);		/* Parent unblocks SIGCHLD */
-            waitfg(pid);
+        if (bg && !admitjob(cmdline)) {
+            placecpus(NULL);		/* it starts later, from its command line */
+            limitadd(NULL);
+            return;
         }
+        if (bg)
+            outfd = capbegin();		/* -1 unless capture is on */
+        pid = spawnjob(args, cmdline, bg ? BG : FG, outfd);
+        if (outfd >= 0)
+            capend(pid ? getjobpid(jobs, pid) : NULL);
+        if (pid == 0)
+            return;
+
+        /* Parent waits for foreground job to terminate */
+        if (bg == 1)
+            printf("[%d] (%d) %s", pid2jid(pid), pid, cmdline);
+        waitfg(pid);
+        if (!bg)
+            fgstatus(pid);
     }
     return;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+//
+// fgstatus - Set laststatus ($?) from how foreground job pid ended:
+//    its exit status, 128 plus the signal that killed it, or 128 plus
+//    SIGTSTP if it was stopped
+//
+void fgstatus(pid_t pid)
+{
+    const struct exit_t *x;
+
+    if (getjobpid(jobs, pid) != NULL)
+        laststatus = 128 + SIGTSTP;
+    else if ((x = findexit(pid, 0)) != NULL)
+        laststatus = x->status;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// logexec - Runs in a new child just before its exec: pin it where
+//    placement wants it, lower its priority if it's a bg job under
+//    the prio policy, apply its resource limits, then log the exec
+//
+static void logexec(char **argv)
+{
+    placechild();
+    priochild();
+    limitchild();
+    EVLOG(nowns(), LOG_EXEC, getpid(), 0, 0, argv[0]);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// spawnjob - Fork and exec argv as a new job in its own process group
+//    and add it to the job list in the given state (FG or BG). If
+//    outfd isn't -1 the child's stdout and stderr go to it. Returns
+//    the child's pid, or 0 if the fork failed.
+//
+pid_t spawnjob(char **argv, char *cmdline, int state, int outfd)
+{
+    pid_t pid;
+    sigset_t prev;
+    long long t1 = 0, tfork = 0;
+    int execpipe[2];
+    char c;
+
+    if (STATS_ON)
+        t1 = nowns();
+
+    /* Parent blocks the job signals temporarily */
+    /* This is to stop the parent and child from 'racing' to finish first */
+    blockjobsigs(&prev);
+
+    /* With stats on, the child reports exec success by closing a CLOEXEC pipe */
+    if (STATS_ON && pipe2(execpipe, O_CLOEXEC) < 0)
+        stats_on = 0;
+
+    placenext(state == BG);
+    prionext(state == BG);
+    if ((pid = forkjob(argv, outfd, logexec)) < 0) {
+        placeadd(NULL, 0);
+        limitadd(NULL);
+        if (STATS_ON) {
+            close(execpipe[0]);
+            close(execpipe[1]);
+        }
+        printf("fork(): forking error\n");
+        sigprocmask(SIG_SETMASK, &prev, 0);
+        return 0;
+    }
+
+    if (pid == 0) {				/* Child's exec failed */
+        printf("%s: Command not found. \n", argv[0]);
+        if (STATS_ON)
+            write(execpipe[1], "x", 1);
+        fflush(stdout);
+        _exit(127);			/* exit() would seek the shared stdin back */
+    }
+
+    if (STATS_ON || evlog_on)
+        tfork = nowns();
+    if (STATS_ON) {
+        statrecord(SEG_SPAWN, tfork - t1);
+        close(execpipe[1]);
+        if (read(execpipe[0], &c, 1) == 0)	/* EOF: exec succeeded */
+            statrecord(SEG_EXEC, nowns() - tfork);
+        close(execpipe[0]);
+    }
+
+    if (!addjob(jobs, pid, state, cmdline)) {
+        placeadd(NULL, 0);
+        limitadd(NULL);
+        kill(-pid, SIGKILL);			/* no room to track it */
+        sigprocmask(SIG_SETMASK, &prev, 0);
+        return 0;
+    }
+    placeadd(jobs, pid);
+    limitadd(getjobpid(jobs, pid));
+    prioadd(getjobpid(jobs, pid));
+    if (verbose)
+        printf("Added job [%d] %d %s", pid2jid(pid), pid, cmdline);
+    EVLOG(tfork, LOG_SPAWN, pid, pid2jid(pid), state == BG, cmdline);
+    boardupdate();
+
+    sigprocmask(SIG_SETMASK, &prev, 0);		/* Parent unblocks the job signals */
+    return pid;
+}
+
 
 /////////////////////////////////////////////////////////////////////////////
 //
@@ -220,7 +511,7 @@ int builtin_cmd(char **argv)
 
         /* Check the state of jobs before exiting */
 
-        for (i=0; i<16; i++) {
+        for (i=0; i<MAXJOBS; i++) {
             if (jobs[i].state == ST)
                 stopped = 1;
         }
@@ -235,7 +526,111 @@ int builtin_cmd(char **argv)
     }
 
     if (!strcmp(argv[0], "jobs")) {
+        if (argv[1] != NULL && !strcmp(argv[1], "-t") && argv[2] == NULL) {
+            treeshow(jobs);
+            return 1;
+        }
+        if (argv[1] != NULL && !strcmp(argv[1], "-o")) {	/* jobs -o %N */
+            if (argv[2] == NULL || argv[2][0] != '%' || !isdigit(argv[2][1]))
+                printf("jobs: usage: jobs [-t | -o %%jobid]\n");
+            else if (!capshow(atoi(&argv[2][1])))
+                printf("%s: No captured output\n", argv[2]);
+            return 1;
+        }
         listjobs(jobs);
+        limitlist(jobs);
+        return 1;
+    }
+
+    if (!strcmp(argv[0], "capture")) {
+        do_capture(argv);
+        return 1;
+    }
+
+    if (!strcmp(argv[0], "export")) {
+        varexport(argv);
+        return 1;
+    }
+
+    if (!strcmp(argv[0], "unset")) {
+        varunset(argv);
+        return 1;
+    }
+
+    if (!strcmp(argv[0], "set") && argv[1] == NULL) {
+        varshow();
+        return 1;
+    }
+
+    if (!strcmp(argv[0], "history")) {
+        if (!hist_on)
+            printf("history: off (start tsh with -H FILE)\n");
+        else if (argv[1] != NULL && !strcmp(argv[1], "-p") && argv[2] != NULL && argv[3] == NULL)
+            histprefix(argv[2]);
+        else if (argv[1] == NULL || (isdigit(argv[1][0]) && argv[2] == NULL))
+            histshow(argv[1] != NULL ? atoi(argv[1]) : 20);
+        else
+            printf("history: usage: history [N | -p PREFIX]\n");
+        return 1;
+    }
+
+    if (!strcmp(argv[0], "limit")) {
+        if (argv[1] == NULL)
+            limitshow();
+        else if (!limitset(argv + 1, 0))
+            printf("limit: usage: limit [RES=VALUE ...] [-- command] (RES: cpu as nofile nproc core)\n");
+        return 1;
+    }
+
+    if (!strcmp(argv[0], "kill")) {
+        do_kill(argv);
+        return 1;
+    }
+
+    if (!strcmp(argv[0], "wait")) {
+        do_wait(argv);
+        return 1;
+    }
+
+    if (!strcmp(argv[0], "dag")) {
+        do_dag(argv);
+        return 1;
+    }
+
+    if (!strcmp(argv[0], "throttle")) {
+        do_throttle(argv);
+        return 1;
+    }
+
+    if (!strcmp(argv[0], "admit")) {
+        if (argv[1] != NULL && !admitset(argv + 1))
+            printf("admit: usage: admit [on|off|cpu PCT|mem PCT|io PCT|avail MB|reserve MB]\n");
+        else if (argv[1] == NULL)
+            admitshow();
+        return 1;
+    }
+
+    if (!strcmp(argv[0], "prio")) {
+        do_prio(argv);
+        return 1;
+    }
+
+    if (!strcmp(argv[0], "place")) {
+        if (argv[1] == NULL)
+            placeshow();
+        else if (!strcmp(argv[1], "off"))
+            place_mode = PLACE_OFF;
+        else if (!strcmp(argv[1], "rr"))
+            place_mode = PLACE_RR;
+        else if (!strcmp(argv[1], "least"))
+            place_mode = PLACE_LEAST;
+        else
+            printf("place: usage: place [off|rr|least]\n");
+        return 1;
+    }
+
+    if (!strcmp(argv[0], "tag")) {
+        do_tag(argv);
         return 1;
     }
 
@@ -244,6 +639,20 @@ int builtin_cmd(char **argv)
         return 1;
     }
 
+    if (!strcmp(argv[0], "stats")) {
+        if (argv[1] == NULL)
+            statprint();
+        else if (!strcmp(argv[1], "reset"))
+            statreset();
+        else if (!strcmp(argv[1], "on"))
+            stats_on = 1;
+        else if (!strcmp(argv[1], "off"))
+            stats_on = 0;
+        else
+            printf("stats: usage: stats [on|off|reset]\n");
+        return 1;
+    }
+
     if (!strcmp(argv[0], "&"))	/* Ignore & */
         return 1;
 
@@ -255,6 +664,10 @@ int builtin_cmd(char **argv)
 //
 // do_bgfg - Execute the builtin bg and fg commands
 //
+//    bg SPEC ...             continue stopped jobs in the background
+//    fg SPEC ...             bring the newest of the jobs to the foreground
+//
+//    SPEC is %jobid, PID, %+, %-, all, stopped or running (jobspec.h)
 //
   // You need to complete rest. At this point,
   // the variable 'jobp' is the job pointer
@@ -266,66 +679,421 @@ int builtin_cmd(char **argv)
   //
 void do_bgfg(char **argv)
 {
-    int jid, pid;
-    char *args = argv[1];
+    struct job_t *sel[MAXJOBS];
+    pid_t pids[MAXARGS];
+    struct jobsel_t js = { sel, 0, NULL, pids, 0 };
     struct job_t *job;
-    //Getting the job/process id
-    if (args != NULL) {     /* if arguments are passed to bg or fg */
-        if (args[0] == '%' && isdigit(args[1])) {
-            jid = atoi(&args[1]);
+    int i, jid, pid;
 
-            if (!(job = getjobjid(jobs, jid))) {
-                printf("%s: No such job\n", args);
-                return;
-            }
+    //Getting the jobs: %jobid, PID or a selector (see jobspec.h)
+    if (argv[1] == NULL) {
+        printf("%s command requires PID or %%jobid argument\n", argv[0]);
+        return;
+    }
+    if (jobselect(argv + 1, &js) < 0) {
+        printf("%s: argument must be a PID or %%jobid\n", argv[0]);
+        return;
+    }
+    for (i = 0; i < js.npids; i++)
+        printf("(%d): No such process\n", pids[i]);
+
+    //bg continues every stopped job it was given
+    if (!strcmp(argv[0], "bg")) {
+        for (i = 0; i < js.njobs; i++) {
+            job = sel[i];
+            if (job->state != ST)
+                continue;
+            printf("[%d] (%d) %s", job->jid, job->pid, job->cmdline);
+            job->state = BG;
+            priojob(job, 1, 0);
+            //send the job a continue signal, run it in the background
+            kill(-job->pid, SIGCONT);
+            EVLOG(nowns(), LOG_CONT, job->pid, job->jid, BG, NULL);
+        }
+        boardupdate();
+        return;
+    }
 
-        } else if (isdigit(*argv[1])) {	/* is it a process id? */
+    //fg takes the newest job it was given into the foreground
+    if ((job = js.newest) == NULL)
+        return;
+    pid = job->pid;
+    jid = job->jid;
+    if (job->state == ST || job->state == BG) {
+        int stopped = job->state == ST;
+
+        job->state = FG;
+        capfg(job);
+        if (!priojob(job, 0, 0))
+            printf("[%d] (%d): priority not fully restored\n", jid, pid);
+        if (stopped) {
+            kill(-pid, SIGCONT);
+            EVLOG(nowns(), LOG_CONT, pid, jid, FG, NULL);
+        }
+        boardupdate();
+        waitfg(pid);
+        capfgdone(jid);
+    }
+}
 
-            pid = atoi(&args[0]);
+/////////////////////////////////////////////////////////////////////////////
+//
+// do_kill - Execute the builtin kill command
+//
+//    kill [-SIG | -s SIG] SPEC ...  send SIG (TERM by default) to jobs
+//    kill -l                        list the signal names
+//
+//    SPEC is %jobid, PID, %+, %-, all, stopped or running (jobspec.h).
+//    All of them are looked up in one pass over the job list and each
+//    job's process group gets the signal directly. The ones that end a
+//    job reach its whole tree, descendants that changed group included.
+//    PIDs that aren't jobs are signalled as single processes.
+//
+void do_kill(char **argv)
+{
+    struct job_t *sel[MAXJOBS];
+    pid_t pids[MAXARGS];
+    struct jobsel_t js = { sel, 0, NULL, pids, 0 };
+    char **arg = argv + 1;
+    int i, sig = SIGTERM, failed;
+    long long t0 = nowns();
+    sigset_t prev;
+
+    if (*arg != NULL && !strcmp(*arg, "-l")) {
+        for (i = 1; i < NSIG; i++)
+            if (sigabbrev_np(i) != NULL)
+                printf("%2d %s\n", i, sigabbrev_np(i));
+        return;
+    }
+    if (*arg != NULL && !strcmp(*arg, "-s") && arg[1] != NULL) {
+        sig = signum(arg[1]);
+        arg += 2;
+    }
+    else if (*arg != NULL && (*arg)[0] == '-') {
+        sig = signum(*arg + 1);
+        arg++;
+    }
+    if (sig < 0 || *arg == NULL || (failed = jobselect(arg, &js)) < 0) {
+        printf("kill: usage: kill [-SIG | -s SIG] %%jobid|pid|%%+|%%-|all|stopped|running ...\n");
+        laststatus = 2;
+        return;
+    }
 
-            if (!(job = getjobpid(jobs, pid))) {
-                printf("(%s): No such process\n", argv[1]);
-                return;
-            }
+    //
+    // Hold SIGCHLD off until every job has been signalled: each stop or
+    // continue would otherwise run the handler, and its waitpid has to
+    // look through every child
+    //
+    blockjobsigs(&prev);
+    for (i = 0; i < js.njobs; i++) {
+        throttlewake(sel[i]->pid);      /* so the signal isn't held up */
+        if (sig == SIGSTOP)
+            throttlejob(sel[i], 100);   /* or the stop would be taken for its own */
+    }
+    if (sig == SIGKILL || sig == SIGTERM || sig == SIGINT || sig == SIGHUP || sig == SIGQUIT)
+        treekill(sel, js.njobs, sig);
+    else
+        for (i = 0; i < js.njobs; i++)
+            kill(-sel[i]->pid, sig);
+    if (sig == SIGCONT) {
+        for (i = 0; i < js.njobs; i++) {
+            if (sel[i]->state != ST)
+                continue;
+            sel[i]->state = BG;
+            EVLOG(nowns(), LOG_CONT, sel[i]->pid, sel[i]->jid, BG, NULL);
+        }
+        boardupdate();
+    }
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    for (i = 0; i < js.npids; i++)
+        if (kill(pids[i], sig) < 0) {
+            printf("kill: (%d): %s\n", pids[i], strerror(errno));
+            failed++;
+        }
+    if (verbose)
+        printf("kill: %d jobs, %d processes in %.3f ms\n", js.njobs, js.npids,
+               (nowns() - t0) / 1e6);
+    laststatus = failed > 0;
+}
 
-        } else {
-            printf("%s: argument must be a PID or %%jobid\n", argv[0]);
+/////////////////////////////////////////////////////////////////////////////
+//
+// anyrunning - True if some background job is running
+//
+static int anyrunning(void)
+{
+    for (int i = 0; i < MAXJOBS; i++)
+        if (jobs[i].state == BG)
+            return 1;
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// do_wait - Execute the builtin wait command
+//
+//    wait                    wait for every running background job
+//    wait %N|pid ...         wait for each of these jobs to finish
+//    wait -n [%N|pid ...]    wait for the next of them (or of any job)
+//
+// Sleeps in waitevents like waitfg and looks again only when events
+// were applied, so nothing is polled. Jobs that finished earlier are
+// found in the exit records. Ctrl-c ends the wait. Sets laststatus
+// to the status of the job waited for (the last one named, or the
+// one -n saw finish): 127 if there is no such job, 130 if interrupted.
+//
+void do_wait(char **argv)
+{
+    pid_t pids[MAXARGS];
+    int npids = 0, next = 0, status = 0, done = 0, changed, k;
+    unsigned seen;
+    const struct exit_t *x;
+    struct job_t *job;
+    sigset_t prev;
+    char **arg = argv + 1;
+
+    if (*arg != NULL && !strcmp(*arg, "-n")) {
+        next = 1;
+        arg++;
+    }
+    for (; *arg != NULL; arg++) {
+        if ((*arg)[0] == '%' && isdigit((*arg)[1])) {
+            if ((job = getjobjid(jobs, atoi(&(*arg)[1]))) != NULL)
+                pids[npids++] = job->pid;
+            else if ((x = findexit(0, atoi(&(*arg)[1]))) != NULL)
+                pids[npids++] = x->pid;
+            else {
+                printf("%s: No such job\n", *arg);
+                status = 127;
+            }
+        }
+        else if (isdigit((*arg)[0])) {
+            if (getjobpid(jobs, atoi(*arg)) != NULL || findexit(atoi(*arg), 0) != NULL)
+                pids[npids++] = atoi(*arg);
+            else {
+                printf("(%s): No such process\n", *arg);
+                status = 127;
+            }
+        }
+        else {
+            printf("wait: usage: wait [-n] [%%jobid|pid ...]\n");
+            laststatus = 2;
             return;
         }
-
-    } else {
-        printf("%s command requires PID or %%jobid argument\n", argv[0]);
+    }
+    if (npids == 0 && argv[1] != NULL && !(next && argv[2] == NULL)) {
+        laststatus = status;        /* nothing left to wait for */
         return;
     }
 
-    //if there is a job, set process id to that jobs process id
-    if (job != NULL) {
-        pid = job->pid;
-        //if the job is stopped, change state to BG/FG and send SIGCONT signal to -pid(???)
-        if (job->state == ST) {
-            if (!strcmp(argv[0], "bg")) {
-                printf("[%d] (%d) %s", job->jid, job->pid, job->cmdline);
-                job->state = BG;
-                //send the job a continue signal, run it in the background
-                kill(-pid, SIGCONT);
+    blockjobsigs(&prev);
+    drainevents();
+    interrupted = 0;
+    seen = nexits;
+    for (changed = 1; !done; ) {
+        if (changed) {                /* first time round, or the job list changed */
+            if (npids == 0 && next) {
+                if ((x = getexit(seen)) != NULL) {
+                    status = x->status;
+                    done = 1;
+                }
+                else if (nexits != seen || !anyrunning()) {
+                    status = 127;   /* record lost, or nothing left to finish */
+                    done = 1;
+                }
             }
-
-            if (!strcmp(argv[0], "fg")) {
-                job->state = FG;
-                kill(-pid, SIGCONT);
-                waitfg(job->pid);
+            else if (npids == 0)
+                done = !anyrunning();
+            else {
+                done = !next;
+                for (k = 0; k < npids; k++) {
+                    if (getjobpid(jobs, pids[k]) != NULL) {
+                        if (!next)
+                            done = 0;
+                        continue;
+                    }
+                    x = findexit(pids[k], 0);
+                    status = x != NULL ? x->status : 127;
+                    if (next) {
+                        done = 1;
+                        break;
+                    }
+                }
             }
+            if (done)
+                break;
         }
-
-        if (job->state == BG) {
-            if (!strcmp(argv[0], "fg")) {
-                job->state = FG;
-                waitfg(job->pid);
-            }
+        waitevents(&prev);
+        changed = drainevents();
+        if (interrupted) {
+            status = 130;
+            break;
         }
     }
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    laststatus = status;
+}
 
-    return;
+/////////////////////////////////////////////////////////////////////////////
+//
+// do_dag - Execute the builtin dag command
+//
+//    dag [-q] [-n] [-j N] FILE   run the task graph in FILE (see dag.h)
+//
+// -j caps the tasks running at once (default: one per CPU), -q prints
+// only the summary line and -n schedules without running anything.
+// Sets laststatus: 0 if every task succeeded.
+//
+void do_dag(char **argv)
+{
+    int maxjobs = sysconf(_SC_NPROCESSORS_ONLN), flags = 0;
+    char **arg;
+
+    for (arg = argv + 1; *arg != NULL && (*arg)[0] == '-'; arg++) {
+        if (!strcmp(*arg, "-q"))
+            flags |= DAG_QUIET;
+        else if (!strcmp(*arg, "-n"))
+            flags |= DAG_DRYRUN;
+        else if (!strcmp(*arg, "-j") && arg[1] != NULL && isdigit(arg[1][0]))
+            maxjobs = atoi(*++arg);
+        else
+            break;
+    }
+    if (*arg == NULL || arg[1] != NULL || maxjobs < 1) {
+        printf("dag: usage: dag [-q] [-n] [-j N] FILE\n");
+        laststatus = 2;
+        return;
+    }
+    if (maxjobs > MAXJOBS)
+        maxjobs = MAXJOBS;
+    laststatus = dagrun(*arg, maxjobs, flags);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// do_throttle - Execute the builtin throttle command
+//
+//    throttle                list throttled jobs and the share they got
+//    throttle %N PCT|off     let job N run PCT percent of the time
+//    throttle -p MS          length of the duty cycle
+//
+void do_throttle(char **argv)
+{
+    struct job_t *job;
+    int pct;
+
+    if (argv[1] == NULL)
+        throttleshow();
+    else if (!strcmp(argv[1], "-p")) {
+        if (argv[2] == NULL || !isdigit(argv[2][0]) || !throttleperiod(atoi(argv[2])))
+            printf("throttle: usage: throttle -p MS (1 to 10000)\n");
+    }
+    else if (argv[1][0] != '%' || !isdigit(argv[1][1]) || argv[2] == NULL ||
+             (strcmp(argv[2], "off") && (!isdigit(argv[2][0]) || atoi(argv[2]) < 1)))
+        printf("throttle: usage: throttle [%%jobid PERCENT|off] [-p MS]\n");
+    else if ((job = getjobjid(jobs, atoi(&argv[1][1]))) == NULL)
+        printf("%s: No such job\n", argv[1]);
+    else {
+        pct = strcmp(argv[2], "off") ? atoi(argv[2]) : 100;
+        if (!throttlejob(job, pct))
+            printf("throttle: %s\n", strerror(errno));
+    }
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// do_prio - Execute the builtin prio command
+//
+//    prio                    show the background job policy
+//    prio on|off             lower new background jobs' priority
+//    prio sched other|batch|idle, prio nice N, prio io none|be|idle
+//                            change what the policy applies
+//    prio %N                 show what job N is running with
+//    prio %N fg|bg           give job N normal or background priority now
+//
+void do_prio(char **argv)
+{
+    struct job_t *job;
+
+    if (argv[1] == NULL)
+        prioshow(NULL);
+    else if (argv[1][0] == '%') {
+        if (!isdigit(argv[1][1]) || (argv[2] != NULL && strcmp(argv[2], "fg") && strcmp(argv[2], "bg")))
+            printf("prio: usage: prio %%jobid [fg|bg]\n");
+        else if ((job = getjobjid(jobs, atoi(&argv[1][1]))) == NULL)
+            printf("%s: No such job\n", argv[1]);
+        else if (argv[2] == NULL)
+            prioshow(job);
+        else if (!priojob(job, !strcmp(argv[2], "bg"), 1))	/* works with the policy off */
+            printf("%s: priority not fully changed\n", argv[1]);
+    }
+    else if (!prioset(argv + 1))
+        printf("prio: usage: prio [on|off|sched CLASS|nice N|io CLASS|%%jobid [fg|bg]]\n");
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// do_capture - Execute the builtin capture command
+//
+//    capture                 show the cap for new background jobs
+//    capture on|off|SIZE     capture new background jobs' output
+//    capture %N SIZE         change the cap of job N's capture
+//
+void do_capture(char **argv)
+{
+    long size;
+
+    if (argv[1] == NULL) {
+        if (capture_cap > 0)
+            printf("capture: %ld bytes per job\n", capture_cap);
+        else
+            printf("capture: off\n");
+        return;
+    }
+    if (argv[1][0] == '%') {
+        if (!isdigit(argv[1][1]) || argv[2] == NULL || (size = parsesize(argv[2])) <= 0)
+            printf("capture: usage: capture %%jobid SIZE\n");
+        else if (!capresize(atoi(&argv[1][1]), size))
+            printf("%s: No captured output\n", argv[1]);
+        return;
+    }
+    if (!strcmp(argv[1], "on"))
+        capture_cap = CAP_DEFAULT;
+    else if (!strcmp(argv[1], "off"))
+        capture_cap = 0;
+    else if ((size = parsesize(argv[1])) >= 0)
+        capture_cap = size;
+    else
+        printf("capture: usage: capture [on|off|SIZE|%%jobid SIZE]\n");
+}
+
+/////////////////////////////////////////////////////////////////////////////
+//
+// do_tag - Execute the builtin tag command
+//
+//    tag                     show whether new background jobs are tagged
+//    tag on|off              tag new background jobs' output lines
+//    tag -p FORMAT           prefix for each line (%j jid, %p pid, %c command)
+//    tag -o FILE|-           send tagged lines to FILE, or back to the terminal
+//
+void do_tag(char **argv)
+{
+    if (argv[1] == NULL)
+        printf("tag: %s\n", tag_on ? "on" : "off");
+    else if (!strcmp(argv[1], "on"))
+        tag_on = 1;
+    else if (!strcmp(argv[1], "off"))
+        tag_on = 0;
+    else if (!strcmp(argv[1], "-p") && argv[2] != NULL) {
+        if (!tagformat(argv[2]))
+            printf("tag: prefix too long\n");
+    }
+    else if (!strcmp(argv[1], "-o") && argv[2] != NULL) {
+        if (!tagoutput(argv[2]))
+            printf("tag: %s: %s\n", argv[2], strerror(errno));
+    }
+    else
+        printf("tag: usage: tag [on|off|-p FORMAT|-o FILE]\n");
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -333,14 +1101,45 @@ void do_bgfg(char **argv)
 //
 void waitfg(pid_t pid)
 {
-    struct job_t *p = getjobpid(jobs, pid);
-
-    while (p->state == FG)
-        sleep(1);
+    struct job_t *p;
+    sigset_t prev;
+    long long t = 0;
+    int slept = 0;
+
+    blockjobsigs(&prev);
+    for (;;) {
+        drainevents();
+        if (STATS_ON)
+            t = nowns();
+        p = getjobpid(jobs, pid);
+        if (p == NULL || p->state != FG)
+            break;
+        waitevents(&prev);	/* sleeps until a handler queues an event */
+        slept = 1;
+    }
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    if (STATS_ON && slept)
+        statrecord(SEG_WAKE, nowns() - t);
 
     return;
 }
 
+/////////////////////////////////////////////////////////////////////////////
+//
+// pid2jid - Map process ID to job ID in the shell's job list
+//
+int pid2jid(pid_t pid)
+{
+    int i;
+
+    if (pid < 1)
+        return 0;
+    for (i = 0; i < MAXJOBS; i++)
+        if (jobs[i].pid == pid)
+            return jobs[i].jid;
+    return 0;
+}
+
 /////////////////////////////////////////////////////////////////////////////
 //
 // Signal handlers
@@ -353,36 +1152,12 @@ void waitfg(pid_t pid)
 //     a child job terminates (becomes a zombie), or stops because it
 //     received a SIGSTOP or SIGTSTP signal. The handler reaps all
 //     available zombie children, but doesn't wait for any other
-//     currently running children to terminate.
+//     currently running children to terminate. Each status change is
+//     queued on the event ring; drainevents updates the job list.
 //
 void sigchld_handler(int sig)
 {
-    int status;
-    pid_t pid;
-
-    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED)) > 0 ) {
-
-        if (WIFEXITED(status)) {   /*checks if child terminated normally */
-            deletejob(jobs, pid);
-        }
-
-        if (WIFSIGNALED(status)) {  /*checks if child was terminated by a signal that was not caught */
-            printf("Job [%d] (%d) terminated by signal %d\n", pid2jid(pid), pid, WTERMSIG(status));
-            deletejob(jobs,pid);
-        }
-
-        if (WIFSTOPPED(status)) {     /*checks if child process that caused return is currently stopped */
-            getjobpid(jobs, pid)->state = ST;
-            //Job [] () stopped by signal x
-            printf("Job [%d] (%d) stopped by signal %d\n", pid2jid(pid), pid, WSTOPSIG(status));
-
-        }
-    }
-
-    if (pid < 0 && errno != ECHILD) {
-        printf("waitpid error: %s\n", strerror(errno));
-    }
-
+    reapchildren();
     return;
 }
 
@@ -390,17 +1165,13 @@ void sigchld_handler(int sig)
 //
 // sigint_handler - The kernel sends a SIGINT to the shell whenver the
 //    user types ctrl-c at the keyboard.  Catch it and send it along
-//    to the foreground job.
+//    to the foreground job. The forwarding itself happens when the
+//    main loop drains the event, since the job list isn't safe to
+//    read from here.
 //
 void sigint_handler(int sig)
 {
-    pid_t pid = fgpid(jobs);
-
-    //if there are foreground jobs, send SIGINT to fg jobs
-    if (fgpid(jobs) != 0) {
-        kill(-pid, SIGINT);
-    }
-
+    pushsignal(SIGINT);
     return;
 }
 
@@ -408,16 +1179,11 @@ void sigint_handler(int sig)
 //
 // sigtstp_handler - The kernel sends a SIGTSTP to the shell whenever
 //     the user types ctrl-z at the keyboard. Catch it and suspend the
-//     foreground job by sending it a SIGTSTP.
+//     foreground job by sending it a SIGTSTP (again via the event ring).
 //
 void sigtstp_handler(int sig)
 {
- pid_t pid = fgpid(jobs);
-
-    if (fgpid(jobs) != 0) {
-        kill(-pid, SIGTSTP);
-    }
-
+    pushsignal(SIGTSTP);
     return;
 }
 
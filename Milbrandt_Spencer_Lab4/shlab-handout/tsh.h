@@ -0,0 +1,32 @@
+//-*-c++-*-
+#ifndef _tsh_h_
+#define _tsh_h_
+
+#include <sys/types.h> // needed for pid_t
+#include "jobs.h"
+
+extern struct job_t jobs[MAXJOBS]; /* The shell's job list */
+extern int laststatus;             /* $?: set by fg jobs, wait and dag */
+
+/* The shell routines in tsh.cc */
+int readline(char *cmdline, int size);
+void eval(char *cmdline);
+int builtin_cmd(char **argv);
+void do_bgfg(char **argv);
+void do_capture(char **argv);
+void do_tag(char **argv);
+void do_kill(char **argv);
+void do_wait(char **argv);
+void do_dag(char **argv);
+void do_prio(char **argv);
+void do_throttle(char **argv);
+void waitfg(pid_t pid);
+void fgstatus(pid_t pid);
+pid_t spawnjob(char **argv, char *cmdline, int state, int outfd);
+int pid2jid(pid_t pid);
+
+void sigchld_handler(int sig);
+void sigtstp_handler(int sig);
+void sigint_handler(int sig);
+
+#endif
@@ -0,0 +1,110 @@
+/*
+ * tshcount.c - Count the system calls a shell makes
+ *
+ * usage: tshcount [-q] [-j jobs] command [args...]
+ * Runs command under ptrace, stopping at every system call made by
+ * any of its threads (the programs it launches are not traced), and
+ * prints the number of calls and the wall time. -j N also prints both
+ * per job, for a run that launched N jobs. -q runs the command
+ * untraced, which gives the real launch throughput.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+#include <map>
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* trace - Run the traced command to completion; returns the syscall count */
+static long trace(pid_t pid)
+{
+    std::map<pid_t, int> insyscall;     /* per thread: between entry and exit */
+    long calls = 0;
+    int status, sig;
+    pid_t tid;
+
+    waitpid(pid, &status, 0);           /* the stop at exec */
+    ptrace(PTRACE_SETOPTIONS, pid, 0,
+	   PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL);
+    ptrace(PTRACE_SYSCALL, pid, 0, 0);
+
+    while ((tid = waitpid(-1, &status, __WALL)) > 0) {
+	if (WIFEXITED(status) || WIFSIGNALED(status)) {
+	    insyscall.erase(tid);
+	    if (tid == pid)
+		break;
+	    continue;
+	}
+	sig = 0;
+	if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+	    if (!insyscall[tid])
+		calls++;
+	    insyscall[tid] = !insyscall[tid];
+	}
+	else if ((status >> 16) == 0 && !(WSTOPSIG(status) == SIGSTOP && !insyscall.count(tid)))
+	    sig = WSTOPSIG(status);     /* a real signal: deliver it */
+	if (!insyscall.count(tid))
+	    insyscall[tid] = 0;
+	ptrace(PTRACE_SYSCALL, tid, 0, sig);
+    }
+    return calls;
+}
+
+int main(int argc, char **argv)
+{
+    int quiet = 0, jobs = 0, c, status;
+    long calls = 0;
+    double t0, t1;
+    pid_t pid;
+
+    while ((c = getopt(argc, argv, "+qj:")) != EOF) {
+	switch (c) {
+	case 'q': quiet = 1; break;
+	case 'j': jobs = atoi(optarg); break;
+	default:
+	    fprintf(stderr, "Usage: %s [-q] [-j jobs] command [args...]\n", argv[0]);
+	    exit(1);
+	}
+    }
+    if (optind >= argc) {
+	fprintf(stderr, "Usage: %s [-q] [-j jobs] command [args...]\n", argv[0]);
+	exit(1);
+    }
+
+    t0 = now();
+    if ((pid = fork()) == 0) {
+	if (!quiet)
+	    ptrace(PTRACE_TRACEME, 0, 0, 0);
+	execvp(argv[optind], argv + optind);
+	perror(argv[optind]);
+	_exit(127);
+    }
+    if (quiet)
+	waitpid(pid, &status, 0);
+    else
+	calls = trace(pid);
+    t1 = now();
+
+    if (quiet) {
+	fprintf(stderr, "%.3fs", t1 - t0);
+	if (jobs > 0)
+	    fprintf(stderr, ", %.0f jobs/s", jobs / (t1 - t0));
+    }
+    else {
+	fprintf(stderr, "%ld syscalls", calls);
+	if (jobs > 0)
+	    fprintf(stderr, ", %.1f per job", (double)calls / jobs);
+    }
+    fprintf(stderr, "\n");
+    return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * tshload.c - Load test for a tsh -S job server
+ *
+ * usage: tshload [-c clients] [-n jobs] [-w window] <socket> [command]
+ * Opens <clients> connections and has each submit <jobs> copies of
+ * command (default /bin/true), keeping at most <window> unfinished
+ * jobs per connection. Reports submissions per second once every
+ * job has been reported done.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <string>
+#include <vector>
+
+struct conn_t {             /* One client connection */
+    int fd;
+    int sent, done, failed;
+    std::string in;
+};
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-c clients] [-n jobs] [-w window] <socket> [command]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int nclients = 4, njobs = 1000, window = 32, c, i, left;
+    const char *path, *command = "/bin/true";
+    std::vector<conn_t> conns;
+    std::vector<struct pollfd> pfds;
+    struct sockaddr_un addr;
+    std::string req;
+    double t0, t1;
+
+    while ((c = getopt(argc, argv, "c:n:w:")) != EOF) {
+	switch (c) {
+	case 'c': nclients = atoi(optarg); break;
+	case 'n': njobs = atoi(optarg); break;
+	case 'w': window = atoi(optarg); break;
+	default: usage(argv[0]);
+	}
+    }
+    if (optind >= argc || nclients < 1 || njobs < 1 || window < 1)
+	usage(argv[0]);
+    path = argv[optind];
+    if (optind + 1 < argc)
+	command = argv[optind + 1];
+    req = std::string("run ") + command + "\n";
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+    conns.resize(nclients);
+    pfds.resize(nclients);
+    for (i = 0; i < nclients; i++) {
+	if ((conns[i].fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+	    connect(conns[i].fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+	    perror(path);
+	    exit(1);
+	}
+	conns[i].sent = conns[i].done = conns[i].failed = 0;
+	pfds[i].fd = conns[i].fd;
+	pfds[i].events = POLLIN;
+    }
+
+    t0 = now();
+    left = nclients * njobs;
+    while (left > 0) {
+	/* Top every connection up to its window */
+	for (i = 0; i < nclients; i++) {
+	    conn_t *k = &conns[i];
+	    std::string batch;
+
+	    while (k->sent < njobs && k->sent - k->done < window) {
+		batch += req;
+		k->sent++;
+	    }
+	    if (!batch.empty() && write(k->fd, batch.data(), batch.size()) != (ssize_t)batch.size()) {
+		perror("write");
+		exit(1);
+	    }
+	}
+
+	if (poll(pfds.data(), nclients, -1) < 0) {
+	    perror("poll");
+	    exit(1);
+	}
+	for (i = 0; i < nclients; i++) {
+	    conn_t *k = &conns[i];
+	    char buf[65536];
+	    size_t start = 0, nl;
+	    ssize_t n;
+
+	    if (!(pfds[i].revents & (POLLIN | POLLHUP)))
+		continue;
+	    if ((n = read(k->fd, buf, sizeof(buf))) <= 0) {
+		fprintf(stderr, "server closed connection\n");
+		exit(1);
+	    }
+	    k->in.append(buf, n);
+	    while ((nl = k->in.find('\n', start)) != std::string::npos) {
+		if (!k->in.compare(start, 5, "done ")) {
+		    k->done++;
+		    left--;
+		}
+		else if (!k->in.compare(start, 6, "error ")) {
+		    k->done++;
+		    k->failed++;
+		    left--;
+		}
+		start = nl + 1;
+	    }
+	    k->in.erase(0, start);
+	}
+    }
+    t1 = now();
+
+    for (i = 0, c = 0; i < nclients; i++)
+	c += conns[i].failed;
+    printf("%d clients x %d jobs: %.3f s, %.0f submissions/s, %d failed\n",
+	   nclients, njobs, t1 - t0, nclients * njobs / (t1 - t0), c);
+    return 0;
+}
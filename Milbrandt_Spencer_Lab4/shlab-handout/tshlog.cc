@@ -0,0 +1,240 @@
+/*
+ * tshlog.c - Convert a tsh -l event log to Chrome trace-event JSON
+ *
+ * usage: tshlog [-s] <logfile>
+ * Writes the trace to stdout; load it in Perfetto or chrome://tracing.
+ * With -s, prints summary statistics instead: the longest-running
+ * jobs and the jobs that spent the most time stopped.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#include "evlog.h"
+
+struct rec_t {              /* A finished record, copied out of the map */
+    long long ts;
+    int kind, pid, jid, arg;
+    char text[EVLOG_TEXT + 1];
+};
+
+struct jobinfo_t {          /* Everything we learned about one job */
+    int shell, pid, jid, status;
+    long long spawn, exit, stopped, stopat;
+    char cmd[EVLOG_TEXT + 1];
+};
+
+static const char *kindname[] = {
+    "?", "start", "parse", "spawn", "exec", "stop", "cont", "fwd", "reap", "exit",
+    "hold", "admit", "shed"
+};
+
+/* jsonstr - Print s as a JSON string literal */
+static void jsonstr(const char *s)
+{
+    putchar('"');
+    for (; *s; s++) {
+	if (*s == '"' || *s == '\\')
+	    printf("\\%c", *s);
+	else if ((unsigned char)*s < 0x20)
+	    printf("\\u%04x", *s);
+	else
+	    putchar(*s);
+    }
+    putchar('"');
+}
+
+/* trim - Drop the trailing newline (and " &") eval left on a cmdline */
+static void trim(char *s)
+{
+    size_t n = strlen(s);
+
+    while (n > 0 && (s[n-1] == '\n' || s[n-1] == ' '))
+	s[--n] = '\0';
+}
+
+static bool bylongest(const jobinfo_t *a, const jobinfo_t *b)
+{
+    return a->exit - a->spawn > b->exit - b->spawn;
+}
+
+static bool bystopped(const jobinfo_t *a, const jobinfo_t *b)
+{
+    return a->stopped > b->stopped;
+}
+
+int main(int argc, char **argv)
+{
+    int summary = 0, fd, c, shell = 0;
+    struct stat st;
+    char *base;
+    unsigned long long i, n;
+    std::vector<rec_t> recs;
+    std::map<long long, jobinfo_t> jobs;
+    long long t0, tend;
+
+    while ((c = getopt(argc, argv, "s")) != EOF) {
+	if (c == 's')
+	    summary = 1;
+	else {
+	    fprintf(stderr, "Usage: %s [-s] <logfile>\n", argv[0]);
+	    exit(1);
+	}
+    }
+    if (optind != argc - 1) {
+	fprintf(stderr, "Usage: %s [-s] <logfile>\n", argv[0]);
+	exit(1);
+    }
+
+    if ((fd = open(argv[optind], O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+	perror(argv[optind]);
+	exit(1);
+    }
+    if (st.st_size < EVLOG_HDRSIZE ||
+	(base = (char *)mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED ||
+	memcmp(base, EVLOG_MAGIC, sizeof(EVLOG_MAGIC)) != 0 ||
+	((struct evlog_hdr *)base)->recsize != sizeof(struct evlog_rec)) {
+	fprintf(stderr, "%s: not a tsh event log\n", argv[optind]);
+	exit(1);
+    }
+
+    /* Copy out every finished record, then put them in time order */
+    n = ((struct evlog_hdr *)base)->nrec.load(std::memory_order_acquire);
+    if (n > (st.st_size - EVLOG_HDRSIZE) / sizeof(struct evlog_rec))
+	n = (st.st_size - EVLOG_HDRSIZE) / sizeof(struct evlog_rec);
+    for (i = 0; i < n; i++) {
+	struct evlog_rec *r = (struct evlog_rec *)(base + EVLOG_HDRSIZE) + i;
+	rec_t x;
+
+	if ((x.ts = r->ts.load(std::memory_order_acquire)) == 0)
+	    continue;
+	x.kind = r->kind;
+	x.pid = r->pid;
+	x.jid = r->jid;
+	x.arg = r->arg;
+	memcpy(x.text, r->text, EVLOG_TEXT);
+	x.text[EVLOG_TEXT] = '\0';
+	trim(x.text);
+	recs.push_back(x);
+    }
+    if (recs.empty()) {
+	fprintf(stderr, "%s: log is empty\n", argv[optind]);
+	exit(1);
+    }
+    std::stable_sort(recs.begin(), recs.end(),
+		     [](const rec_t &a, const rec_t &b) { return a.ts < b.ts; });
+    t0 = recs.front().ts;
+    tend = recs.back().ts;
+
+    if (!summary)
+	printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    /* Fold the records into per-job intervals */
+    for (i = 0; i < recs.size(); i++) {
+	rec_t *r = &recs[i];
+	long long key;
+	jobinfo_t *j;
+
+	if (r->kind == LOG_START) {
+	    shell = r->pid;
+	    if (!summary)
+		printf("{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":%d,\"args\":{\"name\":\"tsh %d\"}},\n",
+		       shell, shell);
+	    continue;
+	}
+
+	if (!summary && r->kind != LOG_SPAWN && r->kind != LOG_EXIT)
+	    printf("{\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,"
+		   "\"args\":{\"jid\":%d,\"arg\":%d}},\n",
+		   r->kind < 13 ? kindname[r->kind] : "?", shell, r->pid,
+		   (r->ts - t0) / 1e3, r->jid, r->arg);
+
+	if (r->pid == 0)
+	    continue;
+	key = ((long long)shell << 32) | (unsigned)r->pid;
+	j = &jobs[key];
+
+	switch (r->kind) {
+	case LOG_SPAWN:
+	    j->shell = shell;
+	    j->pid = r->pid;
+	    j->jid = r->jid;
+	    j->spawn = r->ts;
+	    j->exit = 0;
+	    j->status = -1;
+	    strcpy(j->cmd, r->text);
+	    break;
+	case LOG_STOP:
+	    j->stopat = r->ts;
+	    break;
+	case LOG_CONT:
+	    if (j->stopat) {
+		j->stopped += r->ts - j->stopat;
+		if (!summary)
+		    printf("{\"ph\":\"X\",\"name\":\"stopped\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f},\n",
+			   shell, r->pid, (j->stopat - t0) / 1e3, (r->ts - j->stopat) / 1e3);
+		j->stopat = 0;
+	    }
+	    break;
+	case LOG_EXIT:
+	    j->exit = r->ts;
+	    j->status = r->arg;
+	    break;
+	}
+    }
+
+    /* Jobs still open at the end of the log run to the last record */
+    std::vector<jobinfo_t *> list;
+    for (auto &kv : jobs) {
+	jobinfo_t *j = &kv.second;
+
+	if (j->spawn == 0)
+	    continue;
+	if (j->exit == 0)
+	    j->exit = tend;
+	if (j->stopat) {
+	    j->stopped += j->exit - j->stopat;
+	    j->stopat = 0;
+	}
+	list.push_back(j);
+    }
+
+    if (!summary) {
+	for (i = 0; i < list.size(); i++) {
+	    jobinfo_t *j = list[i];
+
+	    printf("{\"ph\":\"X\",\"name\":");
+	    jsonstr(j->cmd);
+	    printf(",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+		   "\"args\":{\"jid\":%d,\"status\":%d,\"stopped_us\":%.3f}},\n",
+		   j->shell, j->pid, (j->spawn - t0) / 1e3, (j->exit - j->spawn) / 1e3,
+		   j->jid, j->status, j->stopped / 1e3);
+	}
+	/* Trailing metadata entry keeps the list free of a dangling comma */
+	printf("{\"ph\":\"M\",\"name\":\"tshlog\",\"pid\":0,\"args\":{\"records\":%zu}}\n]}\n",
+	       recs.size());
+	return 0;
+    }
+
+    printf("%zu records, %zu jobs, %.3f s\n", recs.size(), list.size(), (tend - t0) / 1e9);
+
+    std::sort(list.begin(), list.end(), bylongest);
+    printf("\nLongest-running jobs:\n");
+    for (i = 0; i < list.size() && i < 10; i++)
+	printf("  %10.3f s  [%d] (%d) %s\n", (list[i]->exit - list[i]->spawn) / 1e9,
+	       list[i]->jid, list[i]->pid, list[i]->cmd);
+
+    std::sort(list.begin(), list.end(), bystopped);
+    printf("\nTime spent stopped:\n");
+    for (i = 0; i < list.size() && i < 10 && list[i]->stopped > 0; i++)
+	printf("  %10.3f s  [%d] (%d) %s\n", list[i]->stopped / 1e9,
+	       list[i]->jid, list[i]->pid, list[i]->cmd);
+    return 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * tshmux.c - Throughput of tagged output (tsh -T)
+ *
+ * usage: tshmux [-j jobs] [-b bytes] [-l linelen] [-s shell] [shell args]
+ * Starts the shell with -p -T and its stdout on a pipe, runs <jobs>
+ * copies of "./mychat <bytes> <linelen> &" and reads everything back.
+ * Each tagged line must be a whole mychat line behind a "[jid] "
+ * prefix, and each job's sequence numbers must arrive in order with
+ * none missing. Reports the tagged bytes per second once every job's
+ * last line is in, and how much of the CPU time the checking took.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <vector>
+
+#define BUFSIZE (1024 * 1024)
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [-j jobs] [-b bytes] [-l linelen] [-s shell] [shell args]\n", prog);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int njobs = 64, len = 100, c, i, jid, bad = 0, left;
+    long bytes = 16 * 1024 * 1024, lines;
+    const char *shell = "./tsh";
+    std::vector<long> next;
+    char *buf, *p, *nl, *end, cmd[128];
+    int in[2], out[2];
+    long have = 0, total = 0;
+    ssize_t n;
+    pid_t pid;
+    struct rusage ru;
+    double t0, t1;
+
+    while ((c = getopt(argc, argv, "j:b:l:s:")) != EOF) {
+	switch (c) {
+	case 'j': njobs = atoi(optarg); break;
+	case 'b': bytes = atol(optarg); break;
+	case 'l': len = atoi(optarg); break;
+	case 's': shell = optarg; break;
+	default: usage(argv[0]);
+	}
+    }
+    lines = bytes / len;
+    if (njobs < 1 || len < 10 || lines < 1)
+	usage(argv[0]);
+
+    /* The shell: our pipes on its stdin and stdout */
+    signal(SIGPIPE, SIG_IGN);
+    if (pipe(in) < 0 || pipe(out) < 0) {
+	perror("pipe");
+	exit(1);
+    }
+    if ((pid = fork()) == 0) {
+	std::vector<char *> args;
+
+	dup2(in[0], STDIN_FILENO);
+	dup2(out[1], STDOUT_FILENO);
+	close(in[0]); close(in[1]); close(out[0]); close(out[1]);
+	args.push_back((char *)shell);
+	args.push_back((char *)"-p");
+	args.push_back((char *)"-T");
+	for (i = optind; i < argc; i++)
+	    args.push_back(argv[i]);
+	args.push_back(NULL);
+	execv(shell, &args[0]);
+	perror(shell);
+	exit(1);
+    }
+    close(in[0]);
+    close(out[1]);
+
+    buf = (char *)malloc(BUFSIZE);
+    next.assign(njobs + 1, 0);
+    left = njobs;
+    t0 = now();
+    snprintf(cmd, sizeof(cmd), "./mychat %ld %d &\n", bytes, len);
+    for (i = 0; i < njobs; i++)
+	if (write(in[1], cmd, strlen(cmd)) < 0) {
+	    perror("write");
+	    exit(1);
+	}
+
+    /* Check every line until every job has had its say */
+    while (left > 0 && (n = read(out[0], buf + have, BUFSIZE - have)) > 0) {
+	have += n;
+	for (p = buf, end = buf + have; (nl = (char *)memchr(p, '\n', end - p)) != NULL; p = nl + 1) {
+	    if (p[0] != '[' || (jid = atoi(p + 1)) < 1 || jid > njobs)
+		continue;               /* not ours */
+	    char *q = strchr(p, ']');
+	    if (q == NULL || q > nl || q[1] != ' ' || q[2] == '(')
+		continue;               /* a "[jid] (pid) cmdline" notice */
+	    q += 2;
+	    if (nl + 1 - q != len || q[8] != ' ' || atol(q) != next[jid]) {
+		if (bad++ < 5)
+		    fprintf(stderr, "job %d: bad line %.*s\n", jid, (int)(nl - p), p);
+		continue;
+	    }
+	    total += len;
+	    if (++next[jid] == lines)
+		left--;
+	}
+	have = end - p;
+	memmove(buf, p, have);
+    }
+    t1 = now();
+    close(in[1]);
+    while (read(out[0], buf, BUFSIZE) > 0)
+	;
+    waitpid(pid, NULL, 0);
+
+    if (left > 0)
+	fprintf(stderr, "%d of %d jobs never finished\n", left, njobs);
+    getrusage(RUSAGE_SELF, &ru);
+    printf("%d jobs x %ld lines of %d bytes: %.0f MB in %.2fs, %.2f GB/s, %d bad lines\n",
+	   njobs, lines, len, total / 1e6, t1 - t0, total / 1e9 / (t1 - t0), bad);
+    printf("checking took %.2fs of CPU\n", ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+	   ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6);
+    free(buf);
+    return (left > 0 || bad > 0);
+}
@@ -0,0 +1,177 @@
+/*
+ * tshtop.c - Live view of the jobs a tsh -b shell is running
+ *
+ * usage: tshtop [-1] <board>
+ * Takes a consistent snapshot of tsh's shared-memory job board ten
+ * times a second and adds CPU use and resident size per job from
+ * /proc/<pid>/stat. With -1, prints a single snapshot and exits.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <map>
+
+#include "jobs.h"
+#include "board.h"
+
+struct sample_t {           /* Last CPU reading for one PID */
+    unsigned long long ticks;
+    long long when;
+};
+
+static long long nowns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#define SNAP_TRIES 100000    /* seqlock retries before giving up on a snapshot */
+
+/*
+ * snapshot - Copy the board under its seqlock. Returns the number of
+ *    entries copied into out, or -1 if no consistent copy could be had
+ *    in SNAP_TRIES tries (the shell may have died in mid-update).
+ */
+static int snapshot(struct board_t *b, struct board_ent *out)
+{
+    unsigned s1, s2;
+    int n, tries;
+
+    for (tries = 0; tries < SNAP_TRIES; tries++) {
+	s1 = b->seq.load(std::memory_order_acquire);
+	if (s1 & 1)
+	    continue;                         /* writer in progress */
+	n = b->njobs;
+	if (n < 0 || n > MAXJOBS)
+	    continue;
+	memcpy(out, b->ent, n * sizeof(struct board_ent));
+	std::atomic_thread_fence(std::memory_order_acquire);
+	s2 = b->seq.load(std::memory_order_relaxed);
+	if (s1 == s2)
+	    return n;
+    }
+    return -1;
+}
+
+/* alive - Is the shell that publishes the board still running? */
+static int alive(pid_t shell)
+{
+    return kill(shell, 0) == 0 || errno == EPERM;
+}
+
+/* procstat - Read utime+stime (ticks) and RSS (pages) for pid */
+static int procstat(pid_t pid, unsigned long long *ticks, long *rss)
+{
+    char path[64], buf[1024], *p;
+    unsigned long long utime, stime;
+    int fd;
+    ssize_t len;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    if ((fd = open(path, O_RDONLY)) < 0)
+	return 0;
+    len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0)
+	return 0;
+    buf[len] = '\0';
+
+    /* comm may contain spaces; the fields we want follow the last ')' */
+    if ((p = strrchr(buf, ')')) == NULL)
+	return 0;
+    if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %*d %*d %*d %*d %*d %*d %*u %*u %ld",
+	       &utime, &stime, rss) != 3)
+	return 0;
+    *ticks = utime + stime;
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    int once = 0, fd, n, i, c;
+    char name[MAXLINE];
+    struct board_t *b;
+    static struct board_ent ents[MAXJOBS];
+    std::map<pid_t, sample_t> last;
+    long hz = sysconf(_SC_CLK_TCK), pagekb = sysconf(_SC_PAGESIZE) / 1024;
+
+    while ((c = getopt(argc, argv, "1")) != EOF) {
+	if (c == '1')
+	    once = 1;
+	else {
+	    fprintf(stderr, "Usage: %s [-1] <board>\n", argv[0]);
+	    exit(1);
+	}
+    }
+    if (optind != argc - 1) {
+	fprintf(stderr, "Usage: %s [-1] <board>\n", argv[0]);
+	exit(1);
+    }
+
+    snprintf(name, sizeof(name), "/%s", argv[optind][0] == '/' ? argv[optind] + 1 : argv[optind]);
+    if ((fd = shm_open(name, O_RDONLY, 0)) < 0) {
+	perror(name);
+	exit(1);
+    }
+    b = (struct board_t *)mmap(NULL, sizeof(struct board_t), PROT_READ, MAP_SHARED, fd, 0);
+    if (b == MAP_FAILED || memcmp(b->magic, BOARD_MAGIC, sizeof(BOARD_MAGIC)) != 0) {
+	fprintf(stderr, "%s: not a tsh job board\n", name);
+	exit(1);
+    }
+
+    for (;;) {
+	long long now = nowns();
+	std::map<pid_t, sample_t> cur;
+
+	if ((n = snapshot(b, ents)) < 0) {
+	    if (!alive(b->shell)) {
+		fprintf(stderr, "%s: tsh %d died mid-update; the board is stale\n", name, b->shell);
+		exit(1);
+	    }
+	    usleep(100000);             /* still busy: try again */
+	    continue;
+	}
+	if (!once)
+	    printf("\033[H\033[J");
+	if (alive(b->shell))
+	    printf("tsh %d: %d jobs\n", b->shell, n);
+	else
+	    printf("tsh %d: gone, the board is stale\n", b->shell);
+	printf("%5s %8s %-3s %6s %9s %9s  %s\n", "JID", "PID", "ST", "CPU%", "RSS(KB)", "ELAPSED", "COMMAND");
+
+	for (i = 0; i < n; i++) {
+	    struct board_ent *e = &ents[i];
+	    unsigned long long ticks = 0;
+	    long rss = 0;
+	    double cpu = 0;
+	    char *nl;
+
+	    if (procstat(e->pid, &ticks, &rss)) {
+		auto it = last.find(e->pid);
+
+		if (it != last.end() && now > it->second.when)
+		    cpu = 100.0 * (ticks - it->second.ticks) / hz / ((now - it->second.when) / 1e9);
+		cur[e->pid] = sample_t{ticks, now};
+	    }
+	    if ((nl = strchr(e->cmd, '\n')) != NULL)
+		*nl = '\0';
+	    printf("%5d %8d %-3s %6.1f %9ld %8.1fs  %s\n", e->jid, e->pid,
+		   e->state == FG ? "FG" : e->state == BG ? "BG" : e->state == ST ? "ST" : "?",
+		   cpu, rss * pagekb, (now - e->start) / 1e9, e->cmd);
+	}
+	fflush(stdout);
+	if (once)
+	    break;
+	last.swap(cur);
+	usleep(100000);   /* 10 Hz */
+    }
+    return 0;
+}
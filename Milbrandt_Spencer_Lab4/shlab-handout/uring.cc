@@ -0,0 +1,359 @@
+#include "uring.h"
+#include "events.h"
+#include "helper-routines.h"
+#include "globals.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/io_uring.h>
+
+/* IORING_OP_WAITID (Linux 6.7) is newer than the uapi headers we build with */
+#define OP_WAITID 50
+
+/* user_data tags; a watched fd's poll is tagged UD_WATCH | serial << 8 */
+#define UD_STDIN  1
+#define UD_SIGNAL 2
+#define UD_WAITID 3
+#define UD_WATCH  4
+#define UD_CANCEL 5
+
+int uring_on = 0;               /* main loop runs on io_uring (-u) */
+
+/*******************************
+ * io_uring main loop
+ *******************************/
+
+static int ringfd = -1;
+
+/* Submission queue */
+static unsigned *sqhead, *sqtail, *sqmask, *sqarray;
+static struct io_uring_sqe *sqes;
+static unsigned sqpending = 0;  /* queued but not yet handed to the kernel */
+static unsigned sqentries;
+
+/* Completion queue */
+static unsigned *cqhead, *cqtail, *cqmask;
+static struct io_uring_cqe *cqes;
+
+/* What's in flight */
+static int sigfd = -1;
+static int haswaitid = 0;       /* kernel supports OP_WAITID */
+static int stdinbusy = 0, sigbusy = 0, waitbusy = 0;
+static int childless = 0;       /* waitid said ECHILD; don't re-arm it yet */
+static struct signalfd_siginfo sigbuf[16];
+static siginfo_t waitinfo;
+
+/* Command input not handed out yet */
+static char inbuf[4 * MAXLINE];
+static int instart = 0, inlen = 0;
+static int ineof = 0;
+
+static int enter(unsigned want);
+static int watchdone(unsigned long long serial);
+
+/* getsqe - Next free submission slot, handing a full queue over first */
+static struct io_uring_sqe *getsqe(void)
+{
+    unsigned tail;
+
+    if (sqpending == sqentries)
+	enter(0);
+    tail = *sqtail + sqpending;
+    unsigned idx = tail & *sqmask;
+    struct io_uring_sqe *sqe = &sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqarray[idx] = idx;
+    sqpending++;
+    return sqe;
+}
+
+static void prepread(int fd, void *buf, unsigned len, unsigned long long tag)
+{
+    struct io_uring_sqe *sqe = getsqe();
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->off = (unsigned long long)-1;  /* current file position */
+    sqe->addr = (unsigned long)buf;
+    sqe->len = len;
+    sqe->user_data = tag;
+}
+
+/*
+ * prepwaitid - Ask to be told when any child has a status to report.
+ *    WNOWAIT leaves the status in place for reapchildren, which also
+ *    takes care of the event ring being full.
+ */
+static void prepwaitid(void)
+{
+    struct io_uring_sqe *sqe = getsqe();
+
+    sqe->opcode = OP_WAITID;
+    sqe->fd = 0;
+    sqe->len = P_ALL;
+    sqe->file_index = WEXITED | WSTOPPED | WNOWAIT;
+    sqe->addr2 = (unsigned long)&waitinfo;
+    sqe->user_data = UD_WAITID;
+    waitbusy = 1;
+}
+
+/* enter - Hand over queued submissions and wait for at least want completions */
+static int enter(unsigned want)
+{
+    int n;
+
+    __atomic_store_n(sqtail, *sqtail + sqpending, __ATOMIC_RELEASE);
+    n = syscall(__NR_io_uring_enter, ringfd, sqpending, want,
+		want ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (n >= 0)
+	sqpending = 0;
+    else if (errno != EINTR)
+	unix_error("io_uring_enter error");
+    return n;
+}
+
+/*
+ * complete - Handle every completion that's ready. Returns the number
+ *    of job events (children or signals) it queued.
+ */
+static int complete(void)
+{
+    unsigned head = *cqhead;
+    unsigned tail = __atomic_load_n(cqtail, __ATOMIC_ACQUIRE);
+    int i, n, events = 0;
+
+    for (; head != tail; head++) {
+	struct io_uring_cqe *cqe = &cqes[head & *cqmask];
+
+	switch (cqe->user_data) {
+	case UD_STDIN:
+	    stdinbusy = 0;
+	    if (cqe->res > 0)
+		inlen += cqe->res;
+	    else if (cqe->res != -EINTR)
+		ineof = 1;
+	    break;
+	case UD_SIGNAL:
+	    sigbusy = 0;
+	    n = cqe->res > 0 ? cqe->res / sizeof(sigbuf[0]) : 0;
+	    for (i = 0; i < n; i++, events++) {
+		if (sigbuf[i].ssi_signo == SIGCHLD)
+		    reapchildren();
+		else
+		    pushsignal(sigbuf[i].ssi_signo);
+	    }
+	    break;
+	case UD_CANCEL:
+	    break;
+	case UD_WAITID:
+	    waitbusy = 0;
+	    if (cqe->res == 0) {
+		reapchildren();
+		events++;
+	    }
+	    else if (cqe->res == -ECHILD)
+		childless = 1;
+	    break;
+	default:
+	    if ((cqe->user_data & 0xff) == UD_WATCH)
+		events += watchdone(cqe->user_data >> 8);
+	    break;
+	}
+    }
+    __atomic_store_n(cqhead, head, __ATOMIC_RELEASE);
+    return events;
+}
+
+/*
+ * watchdone - A watched fd's poll completed. The watch may be gone
+ *    (or cancelled) by now; its serial tells. Returns 1 if it ran.
+ */
+static int watchdone(unsigned long long serial)
+{
+    int i;
+
+    for (i = 0; i < nwatched(); i++) {
+	struct watch_t *w = getwatch(i);
+
+	if (w->serial == serial) {
+	    w->armed = 0;
+	    runwatch(w);
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+/* uringunwatch - Cancel the poll of a watch that is going away */
+void uringunwatch(unsigned serial)
+{
+    struct io_uring_sqe *sqe = getsqe();
+
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = ((unsigned long long)serial << 8) | UD_WATCH;
+    sqe->user_data = UD_CANCEL;
+}
+
+/* armjobs - Make sure signals, children and watched fds will wake us */
+static void armjobs(void)
+{
+    struct io_uring_sqe *sqe;
+    int i;
+
+    if (!sigbusy) {
+	prepread(sigfd, sigbuf, sizeof(sigbuf), UD_SIGNAL);
+	sigbusy = 1;
+    }
+    if (haswaitid && !waitbusy && !childless)
+	prepwaitid();
+    for (i = 0; i < nwatched(); i++) {
+	struct watch_t *w = getwatch(i);
+
+	if (w->armed)
+	    continue;
+	sqe = getsqe();
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = w->fd;
+	sqe->poll32_events = POLLIN;
+	sqe->user_data = ((unsigned long long)w->serial << 8) | UD_WATCH;
+	w->armed = 1;
+    }
+}
+
+/* probewaitid - True if this kernel's io_uring can do OP_WAITID */
+static int probewaitid(void)
+{
+    static char buf[sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op)];
+    struct io_uring_probe *probe = (struct io_uring_probe *)buf;
+
+    if (syscall(__NR_io_uring_register, ringfd, IORING_REGISTER_PROBE, probe, 256) < 0)
+	return 0;
+    return probe->last_op >= OP_WAITID &&
+	(probe->ops[OP_WAITID].flags & IO_URING_OP_SUPPORTED);
+}
+
+/*
+ * uringstart - Switch the shell to the io_uring loop. Returns 0 (and
+ *    changes nothing) if io_uring can't be used here, in which case
+ *    the caller installs the usual signal handlers.
+ */
+int uringstart(void)
+{
+    struct io_uring_params p;
+    size_t sqsize, cqsize;
+    char *sq, *cq;
+    sigset_t mask, prev;
+
+    memset(&p, 0, sizeof(p));
+    if ((ringfd = syscall(__NR_io_uring_setup, 64, &p)) < 0)
+	return 0;
+    fcntl(ringfd, F_SETFD, FD_CLOEXEC);
+
+    sqsize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqsize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+	sqsize = cqsize = sqsize > cqsize ? sqsize : cqsize;
+    sq = (char *)mmap(NULL, sqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		      ringfd, IORING_OFF_SQ_RING);
+    cq = sq;
+    if (sq != MAP_FAILED && !(p.features & IORING_FEAT_SINGLE_MMAP))
+	cq = (char *)mmap(NULL, cqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			  ringfd, IORING_OFF_CQ_RING);
+    sqes = (struct io_uring_sqe *)mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+				       PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				       ringfd, IORING_OFF_SQES);
+    if (sq == MAP_FAILED || cq == MAP_FAILED || sqes == MAP_FAILED) {
+	close(ringfd);
+	return 0;
+    }
+    sqhead = (unsigned *)(sq + p.sq_off.head);
+    sqtail = (unsigned *)(sq + p.sq_off.tail);
+    sqmask = (unsigned *)(sq + p.sq_off.ring_mask);
+    sqarray = (unsigned *)(sq + p.sq_off.array);
+    cqhead = (unsigned *)(cq + p.cq_off.head);
+    cqtail = (unsigned *)(cq + p.cq_off.tail);
+    cqmask = (unsigned *)(cq + p.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    sqentries = p.sq_entries;
+
+    /* Signals are read from the ring from now on; SIGCHLD only if we can't waitid */
+    haswaitid = probewaitid();
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTSTP);
+    if (!haswaitid)
+	sigaddset(&mask, SIGCHLD);
+    if ((sigfd = signalfd(-1, &mask, SFD_CLOEXEC)) < 0)
+	unix_error("signalfd error");
+    blockjobsigs(&prev);
+
+    uring_on = 1;
+    if (verbose)
+	printf("io_uring main loop (%s)\n", haswaitid ? "waitid" : "signalfd");
+    return 1;
+}
+
+/*
+ * uringline - Read one command line, newline included. Signals and
+ *    children are handled while we wait. Returns 0 at end of input;
+ *    like the fgets loop, a last line without a newline is dropped.
+ */
+int uringline(char *buf, int size)
+{
+    char *nl;
+    int n;
+
+    childless = 0;              /* eval may have started new children */
+    for (;;) {
+	nl = (char *)memchr(inbuf + instart, '\n', inlen - instart);
+	if (nl != NULL || inlen - instart >= size - 1) {
+	    n = nl != NULL ? nl - (inbuf + instart) + 1 : inlen - instart;
+	    if (n > size - 1)
+		n = size - 1;
+	    memcpy(buf, inbuf + instart, n);
+	    buf[n] = '\0';
+	    instart += n;
+	    return 1;
+	}
+	if (ineof)
+	    return 0;
+
+	if (!stdinbusy) {
+	    if (instart > 0) {          /* slide the partial line down */
+		memmove(inbuf, inbuf + instart, inlen - instart);
+		inlen -= instart;
+		instart = 0;
+	    }
+	    prepread(STDIN_FILENO, inbuf + inlen, sizeof(inbuf) - inlen, UD_STDIN);
+	    stdinbusy = 1;
+	}
+	armjobs();
+	enter(1);
+	complete();
+    }
+}
+
+/*
+ * uringwait - Sleep until something has been queued on the event
+ *    ring (or at least one completion was handled; the caller checks).
+ */
+void uringwait(void)
+{
+    childless = 0;
+    armjobs();
+    enter(1);
+    complete();
+}
+/*******************************
+ * end io_uring main loop
+ *******************************/
@@ -0,0 +1,26 @@
+//-*-c++-*-
+#ifndef _uring_h_
+#define _uring_h_
+
+/*
+ * io_uring main loop (tsh -u). The job signals stay blocked and no
+ * handlers are installed. Instead one io_uring carries every wait
+ * the shell does:
+ *     stdin   : READ of the next chunk of command input
+ *     signals : READ of a signalfd for SIGINT/SIGTSTP
+ *     watched : POLL_ADD on every watchfd() descriptor
+ *     children: WAITID (P_ALL, WNOWAIT) as a "some child changed" bell,
+ *               or SIGCHLD on the signalfd on kernels without it
+ * Completions are handled in batches. Children are then reaped and
+ * signals queued on the event ring exactly as the handlers would have
+ * done it, so drainevents and the rest of the shell don't change.
+ */
+
+extern int uring_on;
+
+int uringstart(void);
+int uringline(char *buf, int size);
+void uringwait(void);
+void uringunwatch(unsigned serial);
+
+#endif
@@ -0,0 +1,298 @@
+#include "vars.h"
+#include "tsh.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+extern char **environ;
+
+/**********************************
+ * Shell variables and expansion
+ **********************************/
+
+struct var_t {
+    std::string entry;      /* "NAME=VALUE", as it goes in envp */
+    size_t nlen;            /* length of NAME */
+    int exported;
+};
+
+static std::unordered_map<std::string, var_t> vars;
+static std::vector<char *> envv;    /* envp of new jobs, NULL-terminated */
+static int envdirty = 1;            /* an exported variable has changed */
+static std::string expbuf;          /* the current command's expanded words */
+
+/* namelen - Length of the variable name s starts with (0 if none) */
+static size_t namelen(const char *s)
+{
+    size_t n = 0;
+
+    if (!isalpha((unsigned char)s[0]) && s[0] != '_')
+	return 0;
+    while (isalnum((unsigned char)s[n]) || s[n] == '_')
+	n++;
+    return n;
+}
+
+/*
+ * varenv - Make environ the envp of the exported variables again if one
+ *    of them has changed. Every change calls this before it returns:
+ *    environ points into the entries, and setting or unsetting one may
+ *    free the memory it pointed to.
+ */
+static void varenv(void)
+{
+    std::unordered_map<std::string, var_t>::iterator it;
+
+    if (!envdirty)
+	return;
+    envv.clear();
+    for (it = vars.begin(); it != vars.end(); ++it)
+	if (it->second.exported)
+	    envv.push_back(&it->second.entry[0]);
+    envv.push_back(NULL);
+    environ = envv.data();
+    envdirty = 0;
+}
+
+/*
+ * setvar - Set name (of nlen bytes) to value. exported is 1 to export
+ *    it, 0 to leave the flag as it is.
+ */
+static void setvar(const char *name, size_t nlen, const char *value, int exported)
+{
+    var_t &v = vars[std::string(name, nlen)];
+
+    v.entry.assign(name, nlen);
+    v.entry += '=';
+    v.entry += value;
+    v.nlen = nlen;
+    v.exported |= exported;
+    envdirty |= v.exported;
+}
+
+/* getvar - The value of name (of nlen bytes), or NULL if it is unset */
+static const char *getvar(const char *name, size_t nlen)
+{
+    std::unordered_map<std::string, var_t>::iterator it = vars.find(std::string(name, nlen));
+
+    return it != vars.end() ? it->second.entry.c_str() + nlen + 1 : NULL;
+}
+
+/* varinit - Import the environment tsh was started with */
+void varinit(void)
+{
+    char **e;
+    const char *eq;
+
+    for (e = environ; *e != NULL; e++)
+	if ((eq = strchr(*e, '=')) != NULL && namelen(*e) == (size_t)(eq - *e))
+	    setvar(*e, eq - *e, eq + 1, 1);
+    varenv();
+}
+
+/* putnum - Append n to the expansion */
+static void putnum(long n)
+{
+    char num[24];
+
+    snprintf(num, sizeof(num), "%ld", n);
+    expbuf += num;
+}
+
+/*
+ * braced - Expand the "${...}" at p (p points at the '{'). Returns
+ *    what follows it, or NULL if it is malformed.
+ */
+static const char *braced(const char *p)
+{
+    const char *end = strchr(p, '}'), *val, *word;
+    size_t n = namelen(p + 1);
+    int colon, set;
+
+    if (end == NULL || n == 0)
+	return NULL;
+    val = getvar(p + 1, n);
+    p += 1 + n;
+    if (p == end) {
+	if (val != NULL)
+	    expbuf += val;
+	return end + 1;
+    }
+    colon = *p == ':';
+    p += colon;
+    if (*p != '-' && *p != '+')
+	return NULL;
+    word = p + 1;
+    set = val != NULL && (!colon || *val != '\0');
+    if (*p == '-')
+	set ? expbuf.append(val) : expbuf.append(word, end - word);
+    else if (set)
+	expbuf.append(word, end - word);
+    return end + 1;
+}
+
+/* expandword - Append the expansion of w to expbuf. 0 if it is malformed */
+static int expandword(const char *w)
+{
+    const char *p = w, *q, *val;
+    size_t n;
+
+    while (*p != '\0') {
+	if (*p != '$') {
+	    q = strchrnul(p, '$');
+	    expbuf.append(p, q - p);
+	    p = q;
+	    continue;
+	}
+	p++;
+	if (*p == '?') {
+	    putnum(laststatus);
+	    p++;
+	}
+	else if (*p == '$') {
+	    putnum(getpid());
+	    p++;
+	}
+	else if (*p == '{') {
+	    if ((p = braced(p)) == NULL)
+		return 0;
+	}
+	else if ((n = namelen(p)) > 0) {
+	    if ((val = getvar(p, n)) != NULL)
+		expbuf += val;
+	    p += n;
+	}
+	else
+	    expbuf += '$';  /* a lone '$' stands for itself */
+    }
+    return 1;
+}
+
+/*
+ * varexpand - Expand the words in place; quoted (see quotedwords) says
+ *    which to leave alone, and loses the entries of dropped words too.
+ *    Returns 0 (after saying why) if one is malformed.
+ */
+int varexpand(char **argv, char *quoted)
+{
+    size_t off[MAXARGS];
+    int i, j, dollar = 0;
+
+    for (i = 0; argv[i] != NULL; i++)
+	dollar |= strchr(argv[i], '$') != NULL;
+    if (!dollar)
+	return 1;
+
+    expbuf.clear();
+    for (i = 0; argv[i] != NULL; i++) {
+	off[i] = (size_t)-1;
+	if (strchr(argv[i], '$') == NULL || quoted[i])
+	    continue;
+	off[i] = expbuf.size();
+	if (!expandword(argv[i])) {
+	    printf("%s: bad substitution\n", argv[i]);
+	    return 0;
+	}
+	expbuf += '\0';
+    }
+
+    /* expbuf is done growing: point the words into it */
+    for (i = j = 0; argv[i] != NULL; i++) {
+	if (off[i] != (size_t)-1)
+	    argv[i] = &expbuf[off[i]];
+	if (argv[i][0] != '\0' || off[i] == (size_t)-1) {
+	    quoted[j] = quoted[i];
+	    argv[j++] = argv[i];
+	}
+    }
+    argv[j] = NULL;
+    return 1;
+}
+
+/* varassign - If every word is NAME=VALUE, set them all and return 1 */
+int varassign(char **argv)
+{
+    int i;
+
+    for (i = 0; argv[i] != NULL; i++)
+	if (namelen(argv[i]) == 0 || argv[i][namelen(argv[i])] != '=')
+	    return 0;
+    for (i = 0; argv[i] != NULL; i++)
+	setvar(argv[i], namelen(argv[i]), argv[i] + namelen(argv[i]) + 1, 0);
+    varenv();
+    return 1;
+}
+
+/* showvars - Print the (exported) variables as NAME=VALUE, sorted */
+static void showvars(const char *prefix, int exported)
+{
+    std::vector<const char *> lines;
+    std::unordered_map<std::string, var_t>::iterator it;
+    size_t i;
+
+    for (it = vars.begin(); it != vars.end(); ++it)
+	if (!exported || it->second.exported)
+	    lines.push_back(it->second.entry.c_str());
+    std::sort(lines.begin(), lines.end(),
+	      [](const char *a, const char *b) { return strcmp(a, b) < 0; });
+    for (i = 0; i < lines.size(); i++)
+	printf("%s%s\n", prefix, lines[i]);
+}
+
+/* varexport - export [NAME[=VALUE] ...] */
+void varexport(char **argv)
+{
+    std::unordered_map<std::string, var_t>::iterator it;
+    size_t n;
+    int i;
+
+    if (argv[1] == NULL) {
+	showvars("export ", 1);
+	return;
+    }
+    for (i = 1; argv[i] != NULL; i++) {
+	if ((n = namelen(argv[i])) == 0 || (argv[i][n] != '=' && argv[i][n] != '\0')) {
+	    printf("export: %s: not a valid name\n", argv[i]);
+	    continue;
+	}
+	if (argv[i][n] == '=')
+	    setvar(argv[i], n, argv[i] + n + 1, 1);
+	else if ((it = vars.find(argv[i])) != vars.end()) {
+	    envdirty |= !it->second.exported;
+	    it->second.exported = 1;
+	}
+	else
+	    setvar(argv[i], n, "", 1);
+    }
+    varenv();
+}
+
+/* varunset - unset NAME ... */
+void varunset(char **argv)
+{
+    std::unordered_map<std::string, var_t>::iterator it;
+    int i;
+
+    for (i = 1; argv[i] != NULL; i++) {
+	if ((it = vars.find(argv[i])) == vars.end())
+	    continue;
+	envdirty |= it->second.exported;
+	vars.erase(it);
+    }
+    varenv();
+}
+
+/* varshow - set: every variable */
+void varshow(void)
+{
+    showvars("", 0);
+}
+/**********************************
+ * end shell variables
+ **********************************/
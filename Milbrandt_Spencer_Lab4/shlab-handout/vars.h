@@ -0,0 +1,42 @@
+//-*-c++-*-
+#ifndef _vars_h_
+#define _vars_h_
+
+/*
+ * Shell variables and parameter expansion.
+ *
+ * Variables live in a hash map, each with an exported flag; the
+ * environment tsh started with is imported as exported variables.
+ * "NAME=VALUE ..." on a line of its own sets variables, export marks
+ * them (or sets and marks them) for the environment of new jobs, and
+ * unset removes them. set lists them all.
+ *
+ * After parseline, every word that holds a '$' and didn't come in
+ * single quotes is expanded:
+ *
+ *     $NAME, ${NAME}    the value ("" if unset)
+ *     ${NAME:-WORD}     WORD if NAME is unset or empty, else its value
+ *     ${NAME-WORD}      WORD if NAME is unset
+ *     ${NAME:+WORD}     WORD if NAME is set and not empty, else ""
+ *     ${NAME+WORD}      WORD if NAME is set
+ *     $?                status of the last foreground job, wait or dag
+ *     $$                the shell's pid
+ *
+ * WORD is taken literally, and a value is never split into several
+ * words; a word that expands to nothing is dropped. Words without a
+ * '$' are left where parseline put them. The expanded words go into
+ * one buffer that is reused by every command line.
+ *
+ * The environment of new jobs is an envp array of the exported
+ * variables, installed as environ. It is rebuilt as soon as an exported
+ * variable changes, since its entries point into the variables.
+ */
+
+void varinit(void);
+int varexpand(char **argv, char *quoted);
+int varassign(char **argv);
+void varexport(char **argv);
+void varunset(char **argv);
+void varshow(void);
+
+#endif